@@ -1,16 +1,24 @@
-
-#include <iostream>
-#include <enet/enet.h>
-
-#include "chat/chat_app.h"
-#include "util/byte_stream.h"
-
-int main(int argc, char* argv[])
-{
-    net::ENetContainer enet; // initialize ENet
-    
-    ChatApp app = ChatApp(); 
-    app.run();
-
-    return EXIT_SUCCESS;
-}
+
+#include <iostream>
+#include <enet/enet.h>
+
+#include "chat/chat_app.h"
+#include "util/byte_stream.h"
+
+int main(int argc, char* argv[])
+{
+    net::ENetContainer enet; // initialize ENet
+    
+    ChatApp app = ChatApp(); 
+    for (int i = 1; i < argc; ++i)
+    {
+        const std::string arg = argv[i];
+        // datagram checksums aren't negotiated, the host & every client must pass it
+        if (arg == "--checksum") app.getConfig()->checksum = true;
+        // message log directory (host), no log w/o it
+        else if (arg == "--log" && i + 1 < argc) app.getConfig()->log.directory = argv[++i];
+    }
+    app.run();
+
+    return EXIT_SUCCESS;
+}
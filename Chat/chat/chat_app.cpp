@@ -1,213 +1,473 @@
-﻿#include "chat_app.h"
-
-#include "network/enet_wrapper.h"
-#include "state/prompt_state_conn.h"
-#include "util/byte_stream.h"
-
-ChatApp::~ChatApp()
-{
-    delete m_enet;
-    delete m_state;
-    delete m_window;
-}
-
-void ChatApp::run()
-{
-    m_thread = std::jthread(&ChatApp::pollForInput, std::ref(*this));
-
-    m_window->init();
-    goToState(new PromptState_Conn(this));
-
-    // join thread here so application quits immediately
-    m_thread.join();
-}
-
-void ChatApp::quit()
-{
-    if (m_enet) m_enet->disconnectAll();
-    m_quit = true;
-}
-
-void ChatApp::host(const int port, const int max_connections)
-{
-    m_enet = new net::ENetWrapper(*this, true, port, NULL, max_connections);
-}
-
-void ChatApp::connect(const std::string& address, const int port)
-{
-    m_enet = new net::ENetWrapper(*this, false, port, NULL, 1);
-    m_enet->connect(address, port);
-}
-
-void ChatApp::goToState(State* state)
-{
-    if (m_state)
-    {
-        m_state->endState();
-        delete m_state;
-    }
-    m_state = state;
-    m_state->beginState();
-}
-
-void ChatApp::send(user_id_t user_id, protocol::UsernamePackage const& pkg) const
-{
-    ByteStream s;
-    pkg.serialize(s);
-    m_enet->send(toPeerID(user_id), s.getBuf());    
-}
-
-void ChatApp::send(user_id_t user_id, protocol::UsernameAckPackage const& pkg) const
-{
-    ByteStream s;
-    pkg.serialize(s);
-    m_enet->send(toPeerID(user_id), s.getBuf());
-}
-
-void ChatApp::send(user_id_t user_id, protocol::AddUserPackage const& pkg) const
-{
-    ByteStream s;
-    pkg.serialize(s);
-    m_enet->send(toPeerID(user_id), s.getBuf());
-}
-
-void ChatApp::send(user_id_t user_id, protocol::RemoveUserPackage const& pkg) const
-{
-    ByteStream s;
-    pkg.serialize(s);
-    m_enet->send(toPeerID(user_id), s.getBuf());
-}
-
-void ChatApp::send(user_id_t user_id, protocol::MessagePackage const& pkg) const
-{
-    ByteStream s;
-    pkg.serialize(s);
-    m_enet->send(toPeerID(user_id), s.getBuf());
-}
-
-void ChatApp::broadcast(protocol::AddUserPackage const& pkg) const
-{
-    ByteStream s;
-    pkg.serialize(s);
-    m_enet->broadcast(s.getBuf());
-}
-
-void ChatApp::broadcast(protocol::RemoveUserPackage const& pkg) const
-{
-    ByteStream s;
-    pkg.serialize(s);
-    m_enet->broadcast(s.getBuf());
-}
-
-void ChatApp::broadcast(protocol::MessagePackage const& pkg) const
-{
-    ByteStream s;
-    pkg.serialize(s);
-    m_enet->broadcast(s.getBuf());
-}
-
-void ChatApp::addUser(const UserInfo& user, bool is_local)
-{
-    std::lock_guard<std::mutex> lock(m_mutex);
-    m_users.insert(std::pair(user.user_id, user));
-    if (is_local) m_localuser_ptr = &m_users[user.user_id];
-    refreshUserList();
-}
-
-void ChatApp::removeUser(user_id_t user_id)
-{
-    std::lock_guard<std::mutex> lock(m_mutex);
-    m_users.erase(user_id);
-    refreshUserList();
-}
-
-bool ChatApp::containsUser(UserInfo const& user) const
-{
-    return m_users.contains(user.user_id);
-}
-
-UserInfo* ChatApp::getUserInfoPtr(user_id_t user_id)
-{
-    UserMap::iterator it = m_users.find(user_id);
-    if (it != m_users.end()) return &it->second;
-    return NULL;
-}
-
-bool ChatApp::isLocalUser(const UserInfo* user) const
-{
-    if (user && m_localuser_ptr)
-    {
-        return user->user_id == m_localuser_ptr->user_id;
-    }
-    return false;
-}
-
-void ChatApp::pollForInput() const
-{
-    char input[80];
-    while (!m_quit)
-    {
-        input[0] = 0; // ensure empty string
-        m_window->checkInputBox(input);
-        if (m_state && strlen(input) > 0)
-        {
-            m_state->handleInput(input);
-        }
-    }
-}
-
-void ChatApp::refreshUserList() const
-{
-    m_window->clearUserList();
-    for (auto it = m_users.begin(); it != m_users.end(); ++it)
-    {
-        const UserInfo* user = &it->second;
-        const bool is_local = m_localuser_ptr && m_localuser_ptr->user_id == user->user_id;
-        m_window->addUser(user->name, is_local);
-    }
-}
-
-// network callback
-void ChatApp::connectionEvent(net::NetworkTraffic const& e)
-{
-    if (m_state) m_state->receiveConnectionEvent(e.peer_id, e.peer_address);
-}
-
-// network callback
-void ChatApp::disconnectEvent(net::NetworkTraffic const& e)
-{
-    if (m_state) m_state->receiveDisconnectEvent(e.peer_id, e.peer_address);
-}
-
-// network callback
-void ChatApp::receiveEvent(net::NetworkTraffic const& e)
-{
-    ByteStream s(reinterpret_cast<const char*>(e.packet_data), e.packet_length);
-    switch (s.peekInt8())
-    {
-        case protocol::USERNAME: {
-                protocol::UsernamePackage pckt(s);
-                UserInfo user(toUserID(e.peer_id), pckt.username, e.peer_address);
-                if (m_state) m_state->receiveUsernameEvent(&user, pckt);
-                break;
-        } case protocol::USERNAME_ACK: {
-                protocol::UsernameAckPackage pckt(s);
-                if (m_state) m_state->receiveUsernameAckEvent(pckt);
-                break;
-        } case protocol::STATE_ADD_USER: {
-                protocol::AddUserPackage pckt(s);
-                if (m_state) m_state->receiveAddUserEvent(&pckt.user, pckt);
-                break;
-        } case protocol::STATE_REM_USER: {
-                protocol::RemoveUserPackage pckt(s);
-                UserInfo* user = getUserInfoPtr(pckt.user_id);
-                if (m_state) m_state->receiveRemoveUserEvent(user, pckt);
-                break;                
-        } case protocol::MESSAGE: {
-                protocol::MessagePackage pckt(s);
-                UserInfo* user = getUserInfoPtr(pckt.user_id);
-                if (m_state) m_state->receiveMessageEvent(user, pckt);
-                break;                
-        } default: { /* do nothing */ }
-    }
-}
+﻿#include "chat_app.h"
+
+#include "network/enet_wrapper.h"
+#include "state/prompt_state_conn.h"
+#include "util/byte_stream.h"
+
+ChatApp::~ChatApp()
+{
+    delete m_enet;
+    delete m_limiter;
+    delete m_state;
+    delete m_window;
+}
+
+void ChatApp::run()
+{
+    m_window->init();
+    goToState(new PromptState_Conn(this));
+
+    // UI loop, input is polled & repaints are coalesced into one terminal update per frame
+    while (!m_quit)
+    {
+        pollForInput();
+        m_window->render();
+        std::this_thread::sleep_for(ChatWindow::FRAME_INTERVAL);
+    }
+    m_window->render(); // final frame, e.g. quit prompt
+    m_window->awaitEnter();
+}
+
+void ChatApp::quit()
+{
+    if (m_enet) m_enet->disconnectAll();
+    m_quit = true;
+}
+
+void ChatApp::host(const int port, const int max_connections)
+{
+    m_limiter = new RateLimiter(max_connections, m_config.rate_limits);
+    m_hosting = true;
+    m_enet = new net::ENetWrapper(*this, true, port, NULL, max_connections);
+    m_enet->setChecksum(m_config.checksum);
+}
+
+void ChatApp::connect(const std::string& address, const int port)
+{
+    if (!m_enet) // reconnects reuse the client host, see ChatState_Client
+    {
+        m_enet = new net::ENetWrapper(*this, false, port, NULL, 1);
+        m_enet->setChecksum(m_config.checksum);
+    }
+    m_enet->connect(address, port);
+}
+
+void ChatApp::goToState(State* state)
+{
+    std::lock_guard<std::recursive_mutex> lock(m_state_mutex); // the network thread may be inside the old state
+    if (m_state)
+    {
+        m_state->endState();
+        delete m_state;
+    }
+    m_state = state;
+    m_state->beginState();
+}
+
+// user list sync packets are sent reliably: versioned deltas only apply on top of each other
+
+void ChatApp::send(user_id_t user_id, protocol::UsernamePackage const& pkg) const
+{
+    ByteStream s;
+    pkg.serialize(s);
+    m_enet->send(toPeerID(user_id), s.getBuf(), true);
+}
+
+void ChatApp::send(user_id_t user_id, protocol::UsernameAckPackage const& pkg) const
+{
+    ByteStream s;
+    pkg.serialize(s);
+    m_enet->send(toPeerID(user_id), s.getBuf(), true);
+}
+
+void ChatApp::sendUserListPage(user_id_t user_id, uint32_t roster_version, uint16_t page_index, uint16_t page_count,
+    uint16_t user_count, const ByteStream& users) const
+{
+    ByteStream header;
+    protocol::UserListPagePackage::serializeHeader(header, roster_version, page_index, page_count, user_count);
+    m_enet->send(toPeerID(user_id), {
+        net::NetworkTraffic(reinterpret_cast<const enet_uint8*>(header.getBufPtr()), header.getLength()),
+        net::NetworkTraffic(reinterpret_cast<const enet_uint8*>(users.getBufPtr()), users.getLength())
+    }, true);
+}
+
+void ChatApp::send(user_id_t user_id, protocol::AddUserPackage const& pkg) const
+{
+    ByteStream s;
+    pkg.serialize(s);
+    m_enet->send(toPeerID(user_id), s.getBuf());
+}
+
+void ChatApp::send(user_id_t user_id, protocol::RemoveUserPackage const& pkg) const
+{
+    ByteStream s;
+    pkg.serialize(s);
+    m_enet->send(toPeerID(user_id), s.getBuf());
+}
+
+void ChatApp::send(user_id_t user_id, protocol::MessagePackage const& pkg) const
+{
+    ByteStream s;
+    pkg.serialize(s);
+    m_enet->send(toPeerID(user_id), s.getBuf());
+}
+
+void ChatApp::send(user_id_t user_id, protocol::UserDeltaPackage const& pkg) const
+{
+    ByteStream s;
+    pkg.serialize(s);
+    m_enet->send(toPeerID(user_id), s.getBuf(), true);
+}
+
+void ChatApp::send(user_id_t user_id, protocol::DictionaryPackage const& pkg) const
+{
+    ByteStream s;
+    pkg.serialize(s);
+    m_enet->send(toPeerID(user_id), s.getBuf(), true);
+}
+
+void ChatApp::send(user_id_t user_id, protocol::KeyExchangePackage const& pkg) const
+{
+    ByteStream s;
+    pkg.serialize(s);
+    m_enet->send(toPeerID(user_id), s.getBuf(), true);
+}
+
+void ChatApp::send(user_id_t user_id, protocol::JoinRoomPackage const& pkg) const
+{
+    ByteStream s;
+    pkg.serialize(s);
+    m_enet->send(toPeerID(user_id), s.getBuf(), true);
+}
+
+void ChatApp::send(user_id_t user_id, protocol::RoomMembersPackage const& pkg) const
+{
+    ByteStream s;
+    pkg.serialize(s);
+    m_enet->send(toPeerID(user_id), s.getBuf(), true);
+}
+
+void ChatApp::send(user_id_t user_id, protocol::DirectMessagePackage const& pkg) const
+{
+    ByteStream s;
+    pkg.serialize(s);
+    m_enet->send(toPeerID(user_id), s.getBuf(), true);
+}
+
+void ChatApp::broadcast(protocol::AddUserPackage const& pkg) const
+{
+    ByteStream s;
+    pkg.serialize(s);
+    m_enet->broadcast(s.getBuf());
+}
+
+void ChatApp::broadcast(protocol::RemoveUserPackage const& pkg) const
+{
+    ByteStream s;
+    pkg.serialize(s);
+    m_enet->broadcast(s.getBuf());
+}
+
+void ChatApp::broadcast(protocol::MessagePackage const& pkg) const
+{
+    ByteStream s;
+    pkg.serialize(s);
+    m_enet->broadcast(s.getBuf());
+}
+
+void ChatApp::broadcast(protocol::UserDeltaPackage const& pkg) const
+{
+    ByteStream s;
+    pkg.serialize(s);
+    m_enet->broadcast(s.getBuf(), true);
+}
+
+void ChatApp::sendPacket(user_id_t user_id, const std::string& packet, bool reliable) const
+{
+    m_enet->send(toPeerID(user_id), packet, reliable);
+}
+
+void ChatApp::sendPacket(const std::vector<user_id_t>& user_ids, const std::string& packet, bool reliable) const
+{
+    std::vector<net::peer_id_t> peer_ids;
+    peer_ids.reserve(user_ids.size());
+    for (user_id_t user_id : user_ids) peer_ids.push_back(toPeerID(user_id));
+    m_enet->sendToMany(peer_ids, packet, reliable);
+}
+
+void ChatApp::sendPacket(const net::PeerSet& peers, const std::string& packet, bool reliable) const
+{
+    m_enet->sendToMany(peers, packet, reliable);
+}
+
+void ChatApp::startSession(user_id_t user_id, const crypto::SessionKeys& keys)
+{
+    m_enet->startSession(toPeerID(user_id), keys);
+}
+
+void ChatApp::disconnect(user_id_t user_id)
+{
+    m_enet->disconnect(toPeerID(user_id));
+}
+
+size_t ChatApp::maxPayload(user_id_t user_id) const
+{
+    return m_enet->getMaxPayload(toPeerID(user_id));
+}
+
+size_t ChatApp::maxBroadcastPayload() const
+{
+    return m_enet->getMaxBroadcastPayload();
+}
+
+net::TrafficStats ChatApp::getTrafficStats() const
+{
+    return m_enet ? m_enet->getStats() : net::TrafficStats();
+}
+
+void ChatApp::setCompression(bool enabled)
+{
+    if (m_enet) m_enet->setCompression(enabled);
+}
+
+net::CompressionStats ChatApp::getCompressionStats() const
+{
+    return m_enet ? m_enet->getCompressionStats() : net::CompressionStats();
+}
+
+RateLimitStats ChatApp::getRateLimitStats() const
+{
+    return m_limiter ? m_limiter->getStats() : RateLimitStats();
+}
+
+bool ChatApp::addUser(const UserInfo& user, bool is_local)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    auto users = std::make_shared<UserRegistry>(*m_users.load(std::memory_order_relaxed));
+    if (!users->insert(user)) return false;
+    m_users.store(std::move(users), std::memory_order_release);
+    if (is_local) m_local_user_id = user.user_id;
+    m_window->addUser(user.user_id, user.name, is_local);
+    return true;
+}
+
+void ChatApp::removeUser(user_id_t user_id)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    auto users = std::make_shared<UserRegistry>(*m_users.load(std::memory_order_relaxed));
+    users->erase(user_id);
+    m_users.store(std::move(users), std::memory_order_release);
+    if (m_local_user_id == user_id) m_local_user_id = -1;
+    m_window->removeUser(user_id);
+}
+
+void ChatApp::updateUsers(const std::vector<user_id_t>& removed, const std::vector<UserInfo>& added)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    auto users = std::make_shared<UserRegistry>(*m_users.load(std::memory_order_relaxed));
+    // the local user ID stays, it's assigned by the host (see setLocalUserID): after a reconnect,
+    // the catch-up delta may drop our old entry under the ID we were just given
+    for (user_id_t user_id : removed)
+    {
+        if (!users->erase(user_id)) continue;
+        m_window->removeUser(user_id);
+    }
+    for (const UserInfo& user : added)
+    {
+        if (users->insert(user)) m_window->addUser(user.user_id, user.name, m_local_user_id == user.user_id);
+    }
+    m_users.store(std::move(users), std::memory_order_release);
+}
+
+void ChatApp::resetUsers()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_users.store(std::make_shared<UserRegistry>(), std::memory_order_release);
+    m_window->clearUserList();
+}
+
+bool ChatApp::containsUser(UserInfo const& user) const
+{
+    return getUsers()->contains(user.user_id);
+}
+
+UserHandle ChatApp::findUser(user_id_t user_id) const
+{
+    return UserHandle(getUsers(), user_id);
+}
+
+UserHandle ChatApp::getLocalUser() const
+{
+    const int32_t local_user_id = m_local_user_id;
+    if (local_user_id < 0) return UserHandle();
+    return UserHandle(getUsers(), static_cast<user_id_t>(local_user_id));
+}
+
+void ChatApp::setLocalUserID(user_id_t user_id)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_local_user_id = user_id;
+    // already registered? mark it as local in the user list
+    if (UserHandle user = findUser(user_id)) m_window->addUser(user_id, user->name, true);
+}
+
+bool ChatApp::isLocalUser(const UserRef* user) const
+{
+    return user && m_local_user_id == user->user_id;
+}
+
+void ChatApp::pollForInput()
+{
+    m_window->pollInput();
+
+    std::string input;
+    while (!m_quit && m_window->nextInput(input))
+    {
+        std::lock_guard<std::recursive_mutex> lock(m_state_mutex);
+        if (m_state) m_state->handleInput(input);
+    }
+}
+
+// network callback
+void ChatApp::connectionEvent(net::NetworkTraffic const& e)
+{
+    std::lock_guard<std::recursive_mutex> lock(m_state_mutex);
+    if (m_limiter) m_limiter->reset(e.peer_id);
+    if (m_state) m_state->receiveConnectionEvent(e.peer_id, e.peer_address);
+}
+
+// network callback
+void ChatApp::disconnectEvent(net::NetworkTraffic const& e)
+{
+    std::lock_guard<std::recursive_mutex> lock(m_state_mutex);
+    if (m_state) m_state->receiveDisconnectEvent(e.peer_id, e.peer_address);
+}
+
+// network callback
+void ChatApp::receiveEvent(net::NetworkTraffic const& e)
+{
+    static constexpr DispatchTable host_table = makeDispatchTable(protocol::Packages(), protocol::FROM_CLIENT);
+    static constexpr DispatchTable client_table = makeDispatchTable(protocol::Packages(), protocol::FROM_HOST);
+
+    // floods are dropped before any decoding or fan-out
+    if (m_limiter)
+    {
+        const RateLimiter::Verdict verdict = m_limiter->check(e.peer_id, e.packet_length);
+        if (verdict == RateLimiter::KICK)
+        {
+            m_window->error("Disconnecting " + e.peer_address.str() + " for flooding");
+            m_enet->disconnect(e.peer_id);
+        }
+        if (verdict != RateLimiter::ACCEPT) return;
+    }
+
+    ByteStream s(reinterpret_cast<const char*>(e.packet_data), e.packet_length);
+    const uint8_t packet_type = static_cast<uint8_t>(s.peekInt8());
+    const DispatchTable& table = m_hosting ? host_table : client_table;
+    if (packet_type >= protocol::PACKET_TYPE_COUNT || !table[packet_type]) return; // unknown type, or not the sender's to send
+    std::lock_guard<std::recursive_mutex> lock(m_state_mutex);
+    try
+    {
+        table[packet_type](*this, e, s);
+    }
+    catch (const std::out_of_range&)
+    {
+        m_window->error("Truncated packet received from " + e.peer_address.str());
+    }
+}
+
+void ChatApp::handle(net::NetworkTraffic const& e, protocol::UsernamePackage& pkg)
+{
+    UserInfo user(toUserID(e.peer_id), pkg.username, e.peer_address);
+    m_state->receiveUsernameEvent(&user, pkg);
+}
+
+void ChatApp::handle(net::NetworkTraffic const& e, protocol::UsernameAckPackage& pkg)
+{
+    m_state->receiveUsernameAckEvent(pkg);
+}
+
+void ChatApp::handle(net::NetworkTraffic const& e, protocol::AddUserPackage& pkg)
+{
+    m_state->receiveAddUserEvent(&pkg.user, pkg);
+}
+
+void ChatApp::handle(net::NetworkTraffic const& e, protocol::RemoveUserPackage& pkg)
+{
+    UserHandle user = findUser(pkg.user_id);
+    m_state->receiveRemoveUserEvent(user.get(), pkg);
+}
+
+void ChatApp::handle(net::NetworkTraffic const& e, protocol::MessagePackage& pkg)
+{
+    // the host knows the sender by its peer, whatever the package claims
+    if (m_hosting) pkg.user_id = toUserID(e.peer_id);
+    UserHandle user = findUser(pkg.user_id);
+    m_state->receiveMessageEvent(user.get(), pkg);
+}
+
+void ChatApp::handle(net::NetworkTraffic const& e, protocol::UserDeltaPackage& pkg)
+{
+    m_state->receiveUserDeltaEvent(pkg);
+}
+
+void ChatApp::handle(net::NetworkTraffic const& e, protocol::UserListPagePackage& pkg)
+{
+    m_state->receiveUserListPageEvent(pkg);
+}
+
+void ChatApp::handle(net::NetworkTraffic const& e, protocol::MessageBatchPackage& pkg)
+{
+    handleMessages(pkg.messages);
+}
+
+void ChatApp::handle(net::NetworkTraffic const& e, protocol::MessageBatchVarintPackage& pkg)
+{
+    handleMessages(pkg.messages);
+}
+
+void ChatApp::handle(net::NetworkTraffic const& e, protocol::DictionaryPackage& pkg)
+{
+    m_state->receiveDictionaryEvent(pkg);
+}
+
+void ChatApp::handle(net::NetworkTraffic const& e, protocol::KeyExchangePackage& pkg)
+{
+    m_state->receiveKeyExchangeEvent(toUserID(e.peer_id), pkg);
+}
+
+void ChatApp::handle(net::NetworkTraffic const& e, protocol::JoinRoomPackage& pkg)
+{
+    UserHandle user = findUser(toUserID(e.peer_id));
+    m_state->receiveJoinRoomEvent(user.get(), pkg);
+}
+
+void ChatApp::handle(net::NetworkTraffic const& e, protocol::RoomMembersPackage& pkg)
+{
+    m_state->receiveRoomMembersEvent(pkg);
+}
+
+void ChatApp::handle(net::NetworkTraffic const& e, protocol::DirectMessagePackage& pkg)
+{
+    UserHandle user = findUser(toUserID(e.peer_id)); // the sender, on the host
+    m_state->receiveDirectMessageEvent(user.get(), pkg);
+}
+
+void ChatApp::handleMessages(std::vector<protocol::MessagePackage>& messages)
+{
+    // batches only come from the host (clients' are dropped undecoded), so the senders are trusted.
+    // Decoded in one pass, senders are looked up in a single user snapshot
+    UserSnapshot users = getUsers();
+    for (protocol::MessagePackage& message : messages)
+    {
+        std::optional<UserRef> user = users->find(message.user_id);
+        m_state->receiveMessageEvent(user ? &*user : nullptr, message);
+    }
+}
+
+// network callback
+void ChatApp::tickEvent()
+{
+    std::lock_guard<std::recursive_mutex> lock(m_state_mutex);
+    if (m_state) m_state->tick();
+}
@@ -1,97 +1,203 @@
-﻿#pragma once
-
-#include "chat_win.h"
-#include "userinfo.h"
-#include "network/enet_wrapper.h"
-#include "network/protocol.h"
-
-class ChatApp : net::NetworkListener
-{
-public:
-    // Configuration set by local user 
-    struct ChatConfig
-    {
-        bool conn_as_host;     ///< start connection as host?
-        std::string nickname;  ///< local user's nickname
-
-        ChatConfig() : conn_as_host(false) {}
-    };
-    
-    ChatApp() : m_window(new ChatWindow()), m_enet(), m_quit(false) {}
-    ~ChatApp();
-
-    // Starts the application
-    void run();
-    
-    // Quits the application
-    void quit();
-
-    // Start ENet as host
-    void host(const int port, const int max_connections = 16);
-        
-    // Start ENet as client & connect to the provided address
-    void connect(const std::string& address, const int port);
-    
-    // Controls the chat app's state, **always** use this to change state
-    void goToState(State* state);
-    
-    void send(user_id_t user_id, protocol::UsernamePackage const& pkg) const;
-    void send(user_id_t user_id, protocol::UsernameAckPackage const& pkg) const;
-    void send(user_id_t user_id, protocol::AddUserPackage const& pkg) const;
-    void send(user_id_t user_id, protocol::RemoveUserPackage const& pkg) const;
-    void send(user_id_t user_id, protocol::MessagePackage const& pkg) const;
-    
-    void broadcast(protocol::AddUserPackage const& pkg) const;
-    void broadcast(protocol::RemoveUserPackage const& pkg) const;
-    void broadcast(protocol::MessagePackage const& pkg) const;
-
-    void addUser(const UserInfo& user, bool is_local = false);
-    void removeUser(user_id_t user_id);
-    bool containsUser(UserInfo const& user) const;
-
-    ChatWindow* getWindow() const { return m_window; }
-    ChatConfig* getConfig() { return &m_config; }
- 
-    UserInfo* getUserInfoPtr(user_id_t user_id);
-    UserMap& getUserMap() { return m_users; }
-
-    UserInfo* getLocalUserPtr() const { return m_localuser_ptr; }
-    void setLocalUserPtr(UserInfo* user) { m_localuser_ptr = user; }
-    bool isLocalUser(const UserInfo* user) const;
-
-    static net::peer_id_t toUserID(net::peer_id_t peer_id)
-    {
-        return peer_id + 1;
-    }
-    
-    static net::peer_id_t toPeerID(user_id_t user_id)
-    {
-        return (user_id == 0) ? 0 : user_id - 1;
-    }
-    
-private:
-    // Polls for user input
-    void pollForInput() const;
-
-    // Refreshs user listing
-    void refreshUserList() const;
-    
-protected:
-    //~Begin NetworkListener interface
-    void connectionEvent(net::NetworkTraffic const& e) override;
-    void disconnectEvent(net::NetworkTraffic const& e) override;
-    void receiveEvent(net::NetworkTraffic const& e) override;
-    //~End NetworkListener interface
-    
-private:
-    ChatWindow* m_window;      ///< chat window
-    net::ENetWrapper* m_enet;  ///< ENet wrapper
-    ChatConfig m_config;       ///< local chat configuration
-    UserInfo* m_localuser_ptr; ///< pointer to local user
-    UserMap m_users; ///< map of users by user ID
-    State* m_state;  ///< window prompt state
-    bool m_quit;     ///< flag used to control main thread
-    mutable std::mutex m_mutex; ///< mutex
-    std::jthread m_thread;      ///< chat window thread 
-};
-
+﻿#pragma once
+
+#include <array>
+#include <atomic>
+#include <mutex>
+
+#include "chat_win.h"
+#include "message_history.h"
+#include "message_log.h"
+#include "rate_limiter.h"
+#include "user_registry.h"
+#include "userinfo.h"
+#include "network/enet_wrapper.h"
+#include "network/protocol.h"
+
+class ChatApp : net::NetworkListener
+{
+public:
+    // Configuration set by local user 
+    struct ChatConfig
+    {
+        bool conn_as_host;     ///< start connection as host?
+        std::string nickname;  ///< local user's nickname
+        bool checksum;         ///< CRC32C checksums on datagrams? off by default, not negotiated: host & clients must match
+        bool encryption;       ///< encrypt sessions? (w/ peers that support it)
+        RateLimits rate_limits; ///< limits on what each client may send (host)
+        HistoryLimits history;  ///< recent messages kept for newcomers (host)
+        MessageLogConfig log;   ///< persistent message log (host)
+
+        ChatConfig() : conn_as_host(false), checksum(false), encryption(true) {}
+    };
+
+    // Replicated user list version (client), see RosterLog
+    struct RosterVersion
+    {
+        uint32_t epoch = 0;   ///< host session the version belongs to, 0 if none yet
+        uint32_t version = 0; ///< last applied user list version
+    };
+    
+    ChatApp() : m_window(new ChatWindow()), m_enet(), m_limiter(nullptr), m_users(std::make_shared<UserRegistry>()), m_state(nullptr), m_quit(false) {}
+    ~ChatApp();
+
+    // Starts the application
+    void run();
+    
+    // Quits the application
+    void quit();
+
+    // Start ENet as host
+    void host(const int port, const int max_connections = 16);
+        
+    // Start ENet as client & connect to the provided address (again, once disconnected)
+    void connect(const std::string& address, const int port);
+    
+    // Controls the chat app's state, **always** use this to change state
+    void goToState(State* state);
+    
+    void send(user_id_t user_id, protocol::UsernamePackage const& pkg) const;
+    void send(user_id_t user_id, protocol::UsernameAckPackage const& pkg) const;
+    void send(user_id_t user_id, protocol::AddUserPackage const& pkg) const;
+    void send(user_id_t user_id, protocol::RemoveUserPackage const& pkg) const;
+    void send(user_id_t user_id, protocol::MessagePackage const& pkg) const;
+    void send(user_id_t user_id, protocol::UserDeltaPackage const& pkg) const;
+    void send(user_id_t user_id, protocol::DictionaryPackage const& pkg) const;
+    void send(user_id_t user_id, protocol::KeyExchangePackage const& pkg) const;
+    void send(user_id_t user_id, protocol::JoinRoomPackage const& pkg) const;
+    void send(user_id_t user_id, protocol::RoomMembersPackage const& pkg) const;
+    void send(user_id_t user_id, protocol::DirectMessagePackage const& pkg) const;
+
+    // Sends USER_LIST_PAGE w/ pre-serialized users, see UserListCache
+    void sendUserListPage(user_id_t user_id, uint32_t roster_version, uint16_t page_index, uint16_t page_count,
+        uint16_t user_count, const ByteStream& users) const;
+    
+    void broadcast(protocol::AddUserPackage const& pkg) const;
+    void broadcast(protocol::RemoveUserPackage const& pkg) const;
+    void broadcast(protocol::MessagePackage const& pkg) const;
+    void broadcast(protocol::UserDeltaPackage const& pkg) const;
+
+    // Sends an already serialized package
+    void sendPacket(user_id_t user_id, const std::string& packet, bool reliable = false) const;
+    // Sends an already serialized package to several users, sharing one ENet packet
+    void sendPacket(const std::vector<user_id_t>& user_ids, const std::string& packet, bool reliable = false) const;
+    // Sends an already serialized package to a precomputed set of peers, see toPeerID
+    void sendPacket(const net::PeerSet& peers, const std::string& packet, bool reliable = false) const;
+
+    // Encrypts all further traffic w/ a user's peer, see ENetWrapper::startSession
+    void startSession(user_id_t user_id, const crypto::SessionKeys& keys);
+
+    // Disconnects a user's peer
+    void disconnect(user_id_t user_id);
+
+    // Largest packet sent to a user (or broadcast) w/o being fragmented by ENet
+    size_t maxPayload(user_id_t user_id) const;
+    size_t maxBroadcastPayload() const;
+    net::TrafficStats getTrafficStats() const;
+
+    // Turns compression of outgoing datagrams on/off, for all peers
+    void setCompression(bool enabled);
+    net::CompressionStats getCompressionStats() const;
+    RateLimitStats getRateLimitStats() const;
+
+    // Users are published as immutable snapshots: writers (add/remove) copy the
+    // current registry, modify it & swap it in under m_mutex, readers simply
+    // load the latest snapshot, without locking, & never wait on writers.
+    // Each write copies the registry, i.e. O(users) per join/leave, see
+    // BENCH(registry_snapshot_publish); bulk changes go through updateUsers
+    // @return false if the user ID was already taken
+    bool addUser(const UserInfo& user, bool is_local = false);
+    void removeUser(user_id_t user_id);
+    // Applies a batch of removals, then additions, as a single registry update
+    void updateUsers(const std::vector<user_id_t>& removed, const std::vector<UserInfo>& added);
+    // Removes all users, e.g. before loading a user list snapshot
+    void resetUsers();
+    bool containsUser(UserInfo const& user) const;
+
+    ChatWindow* getWindow() const { return m_window; }
+    ChatConfig* getConfig() { return &m_config; }
+    RosterVersion* getRosterVersion() { return &m_roster_version; }
+ 
+    UserHandle findUser(user_id_t user_id) const;
+    UserSnapshot getUsers() const { return m_users.load(std::memory_order_acquire); }
+
+    UserHandle getLocalUser() const;
+    // Sets the local user's ID, which may be registered later on (e.g. in a user list page)
+    void setLocalUserID(user_id_t user_id);
+    bool isLocalUser(const UserRef* user) const;
+
+    static net::peer_id_t toUserID(net::peer_id_t peer_id)
+    {
+        return peer_id + 1;
+    }
+    
+    static net::peer_id_t toPeerID(user_id_t user_id)
+    {
+        return (user_id == 0) ? 0 : user_id - 1;
+    }
+    
+private:
+    // Polls for user input & hands completed lines to the current state
+    void pollForInput();
+    
+    // Received packets are decoded & handed to the state through a table indexed by
+    // packet type, one decoder per package in protocol::Packages, built at compile time.
+    // The host & the client each have their own table, only holding the packages the
+    // other end may send (see protocol::Sender), others are dropped undecoded
+    typedef void (*Decoder)(ChatApp& app, net::NetworkTraffic const& e, ByteStream& s);
+    typedef std::array<Decoder, protocol::PACKET_TYPE_COUNT> DispatchTable;
+
+    template <typename Pkg>
+    static void decode(ChatApp& app, net::NetworkTraffic const& e, ByteStream& s)
+    {
+        Pkg pkg(s);
+        if (app.m_state) app.handle(e, pkg);
+    }
+
+    template <typename... Pkgs>
+    static constexpr DispatchTable makeDispatchTable(protocol::PackageList<Pkgs...>, uint8_t sender)
+    {
+        DispatchTable table{};
+        ((table[Pkgs::TYPE] = (Pkgs::SENDERS & sender) ? &decode<Pkgs> : nullptr), ...);
+        return table;
+    }
+
+    // Package handlers, called w/ a state set
+    void handle(net::NetworkTraffic const& e, protocol::UsernamePackage& pkg);
+    void handle(net::NetworkTraffic const& e, protocol::UsernameAckPackage& pkg);
+    void handle(net::NetworkTraffic const& e, protocol::AddUserPackage& pkg);
+    void handle(net::NetworkTraffic const& e, protocol::RemoveUserPackage& pkg);
+    void handle(net::NetworkTraffic const& e, protocol::MessagePackage& pkg);
+    void handle(net::NetworkTraffic const& e, protocol::UserDeltaPackage& pkg);
+    void handle(net::NetworkTraffic const& e, protocol::UserListPagePackage& pkg);
+    void handle(net::NetworkTraffic const& e, protocol::MessageBatchPackage& pkg);
+    void handle(net::NetworkTraffic const& e, protocol::MessageBatchVarintPackage& pkg);
+    void handle(net::NetworkTraffic const& e, protocol::DictionaryPackage& pkg);
+    void handle(net::NetworkTraffic const& e, protocol::KeyExchangePackage& pkg);
+    void handle(net::NetworkTraffic const& e, protocol::JoinRoomPackage& pkg);
+    void handle(net::NetworkTraffic const& e, protocol::RoomMembersPackage& pkg);
+    void handle(net::NetworkTraffic const& e, protocol::DirectMessagePackage& pkg);
+    void handleMessages(std::vector<protocol::MessagePackage>& messages);
+    
+protected:
+    //~Begin NetworkListener interface
+    void connectionEvent(net::NetworkTraffic const& e) override;
+    void disconnectEvent(net::NetworkTraffic const& e) override;
+    void receiveEvent(net::NetworkTraffic const& e) override;
+    void tickEvent() override;
+    //~End NetworkListener interface
+    
+private:
+    ChatWindow* m_window;      ///< chat window
+    net::ENetWrapper* m_enet;  ///< ENet wrapper
+    RateLimiter* m_limiter;    ///< limits received traffic per client (host), checked before decoding
+    bool m_hosting = false;    ///< hosting the session? selects the dispatch table
+    ChatConfig m_config;       ///< local chat configuration
+    RosterVersion m_roster_version; ///< replicated user list version (network thread only)
+    std::atomic<int32_t> m_local_user_id{ -1 }; ///< local user's ID, -1 until registered
+    std::atomic<UserSnapshot> m_users; ///< latest snapshot of the user registry
+    State* m_state;  ///< window prompt state
+    std::recursive_mutex m_state_mutex; ///< held while calling into m_state or swapping it (UI & network threads), recursive as states swap from their own callbacks
+    std::atomic<bool> m_quit;   ///< flag used to control main thread
+    mutable std::mutex m_mutex; ///< serializes user registry writers
+};
+
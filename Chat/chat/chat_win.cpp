@@ -1,116 +1,389 @@
-﻿#include "chat_win.h"
-
-ChatWindow::~ChatWindow()
-{
-    endwin();
-
-    delete m_inputwin;
-    delete m_userwin;
-}
-
-void ChatWindow::init()
-{
-    // curses setup
-    initscr();
-
-    // colors
-    start_color();
-    init_pair(WHITE, COLOR_WHITE, COLOR_BLACK);
-    init_pair(RED, COLOR_RED, COLOR_BLACK);
-    init_pair(GREEN, COLOR_GREEN, COLOR_BLACK);
-    init_pair(CYAN, COLOR_CYAN, COLOR_BLACK);
-    
-    refresh();
-}
-
-void ChatWindow::checkInputBox(char outMsg[80]) const
-{    
-    // Clear input box
-    wclear(m_inputwin);
-    box(m_inputwin, 0, 0);
-
-    // Await user input
-    mvwscanw(m_inputwin, 1, 1, "%[^\n]", outMsg);
-}
-
-void ChatWindow::print(const std::string& msg)
-{
-    color_set(WHITE, nullptr);
-    mvprintw(m_msg_win_y, 40, "%s", msg.c_str());
-    refresh();
-    m_msg_win_y++;
-}
-
-void ChatWindow::print(const std::string& username, const std::string& msg, bool local)
-{
-    color_set((local ? CYAN : WHITE), nullptr);
-    mvprintw(m_msg_win_y, 40, "%s: %s", username.c_str(), msg.c_str());
-    refresh();
-    m_msg_win_y++;
-}
-
-void ChatWindow::log(const std::string& msg)
-{
-    color_set(GREEN, nullptr);
-    mvprintw(m_msg_win_y, 40, "[LOG] %s", msg.c_str());
-    refresh();
-    m_msg_win_y++;
-}
-
-void ChatWindow::error(const std::string& msg)
-{
-    color_set(RED, nullptr);
-    mvprintw(m_msg_win_y, 40, "[ERROR] %s", msg.c_str());
-    refresh();
-    m_msg_win_y++;
-}
-
-void ChatWindow::clearAll()
-{
-    clearMessages();
-    clearUserList();
-}
-
-void ChatWindow::clearMessages()
-{
-    clear();
-
-    int yMax, xMax;
-    getmaxyx(stdscr, yMax, xMax);
-    
-    // creating input box
-    m_inputwin = newwin(3, xMax-10, yMax-4, 5);
-    wcolor_set(m_inputwin, WHITE, nullptr);
-    box(m_inputwin, 0, 0);
-
-    refresh();
-    wrefresh(m_inputwin);
-
-    // resetting y-index var
-    m_msg_win_y = 1;
-}
-
-void ChatWindow::clearUserList()
-{
-    wclear(m_userwin);
-
-    // creating log box
-    m_userwin = newwin(24, 30, 1, 5);
-    wcolor_set(m_userwin, WHITE, nullptr);
-    box(m_userwin, 0, 0);
-
-    refresh();
-    wrefresh(m_userwin);
-
-    // resetting y-index var
-    m_user_win_y = 1;
-}
-
-void ChatWindow::addUser(const std::string& username, bool is_local)
-{
-    wcolor_set(m_userwin, (is_local ? CYAN : WHITE), nullptr);
-    mvwprintw(m_userwin, m_user_win_y, 2,  (is_local ? "*%s" : "%s"), username.c_str());
-    wrefresh(m_userwin);
-    m_user_win_y++;
-}
-
+﻿#include "chat_win.h"
+
+#include <algorithm>
+
+#include "util/utf8.h"
+
+namespace
+{
+    const int MSG_WIN_X = 40; ///< first column of the message panel
+    const int MSG_WIN_Y = 1;  ///< first row of the message panel
+
+    const int USER_WIN_HEIGHT = 24; ///< user list panel height, incl. border
+    const int USER_WIN_WIDTH = 30;  ///< user list panel width, incl. border
+    const size_t USER_ROWS = USER_WIN_HEIGHT - 3; ///< users listed at once, below the summary row
+}
+
+ChatWindow::~ChatWindow()
+{
+    if (m_userwin) delwin(m_userwin);
+
+    if (stdscr) endwin(); // unless never initialized, e.g. in tests
+}
+
+void ChatWindow::init()
+{
+    // curses setup
+    initscr();
+    cbreak();
+    noecho();
+
+    // colors
+    start_color();
+    init_pair(WHITE, COLOR_WHITE, COLOR_BLACK);
+    init_pair(RED, COLOR_RED, COLOR_BLACK);
+    init_pair(GREEN, COLOR_GREEN, COLOR_BLACK);
+    init_pair(CYAN, COLOR_CYAN, COLOR_BLACK);
+    
+    m_dirty = true;
+}
+
+void ChatWindow::render()
+{
+    Command cmd;
+    while (m_commands.pop(cmd)) apply(cmd);
+    if (!m_dirty) return;
+
+    drawMessages();
+    wnoutrefresh(stdscr);
+
+    if (m_userwin)
+    {
+        if (m_users_dirty) drawUserList();
+        m_users_dirty = false;
+        wnoutrefresh(m_userwin);
+    }
+
+    // input box last, so the cursor is left in it
+    if (WINDOW* inputwin = m_input.window())
+    {
+        if (m_input_dirty) m_input.draw();
+        m_input_dirty = false;
+        wnoutrefresh(inputwin);
+    }
+
+    doupdate();
+    m_dirty = false;
+
+    // posted lines are on screen now
+    const Clock::time_point now = Clock::now();
+    for (const Clock::time_point& posted : m_frame_posts) m_latency.record(now - posted);
+    m_frame_posts.clear();
+}
+
+void ChatWindow::apply(Command& cmd)
+{
+    switch (cmd.kind)
+    {
+        case Command::POST: {
+                m_scrollback.push(cmd.color, std::move(cmd.text));
+                m_frame_posts.push_back(cmd.posted);
+                m_dirty = true;
+                break;
+        } case Command::ADD_USER: {
+                auto it = findUser(cmd.user_id);
+                UserEntry entry = { cmd.user_id, std::move(cmd.text), cmd.is_local };
+                if (it != m_users.end() && it->user_id == cmd.user_id) *it = std::move(entry);
+                else m_users.insert(it, std::move(entry));
+                m_users_dirty = m_dirty = true;
+                break;
+        } case Command::REMOVE_USER: {
+                auto it = findUser(cmd.user_id);
+                if (it == m_users.end() || it->user_id != cmd.user_id) break;
+                m_users.erase(it);
+                m_users_dirty = m_dirty = true;
+                break;
+        } case Command::CLEAR_MESSAGES: {
+                applyClearMessages();
+                break;
+        } case Command::CLEAR_USER_LIST: {
+                // creating log box, once, it is redrawn in place afterwards
+                if (!m_userwin) m_userwin = newwin(USER_WIN_HEIGHT, USER_WIN_WIDTH, 1, 5);
+                m_users.clear();
+                m_user_top = 0;
+                m_users_dirty = m_dirty = true;
+                break;
+        }
+    }
+}
+
+std::string ChatWindow::latencyStats() const
+{
+    return m_latency.str();
+}
+
+void ChatWindow::pollInput()
+{
+    for (int ch = m_input.readKey(); ch != ERR; ch = m_input.readKey())
+    {
+        if (ch == KEY_PPAGE || ch == KEY_NPAGE) scrollPage(ch == KEY_PPAGE);
+        else if (ch == KEY_SPREVIOUS || ch == KEY_SNEXT) scrollUsers(ch == KEY_SPREVIOUS);
+        else if (m_input.handleKey(ch)) m_input_dirty = m_dirty = true;
+    }
+}
+
+bool ChatWindow::nextInput(std::string& out_line)
+{
+    return m_input.popLine(out_line);
+}
+
+void ChatWindow::awaitEnter()
+{
+    WINDOW* inputwin = m_input.window();
+    if (!inputwin) return;
+
+    nodelay(inputwin, FALSE);
+    for (int ch = wgetch(inputwin); ch != '\n' && ch != '\r' && ch != KEY_ENTER; ch = wgetch(inputwin)) {}
+    nodelay(inputwin, TRUE);
+}
+
+void ChatWindow::scrollPage(bool up)
+{
+    if (m_scrollback.empty()) return;
+
+    const int page = msgHeight();
+    RowPos top = visibleTop();
+    if (up)
+    {
+        moveUp(top, page);
+        m_top = top;
+        m_follow = false;
+    }
+    else
+    {
+        moveDown(top, page);
+        m_top = top;
+        m_follow = !(top < bottomTop()); // reached the newest messages
+    }
+    m_dirty = true;
+}
+
+void ChatWindow::scrollUsers(bool up)
+{
+    const size_t last_top = m_users.size() > USER_ROWS ? m_users.size() - USER_ROWS : 0;
+    m_user_top = std::min(m_user_top, last_top);
+    if (up) m_user_top -= std::min(m_user_top, USER_ROWS);
+    else m_user_top = std::min(m_user_top + USER_ROWS, last_top);
+    m_users_dirty = m_dirty = true;
+}
+
+void ChatWindow::post(TextColor color, std::string text)
+{
+    Command cmd;
+    cmd.kind = Command::POST;
+    cmd.color = color;
+    cmd.text = std::move(text);
+    cmd.posted = Clock::now();
+    m_commands.push(std::move(cmd));
+}
+
+int ChatWindow::msgWidth() const
+{
+    return std::max(getmaxx(stdscr) - MSG_WIN_X, 1);
+}
+
+int ChatWindow::msgHeight() const
+{
+    // rows above the input box
+    return std::max(getmaxy(stdscr) - 4 - MSG_WIN_Y, 1);
+}
+
+int ChatWindow::rowCount(uint64_t line) const
+{
+    const int width = msgWidth();
+    const int length = static_cast<int>(utf8::length(m_scrollback.at(line).text));
+    return std::max((length + width - 1) / width, 1);
+}
+
+void ChatWindow::moveUp(RowPos& pos, int n) const
+{
+    while (n > 0)
+    {
+        if (pos.row > 0)
+        {
+            const int k = std::min(n, pos.row);
+            pos.row -= k;
+            n -= k;
+        }
+        else if (pos.line > m_scrollback.begin())
+        {
+            pos.line--;
+            pos.row = rowCount(pos.line) - 1;
+            n--;
+        }
+        else break;
+    }
+}
+
+void ChatWindow::moveDown(RowPos& pos, int n) const
+{
+    while (n > 0)
+    {
+        const int last = rowCount(pos.line) - 1;
+        if (pos.row < last)
+        {
+            const int k = std::min(n, last - pos.row);
+            pos.row += k;
+            n -= k;
+        }
+        else if (pos.line + 1 < m_scrollback.end())
+        {
+            pos.line++;
+            pos.row = 0;
+            n--;
+        }
+        else break;
+    }
+}
+
+ChatWindow::RowPos ChatWindow::bottomTop() const
+{
+    if (m_scrollback.empty()) return { m_scrollback.end(), 0 };
+    RowPos pos = { m_scrollback.end() - 1, rowCount(m_scrollback.end() - 1) - 1 };
+    moveUp(pos, msgHeight() - 1);
+    return pos;
+}
+
+ChatWindow::RowPos ChatWindow::visibleTop() const
+{
+    if (m_follow) return bottomTop();
+
+    RowPos pos = m_top;
+    if (pos.line < m_scrollback.begin()) pos = { m_scrollback.begin(), 0 }; // evicted while scrolled up
+    else if (pos.line < m_scrollback.end()) pos.row = std::min(pos.row, rowCount(pos.line) - 1);
+    return pos;
+}
+
+void ChatWindow::drawMessages()
+{
+    const int width = msgWidth();
+    const int height = msgHeight();
+
+    RowPos pos = visibleTop();
+
+    for (int y = 0; y < height; ++y)
+    {
+        move(MSG_WIN_Y + y, MSG_WIN_X);
+        clrtoeol();
+        if (pos.line >= m_scrollback.end()) continue;
+
+        // rows hold width characters, cut between UTF-8 sequences
+        const Scrollback::Line& line = m_scrollback.at(pos.line);
+        const size_t begin = utf8::advance(line.text, 0, static_cast<size_t>(pos.row) * width);
+        const size_t end = utf8::advance(line.text, begin, width);
+        if (begin < end)
+        {
+            color_set(line.color, nullptr);
+            addnstr(line.text.c_str() + begin, static_cast<int>(end - begin));
+        }
+
+        if (pos.row + 1 < rowCount(pos.line)) pos.row++;
+        else pos = { pos.line + 1, 0 };
+    }
+}
+
+void ChatWindow::print(const std::string& msg)
+{
+    post(WHITE, msg);
+}
+
+void ChatWindow::print(const std::string& username, const std::string& msg, bool local)
+{
+    post((local ? CYAN : WHITE), username + ": " + msg);
+}
+
+void ChatWindow::log(const std::string& msg)
+{
+    post(GREEN, "[LOG] " + msg);
+}
+
+void ChatWindow::error(const std::string& msg)
+{
+    post(RED, "[ERROR] " + msg);
+}
+
+void ChatWindow::clearAll()
+{
+    clearMessages();
+    clearUserList();
+}
+
+void ChatWindow::clearMessages()
+{
+    Command cmd;
+    cmd.kind = Command::CLEAR_MESSAGES;
+    m_commands.push(std::move(cmd));
+}
+
+void ChatWindow::applyClearMessages()
+{
+    clear();
+
+    int yMax, xMax;
+    getmaxyx(stdscr, yMax, xMax);
+    
+    // creating input box, once, it is redrawn in place afterwards
+    m_input.create(3, xMax-10, yMax-4, 5);
+    m_input.clear();
+    m_input_dirty = true;
+    m_users_dirty = true;
+
+    // resetting scrollback
+    m_scrollback.clear();
+    m_follow = true;
+    m_dirty = true;
+}
+
+void ChatWindow::clearUserList()
+{
+    Command cmd;
+    cmd.kind = Command::CLEAR_USER_LIST;
+    m_commands.push(std::move(cmd));
+}
+
+std::vector<ChatWindow::UserEntry>::iterator ChatWindow::findUser(user_id_t user_id)
+{
+    return std::lower_bound(m_users.begin(), m_users.end(), user_id,
+        [](const UserEntry& entry, user_id_t id) { return entry.user_id < id; });
+}
+
+void ChatWindow::addUser(user_id_t user_id, const std::string& username, bool is_local)
+{
+    Command cmd;
+    cmd.kind = Command::ADD_USER;
+    cmd.user_id = user_id;
+    cmd.text = username;
+    cmd.is_local = is_local;
+    m_commands.push(std::move(cmd));
+}
+
+void ChatWindow::removeUser(user_id_t user_id)
+{
+    Command cmd;
+    cmd.kind = Command::REMOVE_USER;
+    cmd.user_id = user_id;
+    m_commands.push(std::move(cmd));
+}
+
+void ChatWindow::drawUserList()
+{
+    werase(m_userwin);
+    wcolor_set(m_userwin, WHITE, nullptr);
+    box(m_userwin, 0, 0);
+
+    // the list may have shrunk since it was scrolled
+    const size_t last_top = m_users.size() > USER_ROWS ? m_users.size() - USER_ROWS : 0;
+    m_user_top = std::min(m_user_top, last_top);
+    const size_t end = std::min(m_user_top + USER_ROWS, m_users.size());
+
+    // summary row (w/ the listed range once there's more than fits), then the listed users
+    if (m_users.size() > USER_ROWS) mvwprintw(m_userwin, 1, 2, "%zu users, %zu-%zu", m_users.size(), m_user_top + 1, end);
+    else mvwprintw(m_userwin, 1, 2, "%zu user%s", m_users.size(), (m_users.size() == 1 ? "" : "s"));
+    for (size_t i = m_user_top; i < end; ++i)
+    {
+        const UserEntry& user = m_users[i];
+        wcolor_set(m_userwin, (user.is_local ? CYAN : WHITE), nullptr);
+        mvwprintw(m_userwin, static_cast<int>(i - m_user_top) + 2, 2, (user.is_local ? "*%.*s" : "%.*s"),
+            USER_WIN_WIDTH - 5, user.username.c_str());
+    }
+}
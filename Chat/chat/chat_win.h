@@ -1,71 +1,203 @@
-﻿#pragma once
-
-#include <string>
-#include "curses.h"
-#include "userinfo.h"
-
-class State;
-
-/**
- * Simple Chat Window using PDCurses, includes
- * operations to post/display messages
- *
- * TODO (aleforte) nice to have:
- *  - scrolling to text display window
- *  - fix column alignment on window resize
- */
-class ChatWindow
-{
-public:
-    
-    enum TextColor : uint8_t
-    {
-        WHITE = 0,
-        RED = 1,
-        GREEN = 2,
-        CYAN = 3
-    };
-
-    ChatWindow() = default;
-    ~ChatWindow();
-
-    // Initializes chat window
-    void init();
-    
-    // Checks input box for user input and copies to buffer
-    void checkInputBox(char outMsg[80]) const;
-
-    // Prints message to the main chat window
-    void print(const std::string& msg);
-
-    // Prints message, prefixed with username, to the main chat window
-    void print(const std::string& username, const std::string& msg, bool local = false);
-
-    // Prints log message to window
-    void log(const std::string& msg);
-
-    // Prints error message to window
-    void error(const std::string& msg);
-
-    // Refreshes all window panels
-    void clearAll();
-
-    // Refreshes message panel
-    void clearMessages();
-
-    // Refreshes user list panel
-    void clearUserList();
-
-    // Adds user to user list panel
-    void addUser(const std::string& username, bool is_local);
-    
-private:
-    // Message window Y-axis, used to slot messages as they are posted
-    int m_msg_win_y = 1;
-
-    // User window Y-axis, used to slot usernames as they join session
-    int m_user_win_y = 1;
-
-    WINDOW* m_inputwin = nullptr; ///< Textbox for user input
-    WINDOW* m_userwin = nullptr;  ///< Window listing connected users
-};
+﻿#pragma once
+
+#include <chrono>
+#include <string>
+#include <vector>
+#include "curses.h"
+#include "input_box.h"
+#include "scrollback.h"
+#include "userinfo.h"
+#include "util/latency_histogram.h"
+#include "util/mpsc_queue.h"
+
+class State;
+
+/**
+ * Simple Chat Window using PDCurses, includes
+ * operations to post/display messages
+ *
+ * Posting a message only appends to an in-memory model and marks it dirty,
+ * the terminal is repainted once per frame by render() (see FRAME_INTERVAL)
+ *
+ * Messages are kept in a bounded scrollback, only the rows visible in the
+ * message panel are drawn. PageUp/PageDown scroll through the history.
+ * Likewise the user list is kept sorted by user ID and patched per join/leave,
+ * only the users fitting in the panel are drawn. Shift+PageUp/PageDown scroll
+ * through the list.
+ *
+ * Input is read keystroke by keystroke without blocking (see pollInput), so
+ * the window is driven from a single thread that polls input & renders.
+ *
+ * Curses is not thread-safe, hence the window is owned by that UI thread:
+ * the post/user list methods below may be called from any thread, they only
+ * queue a command which the UI thread applies on its next render(). Everything
+ * else (init, render, input) must be called from the UI thread.
+ *
+ * TODO (aleforte) nice to have:
+ *  - fix column alignment on window resize
+ */
+class ChatWindow
+{
+public:
+    
+    enum TextColor : uint8_t
+    {
+        WHITE = 0,
+        RED = 1,
+        GREEN = 2,
+        CYAN = 3
+    };
+
+    // Time between two repaints, i.e. ~30 frames per second
+    static constexpr std::chrono::milliseconds FRAME_INTERVAL{33};
+
+    ChatWindow(size_t max_lines = Scrollback::DEFAULT_MAX_LINES, size_t max_bytes = Scrollback::DEFAULT_MAX_BYTES)
+        : m_scrollback(max_lines, max_bytes) {}
+    ~ChatWindow();
+
+    // Initializes chat window
+    void init();
+
+    // Applies queued commands & repaints dirty regions in a single terminal update
+    void render();
+    
+    // Reads pending keystrokes into the input box, never blocks
+    void pollInput();
+
+    // Pops the oldest line completed in the input box
+    // @return false if no line is pending
+    bool nextInput(std::string& out_line);
+
+    // Blocks until the user presses Enter
+    void awaitEnter();
+
+    // Summary of the post-to-screen latency of posted lines, see LatencyHistogram::str
+    std::string latencyStats() const;
+
+    // Prints message to the main chat window
+    void print(const std::string& msg);
+
+    // Prints message, prefixed with username, to the main chat window
+    void print(const std::string& username, const std::string& msg, bool local = false);
+
+    // Prints log message to window
+    void log(const std::string& msg);
+
+    // Prints error message to window
+    void error(const std::string& msg);
+
+    // Refreshes all window panels
+    void clearAll();
+
+    // Refreshes message panel
+    void clearMessages();
+
+    // Refreshes user list panel
+    void clearUserList();
+
+    // Adds user to user list panel (replaces an entry w/ the same user ID)
+    void addUser(user_id_t user_id, const std::string& username, bool is_local);
+
+    // Removes user from user list panel
+    void removeUser(user_id_t user_id);
+    
+private:
+    typedef std::chrono::steady_clock Clock;
+
+    // A UI mutation, queued by any thread & applied by the UI thread
+    struct Command
+    {
+        enum Kind : uint8_t
+        {
+            POST,            // post text as a line of the message panel
+            ADD_USER,        // add/replace a user of the user list, text holds the username
+            REMOVE_USER,     // remove a user of the user list
+            CLEAR_MESSAGES,  // reset message panel
+            CLEAR_USER_LIST, // reset user list panel
+        };
+
+        Kind kind = POST;
+        TextColor color = WHITE;
+        user_id_t user_id = 0;
+        bool is_local = false;
+        std::string text;
+        Clock::time_point posted; ///< when the command was queued
+    };
+
+    // A row in the message panel, i.e. a line of the scrollback plus the wrapped row within it
+    struct RowPos
+    {
+        uint64_t line = 0; ///< scrollback sequence number
+        int row = 0;       ///< wrapped row within the line
+
+        bool operator<(const RowPos& other) const
+        {
+            return line < other.line || (line == other.line && row < other.row);
+        }
+    };
+
+    // A user listed in the user list panel
+    struct UserEntry
+    {
+        user_id_t user_id;     ///< user's ID, sort key
+        std::string username;  ///< user's nickname
+        bool is_local;         ///< is this the local user?
+    };
+
+    // Queues a line for the message panel
+    void post(TextColor color, std::string text);
+
+    // Applies a queued command to the model (UI thread)
+    void apply(Command& cmd);
+
+    // Resets message panel & input box (UI thread)
+    void applyClearMessages();
+
+    // Scrolls message panel by a page, towards older (up) or newer messages
+    void scrollPage(bool up);
+
+    // Scrolls user list panel by a page
+    void scrollUsers(bool up);
+
+    // Message panel layout, derived from the terminal size
+    int msgWidth() const;
+    int msgHeight() const;
+
+    // Number of rows a scrollback line wraps to, msgWidth() UTF-8 characters each
+    int rowCount(uint64_t line) const;
+
+    // Moves a row position up/down by n rows, O(n), clamped to the scrollback
+    void moveUp(RowPos& pos, int n) const;
+    void moveDown(RowPos& pos, int n) const;
+
+    // First visible row when the panel follows the newest messages
+    RowPos bottomTop() const;
+
+    // First visible row, clamped to the lines still held in the scrollback
+    RowPos visibleTop() const;
+
+    // Draws the visible rows of the message panel
+    void drawMessages();
+
+    // Draws the user count & the users fitting in the user list panel, from m_user_top on
+    void drawUserList();
+
+    // Returns the first user entry w/ an ID not less than user_id
+    std::vector<UserEntry>::iterator findUser(user_id_t user_id);
+
+    Scrollback m_scrollback;  ///< message history
+    RowPos m_top;             ///< first visible row, when not following
+    bool m_follow = true;     ///< true if the panel sticks to the newest messages
+    std::vector<UserEntry> m_users; ///< listed users, sorted by user ID
+    size_t m_user_top = 0;          ///< first user shown in the user list panel
+    bool m_dirty = false;       ///< true if anything changed since the last frame
+    bool m_users_dirty = false; ///< true if the user list changed since the last frame
+
+    MPSCQueue<Command> m_commands;              ///< commands waiting for the UI thread
+    std::vector<Clock::time_point> m_frame_posts; ///< queue times of lines drawn by the pending frame
+    LatencyHistogram m_latency;                 ///< post-to-screen latency of posted lines
+
+    InputBox m_input;             ///< Textbox for user input
+    bool m_input_dirty = false;   ///< true if the input box changed since the last frame
+    WINDOW* m_userwin = nullptr;  ///< Window listing connected users
+};
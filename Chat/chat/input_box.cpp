@@ -0,0 +1,159 @@
+﻿#include "input_box.h"
+
+#include <algorithm>
+
+#include "util/utf8.h"
+
+InputBox::~InputBox()
+{
+    if (m_win) delwin(m_win);
+}
+
+void InputBox::create(int height, int width, int y, int x)
+{
+    if (m_win) return;
+
+    m_win = newwin(height, width, y, x);
+    keypad(m_win, TRUE);  // decode arrow/page keys
+    nodelay(m_win, TRUE); // wgetch returns ERR instead of blocking
+}
+
+int InputBox::readKey() const
+{
+    return m_win ? wgetch(m_win) : ERR;
+}
+
+bool InputBox::handleKey(int ch)
+{
+    // the rest of a UTF-8 sequence, inserted as one character once complete
+    if (!m_pending.empty() && ch >= 0x80 && ch <= 0xFF && utf8::isContinuation(static_cast<char>(ch)))
+    {
+        m_pending += static_cast<char>(ch);
+        if (m_pending.length() < utf8::sequenceLength(m_pending[0])) return false;
+        insert(m_pending);
+        m_pending.clear();
+        return true;
+    }
+    const bool flushed = !m_pending.empty();
+    flushPending();
+
+    switch (ch)
+    {
+        case '\n': case '\r': case KEY_ENTER:
+#ifdef PADENTER
+        case PADENTER:
+#endif
+            submit();
+            return true;
+        case KEY_BACKSPACE: case '\b': case 127: {
+            if (m_cursor == 0) return flushed;
+            const size_t previous = utf8::retreat(m_line, m_cursor, 1);
+            m_line.erase(previous, m_cursor - previous);
+            m_cursor = previous;
+            return true;
+        } case KEY_DC:
+            if (m_cursor == m_line.length()) return flushed;
+            m_line.erase(m_cursor, utf8::advance(m_line, m_cursor, 1) - m_cursor);
+            return true;
+        case KEY_LEFT:
+            m_cursor = utf8::retreat(m_line, m_cursor, 1);
+            return true;
+        case KEY_RIGHT:
+            m_cursor = utf8::advance(m_line, m_cursor, 1);
+            return true;
+        case KEY_HOME:
+            m_cursor = 0;
+            return true;
+        case KEY_END:
+            m_cursor = m_line.length();
+            return true;
+        case KEY_UP:
+            if (m_history_pos > 0) recall(m_history_pos - 1);
+            return true;
+        case KEY_DOWN:
+            if (m_history_pos < m_history.size()) recall(m_history_pos + 1);
+            return true;
+        default:
+            // printable characters only, ignore other control & function keys
+            if (ch < ' ' || ch == 127 || (ch >= KEY_MIN && ch <= KEY_MAX)) return flushed;
+            if (ch >= 0x80 && ch <= 0xFF && utf8::sequenceLength(static_cast<char>(ch)) > 1)
+            {
+                m_pending = static_cast<char>(ch); // a UTF-8 lead byte, its sequence follows
+                return flushed;
+            }
+            std::string text;
+            utf8::append(text, static_cast<char32_t>(ch)); // ASCII, Latin-1 or a wide code point
+            insert(text);
+            return true;
+    }
+}
+
+bool InputBox::popLine(std::string& out_line)
+{
+    if (m_completed.empty()) return false;
+    out_line = std::move(m_completed.front());
+    m_completed.pop_front();
+    return true;
+}
+
+void InputBox::clear()
+{
+    m_line.clear();
+    m_pending.clear();
+    m_cursor = 0;
+    m_view = 0;
+}
+
+void InputBox::draw()
+{
+    if (!m_win) return;
+
+    werase(m_win);
+    wcolor_set(m_win, 0, nullptr);
+    box(m_win, 0, 0);
+
+    // scroll horizontally so the cursor stays within the box, a column per character
+    const size_t width = static_cast<size_t>(getmaxx(m_win) > 3 ? getmaxx(m_win) - 3 : 1);
+    const std::string_view line = m_line;
+    if (m_cursor < m_view) m_view = m_cursor;
+    else if (utf8::length(line.substr(m_view, m_cursor - m_view)) > width) m_view = utf8::retreat(line, m_cursor, width);
+
+    const size_t end = utf8::advance(line, m_view, width + 1);
+    mvwaddnstr(m_win, 1, 1, m_line.c_str() + m_view, static_cast<int>(end - m_view));
+    wmove(m_win, 1, 1 + static_cast<int>(utf8::length(line.substr(m_view, m_cursor - m_view))));
+}
+
+void InputBox::submit()
+{
+    if (!m_line.empty())
+    {
+        if (m_history.empty() || m_history.back() != m_line) m_history.push_back(m_line);
+        if (m_history.size() > MAX_HISTORY) m_history.pop_front();
+        m_completed.push_back(std::move(m_line));
+    }
+    clear();
+    m_draft.clear();
+    m_history_pos = m_history.size();
+}
+
+void InputBox::insert(const std::string& text)
+{
+    m_line.insert(m_cursor, text);
+    m_cursor += text.length();
+}
+
+void InputBox::flushPending()
+{
+    std::string text;
+    for (char byte : m_pending) utf8::append(text, static_cast<unsigned char>(byte));
+    m_pending.clear();
+    if (!text.empty()) insert(text);
+}
+
+void InputBox::recall(size_t history_pos)
+{
+    if (m_history_pos == m_history.size()) m_draft = m_line; // leaving the new line
+    m_history_pos = history_pos;
+    m_line = (history_pos == m_history.size()) ? m_draft : m_history[history_pos];
+    m_cursor = m_line.length();
+}
@@ -0,0 +1,76 @@
+﻿#pragma once
+
+#include <deque>
+#include <string>
+#include "curses.h"
+
+/**
+ * Single line, editable input box
+ *
+ * Fed one keystroke at a time (non-blocking), keeps a line buffer of any
+ * length plus a bounded history. Completed lines are queued until popped.
+ *
+ * Keys: Left/Right/Home/End move the cursor, Backspace/Delete edit,
+ * Up/Down browse history, Enter completes the line.
+ *
+ * The line is UTF-8, edited a code point at a time. Curses hands over text as
+ * UTF-8 bytes (ncurses), code points (wide PDCurses) or single-byte characters,
+ * taken as Latin-1 when they aren't part of a UTF-8 sequence.
+ */
+class InputBox
+{
+public:
+    static constexpr size_t MAX_HISTORY = 100; ///< number of lines kept in history
+
+    InputBox() = default;
+    ~InputBox();
+
+    // non-copyable, owns a curses window
+    InputBox(const InputBox&) = delete;
+    InputBox& operator=(const InputBox&) = delete;
+
+    // Creates the underlying curses window (once) & sets it up for non-blocking reads
+    void create(int height, int width, int y, int x);
+
+    // Returns the next pending keystroke, or ERR if there is none
+    int readKey() const;
+
+    // Applies a keystroke to the line buffer
+    // @return true if the box needs to be redrawn
+    bool handleKey(int ch);
+
+    // Pops the oldest completed line
+    // @return false if no line is pending
+    bool popLine(std::string& out_line);
+
+    // Clears the line being edited
+    void clear();
+
+    // Draws box & line buffer, leaving the cursor at the edit position
+    void draw();
+
+    WINDOW* window() const { return m_win; }
+
+private:
+    // Completes the current line, queueing it & adding it to history
+    void submit();
+
+    // Replaces the line being edited with a history entry
+    void recall(size_t history_pos);
+
+    // Inserts text at the cursor, moving the cursor past it
+    void insert(const std::string& text);
+
+    // Inserts the bytes of an unfinished UTF-8 sequence, each as a Latin-1 character
+    void flushPending();
+
+    WINDOW* m_win = nullptr;          ///< curses window
+    std::string m_line;               ///< line being edited
+    size_t m_cursor = 0;              ///< edit position within m_line, in bytes (on a character)
+    size_t m_view = 0;                ///< first byte shown, scrolls w/ the cursor
+    std::string m_pending;            ///< UTF-8 sequence being typed, until its last byte
+    std::deque<std::string> m_history;   ///< previously submitted lines, oldest first
+    size_t m_history_pos = 0;         ///< browsed history entry, m_history.size() for the new line
+    std::string m_draft;              ///< new line, stashed while browsing history
+    std::deque<std::string> m_completed; ///< completed lines, waiting to be popped
+};
@@ -0,0 +1,97 @@
+﻿#pragma once
+
+#include <chrono>
+#include <functional>
+#include <mutex>
+#include <vector>
+
+#include "room_registry.h"
+#include "userinfo.h"
+#include "network/protocol.h"
+
+/**
+ * Message batching stage (host)
+ *
+ * Chat lines to be broadcast are collected into one batch, which is handed to the
+ * sink once it would outgrow a datagram (as a MESSAGE_BATCH, the largest batch
+ * encoding), or once its oldest line waited for the latency budget. A busy session thus sends a few packets carrying
+ * many lines each, rather than one packet per line.
+ *
+ * Each line carries the room it was said in, as of when it was queued, so a sender
+ * moving on before the flush doesn't take its last lines along.
+ *
+ * Lines come from both the network thread (clients) & the UI thread (host user).
+ */
+class MessageBatcher
+{
+public:
+    typedef std::chrono::steady_clock Clock;
+    typedef std::function<void(const std::vector<protocol::MessagePackage>& messages, const std::vector<room_id_t>& rooms)> Sink;
+
+    static constexpr std::chrono::milliseconds DEFAULT_BUDGET{ 2 };
+    static constexpr size_t DEFAULT_MAX_BYTES = 1200; ///< until the peers' MTU is known
+
+    MessageBatcher(Sink sink, std::chrono::milliseconds budget = DEFAULT_BUDGET, size_t max_bytes = DEFAULT_MAX_BYTES)
+        : m_sink(std::move(sink)), m_budget(budget), m_max_bytes(max_bytes) {}
+
+    // Queues a line said in a room, flushing the pending batch first if the line wouldn't fit anymore
+    void add(const protocol::MessagePackage& pkg, room_id_t room = RoomRegistry::LOBBY)
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        const size_t size = protocol::MessageBatchPackage::entrySize(pkg);
+        const size_t header = protocol::MessageBatchPackage::HEADER_SIZE;
+        if (!m_lines.empty() && header + m_bytes + size > m_max_bytes) flushLocked();
+
+        if (m_lines.empty()) m_first = Clock::now();
+        m_lines.push_back(pkg);
+        m_rooms.push_back(room);
+        m_bytes += size;
+        m_messages++;
+        if (header + m_bytes >= m_max_bytes) flushLocked(); // full, or an oversized line
+    }
+
+    // Flushes the pending batch once its latency budget is used up
+    void tick(Clock::time_point now = Clock::now())
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (!m_lines.empty() && now - m_first >= m_budget) flushLocked();
+    }
+
+    // Flushes the pending batch right away, e.g. when the session ends
+    void flush()
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (!m_lines.empty()) flushLocked();
+    }
+
+    // Sets the max. size of a batch packet, e.g. to the path MTU payload
+    void setMaxBytes(size_t max_bytes)
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_max_bytes = max_bytes;
+    }
+
+    uint64_t messages() const { std::lock_guard<std::mutex> lock(m_mutex); return m_messages; }
+    uint64_t packets() const { std::lock_guard<std::mutex> lock(m_mutex); return m_packets; }
+
+private:
+    void flushLocked()
+    {
+        m_sink(m_lines, m_rooms);
+        m_lines.clear();
+        m_rooms.clear();
+        m_bytes = 0;
+        m_packets++;
+    }
+
+    Sink m_sink;                        ///< sends a finished batch
+    std::chrono::milliseconds m_budget; ///< max. time a line waits for company
+    size_t m_max_bytes;                 ///< max. size of a batch packet, header included
+    std::vector<protocol::MessagePackage> m_lines; ///< lines of the pending batch
+    std::vector<room_id_t> m_rooms;     ///< room of each line
+    size_t m_bytes = 0;                 ///< serialized size of m_lines in a MESSAGE_BATCH
+    Clock::time_point m_first;          ///< when the first pending line was queued
+    uint64_t m_messages = 0;            ///< lines queued, for stats
+    uint64_t m_packets = 0;             ///< batches sent, for stats
+    mutable std::mutex m_mutex;
+};
@@ -0,0 +1,241 @@
+﻿#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+/**
+ * Shared dictionary for chat message text
+ *
+ * Chat lines are too short for generic compression, but a session keeps repeating
+ * the same words. The host trains a dictionary of those (see DictionaryTrainer),
+ * & peers w/ CAP_DICTIONARY exchange MESSAGE text packed against it:
+ *   0x00, dictionary version, then the text, where 0x00 <index> stands for an entry
+ *   & 0x00 0xFF for a NUL byte.
+ * Text is only packed when that makes it shorter (or starts w/ a NUL byte), any
+ * other text is sent as is.
+ */
+class MessageDictionary
+{
+public:
+    static constexpr char MARKER = '\0';          ///< starts packed text & entry references
+    static constexpr size_t MAX_ENTRIES = 255;     ///< entry indices, 0xFF escapes a NUL byte
+    static constexpr uint8_t ESCAPED_NUL = 0xFF;
+    static constexpr size_t MIN_ENTRY_LENGTH = 3;  ///< shorter entries don't beat their reference
+    static constexpr size_t MAX_ENTRY_LENGTH = 32;
+
+    // Empty dictionary (version 0), only packs text starting w/ a NUL byte
+    MessageDictionary() : m_version(0) {}
+
+    MessageDictionary(uint8_t version, std::vector<std::string> entries) : m_version(version), m_entries(std::move(entries))
+    {
+        if (m_entries.size() > MAX_ENTRIES) m_entries.resize(MAX_ENTRIES);
+        for (size_t i = 0; i < m_entries.size(); ++i)
+        {
+            if (m_entries[i].empty() || m_entries[i].find(MARKER) != std::string::npos) continue; // never matched
+            m_index[static_cast<uint8_t>(m_entries[i][0])].push_back(static_cast<uint8_t>(i));
+        }
+        // longest entries first, matching is greedy
+        for (std::vector<uint8_t>& candidates : m_index)
+        {
+            std::stable_sort(candidates.begin(), candidates.end(),
+                [this](uint8_t a, uint8_t b) { return m_entries[a].length() > m_entries[b].length(); });
+        }
+    }
+
+    // Entries as sent in a DICTIONARY package, NUL-separated
+    MessageDictionary(uint8_t version, const std::string& joined) : MessageDictionary(version, split(joined)) {}
+
+    uint8_t version() const { return m_version; }
+    size_t size() const { return m_entries.size(); }
+
+    std::string joined() const
+    {
+        std::string joined;
+        for (size_t i = 0; i < m_entries.size(); ++i)
+        {
+            if (i) joined += MARKER;
+            joined += m_entries[i];
+        }
+        return joined;
+    }
+
+    // Packs text against the dictionary, if that makes it shorter
+    std::string pack(const std::string& text) const
+    {
+        const bool forced = !text.empty() && text[0] == MARKER; // would otherwise look packed
+        if (m_entries.empty() && !forced) return text;
+
+        std::string packed;
+        packed.reserve(text.length() + 2);
+        packed += MARKER;
+        packed += static_cast<char>(m_version);
+        for (size_t i = 0; i < text.length();)
+        {
+            const uint8_t c = static_cast<uint8_t>(text[i]);
+            if (c == static_cast<uint8_t>(MARKER))
+            {
+                packed += MARKER;
+                packed += static_cast<char>(ESCAPED_NUL);
+                i++;
+                continue;
+            }
+            const std::string* match = nullptr;
+            uint8_t index = 0;
+            for (uint8_t candidate : m_index[c])
+            {
+                const std::string& entry = m_entries[candidate];
+                if (text.compare(i, entry.length(), entry) == 0)
+                {
+                    match = &entry;
+                    index = candidate;
+                    break;
+                }
+            }
+            if (match)
+            {
+                packed += MARKER;
+                packed += static_cast<char>(index);
+                i += match->length();
+            }
+            else
+            {
+                packed += text[i++];
+            }
+        }
+        return (forced || packed.length() < text.length()) ? packed : text;
+    }
+
+    // Unpacks text packed against this dictionary, text that isn't packed is copied
+    // @return false if it was packed against another version, or is malformed
+    bool unpack(const std::string& packed, std::string& text) const
+    {
+        if (!isPacked(packed))
+        {
+            text = packed;
+            return true;
+        }
+        if (packed.length() < 2 || static_cast<uint8_t>(packed[1]) != m_version) return false;
+
+        std::string out;
+        out.reserve(packed.length() * 2);
+        for (size_t i = 2; i < packed.length(); ++i)
+        {
+            if (packed[i] != MARKER)
+            {
+                out += packed[i];
+                continue;
+            }
+            if (++i == packed.length()) return false;
+            const uint8_t index = static_cast<uint8_t>(packed[i]);
+            if (index == ESCAPED_NUL) out += MARKER;
+            else if (index < m_entries.size()) out += m_entries[index];
+            else return false;
+        }
+        text = std::move(out);
+        return true;
+    }
+
+    static bool isPacked(const std::string& text) { return !text.empty() && text[0] == MARKER; }
+
+private:
+    static std::vector<std::string> split(const std::string& joined)
+    {
+        std::vector<std::string> entries;
+        if (joined.empty()) return entries;
+        size_t start = 0;
+        for (size_t end; (end = joined.find(MARKER, start)) != std::string::npos; start = end + 1)
+        {
+            entries.push_back(joined.substr(start, end - start));
+        }
+        entries.push_back(joined.substr(start));
+        return entries;
+    }
+
+    uint8_t m_version;                 ///< identifies the dictionary in packed text, 0 if empty
+    std::vector<std::string> m_entries; ///< indexed by entry references
+    std::array<std::vector<uint8_t>, 256> m_index; ///< entries by first byte, longest first
+};
+
+typedef std::shared_ptr<const MessageDictionary> DictionaryHandle;
+
+/**
+ * Builds MessageDictionary instances from recent chat traffic (host)
+ *
+ * Counts the words (w/ their trailing space) of the text it's shown, & every
+ * RETRAIN_INTERVAL messages picks the entries saving the most bytes. Counts decay
+ * at every retraining, so the dictionary follows the conversation. Not thread-safe.
+ */
+class DictionaryTrainer
+{
+public:
+    static constexpr size_t RETRAIN_INTERVAL = 512;  ///< messages between two dictionaries
+    static constexpr size_t MAX_CANDIDATES = 8192;   ///< words counted at once
+
+    // Counts the words of a message
+    // @return true if a new dictionary is due, see build
+    bool observe(const std::string& text)
+    {
+        for (size_t start = 0; start < text.length();)
+        {
+            size_t end = text.find(' ', start);
+            end = (end == std::string::npos) ? text.length() : end + 1; // w/ the space
+            count(text.substr(start, end - start));
+            start = end;
+        }
+        return ++m_observed % RETRAIN_INTERVAL == 0;
+    }
+
+    // Picks the most valuable words into a dictionary, then decays the counts
+    MessageDictionary build(uint8_t version)
+    {
+        std::vector<std::pair<uint64_t, const std::string*>> ranked;
+        ranked.reserve(m_counts.size());
+        for (const auto& [word, count] : m_counts)
+        {
+            if (count > 1) ranked.emplace_back(count * (word.length() - 2), &word); // saved bytes
+        }
+        const size_t kept = std::min(ranked.size(), MessageDictionary::MAX_ENTRIES);
+        std::partial_sort(ranked.begin(), ranked.begin() + kept, ranked.end(),
+            [](const auto& a, const auto& b) { return a.first > b.first || (a.first == b.first && *a.second < *b.second); });
+
+        std::vector<std::string> entries;
+        entries.reserve(kept);
+        for (size_t i = 0; i < kept; ++i) entries.push_back(*ranked[i].second);
+        decay();
+        return MessageDictionary(version, std::move(entries));
+    }
+
+private:
+    void count(const std::string& word)
+    {
+        if (word.length() < MessageDictionary::MIN_ENTRY_LENGTH || word.length() > MessageDictionary::MAX_ENTRY_LENGTH) return;
+        if (word.find(MessageDictionary::MARKER) != std::string::npos) return;
+        auto it = m_counts.find(word);
+        if (it != m_counts.end())
+        {
+            it->second++;
+            return;
+        }
+        if (m_counts.size() >= MAX_CANDIDATES) decay();
+        if (m_counts.size() < MAX_CANDIDATES) m_counts.emplace(word, 1);
+    }
+
+    // halves all counts, forgetting words seen once
+    void decay()
+    {
+        for (auto it = m_counts.begin(); it != m_counts.end();)
+        {
+            it->second /= 2;
+            if (it->second == 0) it = m_counts.erase(it);
+            else ++it;
+        }
+    }
+
+    std::unordered_map<std::string, uint32_t> m_counts; ///< occurrences by word
+    uint64_t m_observed = 0; ///< messages observed
+};
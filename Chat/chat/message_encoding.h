@@ -0,0 +1,76 @@
+﻿#pragma once
+
+#include <array>
+#include <string>
+#include <vector>
+
+#include "userinfo.h"
+#include "network/protocol.h"
+#include "util/byte_stream.h"
+
+// How a batch of messages is serialized for a peer, depends on its capabilities
+enum MessageEncoding : uint8_t
+{
+    ENCODING_PLAIN,        // one MESSAGE packet per message
+    ENCODING_BATCH,        // MESSAGE_BATCH
+    ENCODING_BATCH_VARINT, // MESSAGE_BATCH_VARINT
+    ENCODING_COUNT
+};
+
+// Picks the densest encoding a peer supports
+inline MessageEncoding pickEncoding(uint32_t capabilities)
+{
+    if (capabilities & protocol::CAP_VARINT) return ENCODING_BATCH_VARINT;
+    if (capabilities & protocol::CAP_MESSAGE_BATCH) return ENCODING_BATCH;
+    return ENCODING_PLAIN;
+}
+
+/**
+ * Serializations of one batch of messages (host)
+ *
+ * Built lazily, once per encoding in use, then shared by all peers using it.
+ */
+class EncodedMessages
+{
+public:
+    EncodedMessages(const std::vector<protocol::MessagePackage>& messages) : m_messages(messages) {}
+
+    // Returns the packets carrying the messages in the given encoding
+    const std::vector<std::string>& get(MessageEncoding encoding)
+    {
+        std::vector<std::string>& packets = m_packets[encoding];
+        if (packets.empty() && !m_messages.empty())
+        {
+            switch (encoding)
+            {
+                case ENCODING_PLAIN: {
+                        for (const protocol::MessagePackage& pkg : m_messages) packets.push_back(serialize(pkg));
+                        break;
+                } case ENCODING_BATCH: {
+                        protocol::MessageBatchPackage batch;
+                        batch.messages = m_messages;
+                        packets.push_back(serialize(batch));
+                        break;
+                } case ENCODING_BATCH_VARINT: {
+                        protocol::MessageBatchVarintPackage batch;
+                        batch.messages = m_messages;
+                        packets.push_back(serialize(batch));
+                        break;
+                } default: { /* do nothing */ }
+            }
+        }
+        return packets;
+    }
+
+private:
+    template <typename Pkg>
+    static std::string serialize(const Pkg& pkg)
+    {
+        ByteStream s;
+        pkg.serialize(s);
+        return s.getBuf();
+    }
+
+    const std::vector<protocol::MessagePackage>& m_messages; ///< the batch
+    std::array<std::vector<std::string>, ENCODING_COUNT> m_packets; ///< serialized packets by encoding
+};
@@ -0,0 +1,125 @@
+﻿#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "userinfo.h"
+#include "network/protocol.h"
+#include "util/byte_stream.h"
+
+// How much conversation the host keeps for newcomers, whichever bound is hit first
+struct HistoryLimits
+{
+    size_t max_messages = 100;  ///< messages kept, 0 to keep none
+    size_t max_bytes = 32768;   ///< serialized bytes kept
+};
+
+/**
+ * Recent messages, replayed to newcomers (host)
+ *
+ * Messages are stored serialized, as MESSAGE packets, in a byte ring allocated
+ * once w/ an index ring next to it, so memory never grows past the limits:
+ * adding a message evicts the oldest ones in its way. Each message is laid out
+ * contiguously (the ring wraps early rather than splitting one), so catch-up
+ * copies stored bytes into its packets w/o encoding anything again.
+ */
+class MessageHistory
+{
+public:
+    MessageHistory(const HistoryLimits& limits) : m_buffer(limits.max_bytes), m_entries(limits.max_messages) {}
+
+    // Keeps a message, evicting the oldest ones as needed
+    void add(const protocol::MessagePackage& pkg)
+    {
+        ByteStream s;
+        pkg.serialize(s);
+        const size_t length = s.getLength();
+        if (m_entries.empty() || length > m_buffer.size()) return; // would never fit
+
+        size_t offset = m_head;
+        if (length > m_buffer.size() - offset) // wrap early, evicting what's left past the head
+        {
+            while (m_count && front().offset >= offset) pop();
+            offset = 0;
+        }
+        // messages right past the head are the oldest
+        while (m_count && front().offset >= offset && front().offset < offset + length) pop();
+        if (m_count == m_entries.size()) pop();
+
+        memcpy(m_buffer.data() + offset, s.getBufPtr(), length);
+        m_entries[(m_first + m_count) % m_entries.size()] = { static_cast<uint32_t>(offset), static_cast<uint32_t>(length) };
+        m_count++;
+        m_head = offset + length;
+    }
+
+    // Calls f(std::string_view) w/ each kept MESSAGE packet, the oldest first
+    template <typename F>
+    void forEach(F&& f) const
+    {
+        for (size_t i = 0; i < m_count; ++i)
+        {
+            const Entry& entry = at(i);
+            f(std::string_view(m_buffer.data() + entry.offset, entry.length));
+        }
+    }
+
+    // Calls f(const std::string&) w/ the kept messages as MESSAGE_BATCH packets of at
+    // most max_bytes (or a single message, if larger), the oldest first
+    template <typename F>
+    void forEachBatch(size_t max_bytes, F&& f) const
+    {
+        typedef protocol::MessageBatchPackage Batch;
+        for (size_t begin = 0; begin < m_count;)
+        {
+            // batch entries are MESSAGE packets w/o their type
+            size_t end = begin;
+            size_t length = Batch::HEADER_SIZE;
+            while (end < m_count && end - begin < UINT16_MAX)
+            {
+                const size_t entry_length = at(end).length - sizeof(int8_t);
+                if (end > begin && length + entry_length > max_bytes) break;
+                length += entry_length;
+                end++;
+            }
+
+            ByteStream s(static_cast<unsigned int>(length + 1));
+            s.writeInt8(Batch::TYPE);
+            s.writeUInt16(static_cast<uint16_t>(end - begin));
+            for (size_t i = begin; i < end; ++i)
+            {
+                const Entry& entry = at(i);
+                s.writeBytes(m_buffer.data() + entry.offset + sizeof(int8_t), entry.length - sizeof(int8_t));
+            }
+            f(s.getBuf());
+            begin = end;
+        }
+    }
+
+    size_t size() const { return m_count; }
+    bool empty() const { return m_count == 0; }
+
+private:
+    struct Entry
+    {
+        uint32_t offset = 0; ///< position in m_buffer
+        uint32_t length = 0; ///< serialized length
+    };
+
+    const Entry& at(size_t i) const { return m_entries[(m_first + i) % m_entries.size()]; }
+    const Entry& front() const { return m_entries[m_first]; }
+
+    void pop()
+    {
+        m_first = (m_first + 1) % m_entries.size();
+        m_count--;
+    }
+
+    std::vector<char> m_buffer;   ///< serialized messages, allocated once
+    std::vector<Entry> m_entries; ///< ring of kept messages, allocated once
+    size_t m_first = 0;           ///< index of the oldest message in m_entries
+    size_t m_count = 0;           ///< messages kept
+    size_t m_head = 0;            ///< where the next message goes in m_buffer
+};
@@ -0,0 +1,297 @@
+﻿#include "message_log.h"
+
+#include <algorithm>
+#include <charconv>
+#include <chrono>
+#include <cstdio>
+#include <filesystem>
+#include <system_error>
+
+#include "util/byte_stream.h"
+#include "util/crc32c.h"
+
+namespace
+{
+    const char* SEGMENT_EXTENSION = ".log";
+    const size_t SEGMENT_NAME_DIGITS = 20; // any 64-bit sequence number, zero-padded so names sort
+
+    void store32(uint8_t* p, uint32_t value) { memcpy(p, &value, sizeof(value)); }
+}
+
+bool MessageLog::open(const MessageLogConfig& config)
+{
+    close();
+    m_config = config;
+    m_segments.clear();
+
+    std::error_code error;
+    std::filesystem::create_directories(m_config.directory, error);
+    if (error) return false;
+
+    // segments are named after their first sequence number
+    std::vector<std::pair<uint64_t, std::string>> files;
+    for (const auto& entry : std::filesystem::directory_iterator(m_config.directory, error))
+    {
+        const std::filesystem::path& path = entry.path();
+        const std::string stem = path.stem().string();
+        if (path.extension() != SEGMENT_EXTENSION || stem.length() != SEGMENT_NAME_DIGITS
+            || !std::all_of(stem.begin(), stem.end(), [](char c) { return c >= '0' && c <= '9'; })) continue;
+        uint64_t first_seq;
+        if (std::from_chars(stem.data(), stem.data() + stem.length(), first_seq).ec != std::errc()) continue;
+        files.emplace_back(first_seq, path.string());
+    }
+    if (error) return false;
+    std::sort(files.begin(), files.end());
+
+    for (size_t i = 0; i < files.size(); ++i)
+    {
+        if (!recover(files[i].second, files[i].first, i + 1 == files.size()))
+        {
+            m_segments.clear();
+            return false;
+        }
+    }
+    m_committed = m_segments.empty() ? 0 : m_segments.back()->first_seq + m_segments.back()->count;
+
+    m_stop = false;
+    m_writer = std::thread(&MessageLog::write, this);
+    return true;
+}
+
+void MessageLog::close()
+{
+    if (!m_writer.joinable()) return;
+    {
+        std::lock_guard<std::mutex> lock(m_pending_mutex);
+        m_stop = true;
+    }
+    m_pending_ready.notify_one();
+    m_writer.join();
+}
+
+void MessageLog::append(const std::vector<protocol::MessagePackage>& messages)
+{
+    std::lock_guard<std::mutex> lock(m_pending_mutex);
+    if (!m_writer.joinable()) return;
+    const bool was_empty = m_pending.empty();
+    ByteStream s;
+    for (const protocol::MessagePackage& pkg : messages)
+    {
+        s.clear();
+        pkg.serialize(s);
+        const uint32_t length = s.getLength();
+        if (RECORD_HEADER_SIZE + length > m_config.segment_size
+            || m_pending.length() + RECORD_HEADER_SIZE + length > m_config.max_pending) // the writer can't keep up
+        {
+            m_dropped++;
+            continue;
+        }
+        uint8_t header[RECORD_HEADER_SIZE];
+        store32(header, length);
+        store32(header + sizeof(uint32_t), crc32c::compute(s.getBufPtr(), length));
+        m_pending.append(reinterpret_cast<const char*>(header), RECORD_HEADER_SIZE);
+        m_pending.append(s.getBufPtr(), length);
+    }
+    if (was_empty && !m_pending.empty()) m_pending_ready.notify_one(); // the writer may be idle
+}
+
+MessageLogStats MessageLog::getStats() const
+{
+    MessageLogStats stats;
+    stats.committed = m_committed;
+    stats.dropped = m_dropped;
+    stats.commits = m_commits;
+    stats.syncs = m_syncs;
+    std::shared_lock<std::shared_mutex> lock(m_segments_mutex);
+    stats.segments = m_segments.size();
+    return stats;
+}
+
+std::vector<MessageLog::Slice> MessageLog::slices(uint64_t seq) const
+{
+    std::vector<Slice> slices;
+    std::shared_lock<std::shared_mutex> lock(m_segments_mutex);
+
+    // the last segment starting at or before seq, or the first one
+    auto it = std::upper_bound(m_segments.begin(), m_segments.end(), seq,
+        [](uint64_t value, const std::unique_ptr<Segment>& segment) { return value < segment->first_seq; });
+    if (it != m_segments.begin()) --it;
+
+    for (; it != m_segments.end(); ++it)
+    {
+        const Segment& segment = **it;
+        const uint64_t end_seq = segment.first_seq + segment.count;
+        if (end_seq <= seq) continue;
+        Slice slice{ &segment, segment.file, 0, segment.first_seq, end_seq };
+        if (seq > segment.first_seq)
+        {
+            // jump to the closest indexed record, the rest is walked
+            const size_t entry = static_cast<size_t>((seq - segment.first_seq) / INDEX_INTERVAL);
+            slice.offset = segment.index[entry];
+            slice.first_seq = segment.first_seq + entry * INDEX_INTERVAL;
+        }
+        slices.push_back(slice);
+    }
+    return slices;
+}
+
+std::shared_ptr<const MappedFile> MessageLog::map(const Segment& segment) const
+{
+    // opening would create a missing file, i.e. one deleted behind the log's back
+    const std::string path = segmentPath(segment.first_seq);
+    std::error_code error;
+    if (std::filesystem::file_size(path, error) != segment.size || error) return nullptr;
+    auto file = std::make_shared<MappedFile>();
+    if (!file->open(path, segment.size)) return nullptr;
+    return file;
+}
+
+bool MessageLog::recover(const std::string& path, uint64_t first_seq, bool last)
+{
+    std::error_code error;
+    uintmax_t size = std::filesystem::file_size(path, error);
+    if (error) return false;
+    if (size == 0) size = m_config.segment_size; // created, but not sized yet
+
+    auto segment = std::make_unique<Segment>();
+    segment->first_seq = first_seq;
+    segment->size = static_cast<size_t>(size);
+    segment->file = std::make_shared<MappedFile>();
+    if (!segment->file->open(path, segment->size)) return false;
+
+    // committed records end at a zero length, or at the first one cut short
+    const uint8_t* data = segment->file->data();
+    size_t offset = 0;
+    while (offset + RECORD_HEADER_SIZE <= size)
+    {
+        const uint32_t length = load32(data + offset);
+        if (length == 0 || length > size - offset - RECORD_HEADER_SIZE) break;
+        if (crc32c::compute(data + offset + RECORD_HEADER_SIZE, length) != load32(data + offset + sizeof(uint32_t))) break;
+        if (segment->count % INDEX_INTERVAL == 0) segment->index.push_back(static_cast<uint32_t>(offset));
+        segment->count++;
+        offset += RECORD_HEADER_SIZE + length;
+    }
+    segment->end = offset;
+    segment->synced = offset;
+
+    // appends resume at the end of the last segment, so clear what a torn write left past it
+    // (mapped pages may reach the disk in any order)
+    uint8_t* tail = segment->file->data() + offset;
+    if (last && std::any_of(tail, tail + (size - offset), [](uint8_t byte) { return byte != 0; }))
+    {
+        memset(tail, 0, static_cast<size_t>(size - offset));
+        segment->file->flush(offset, static_cast<size_t>(size - offset));
+    }
+    if (!last) segment->file.reset(); // full, mapped again on reads
+    m_segments.push_back(std::move(segment));
+    return true;
+}
+
+void MessageLog::write()
+{
+    typedef std::chrono::steady_clock Clock;
+    const auto interval = std::chrono::milliseconds(m_config.sync_interval_ms);
+    Clock::time_point last_sync = Clock::now();
+    std::vector<Segment*> dirty; // committed but not synced
+    std::string records;
+
+    for (;;)
+    {
+        bool stop;
+        {
+            std::unique_lock<std::mutex> lock(m_pending_mutex);
+            if (m_pending.empty() && !m_stop)
+            {
+                // idle: wake up for the next interval sync if something is left to sync
+                if (m_config.sync == MessageLogConfig::SYNC_INTERVAL && !dirty.empty()) m_pending_ready.wait_for(lock, interval);
+                else m_pending_ready.wait(lock, [this] { return !m_pending.empty() || m_stop; });
+            }
+            records.swap(m_pending);
+            stop = m_stop;
+        }
+
+        if (!records.empty())
+        {
+            std::unique_lock<std::shared_mutex> lock(m_segments_mutex);
+            commit(records, dirty);
+            records.clear();
+            m_commits++;
+        }
+
+        const bool sync_due = m_config.sync == MessageLogConfig::SYNC_COMMIT
+            || (m_config.sync == MessageLogConfig::SYNC_INTERVAL && Clock::now() - last_sync >= interval);
+        if (!dirty.empty() && (sync_due || stop))
+        {
+            for (Segment* segment : dirty) sync(*segment);
+            dirty.clear();
+            last_sync = Clock::now();
+        }
+        if (stop) return;
+    }
+}
+
+void MessageLog::commit(const std::string& records, std::vector<Segment*>& touched)
+{
+    Segment* segment = m_segments.empty() ? nullptr : m_segments.back().get();
+    const uint8_t* data = reinterpret_cast<const uint8_t*>(records.data());
+    for (size_t offset = 0; offset < records.length();)
+    {
+        const size_t length = RECORD_HEADER_SIZE + load32(data + offset);
+
+        // records don't span segments, the rest of a full one stays zero
+        if (!segment || length > segment->size - segment->end)
+        {
+            Segment* next = roll(segment ? segment->first_seq + segment->count : 0);
+            if (!next)
+            {
+                // e.g. the disk is full (segments are allocated when rolled): the batch is lost,
+                // the log stays consistent
+                for (; offset < records.length(); offset += RECORD_HEADER_SIZE + load32(data + offset)) m_dropped++;
+                break;
+            }
+            segment = next;
+        }
+
+        if (segment->count % INDEX_INTERVAL == 0) segment->index.push_back(static_cast<uint32_t>(segment->end));
+        memcpy(segment->file->data() + segment->end, data + offset, length);
+        segment->end += length;
+        segment->count++;
+        m_committed++;
+        offset += length;
+        if (std::find(touched.begin(), touched.end(), segment) == touched.end()) touched.push_back(segment);
+    }
+}
+
+MessageLog::Segment* MessageLog::roll(uint64_t first_seq)
+{
+    auto segment = std::make_unique<Segment>();
+    segment->first_seq = first_seq;
+    segment->size = m_config.segment_size;
+    segment->file = std::make_shared<MappedFile>();
+    if (!segment->file->open(segmentPath(first_seq), segment->size)) return nullptr;
+
+    // only the active segment stays mapped, readers still walking the full one keep
+    // its mapping alive until they're done
+    if (!m_segments.empty())
+    {
+        Segment& full = *m_segments.back();
+        if (m_config.sync != MessageLogConfig::SYNC_NEVER) sync(full);
+        full.file.reset();
+    }
+    m_segments.push_back(std::move(segment));
+    return m_segments.back().get();
+}
+
+void MessageLog::sync(Segment& segment)
+{
+    if (segment.end == segment.synced || !segment.file) return;
+    if (segment.file->flush(segment.synced, segment.end - segment.synced)) m_syncs++;
+    segment.synced = segment.end;
+}
+
+std::string MessageLog::segmentPath(uint64_t first_seq) const
+{
+    char name[SEGMENT_NAME_DIGITS + 1];
+    snprintf(name, sizeof(name), "%020llu", static_cast<unsigned long long>(first_seq));
+    return (std::filesystem::path(m_config.directory) / (name + std::string(SEGMENT_EXTENSION))).string();
+}
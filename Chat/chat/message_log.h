@@ -0,0 +1,184 @@
+﻿#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#include "userinfo.h"
+#include "network/protocol.h"
+#include "util/mapped_file.h"
+
+// Where & how the host logs messages
+struct MessageLogConfig
+{
+    // When appended messages are forced to the disk
+    enum Sync : uint8_t
+    {
+        SYNC_NEVER,    // left to the OS, lost on a power cut (not on a crash)
+        SYNC_COMMIT,   // after every group commit, before the next one
+        SYNC_INTERVAL  // at most every sync_interval_ms
+    };
+
+    std::string directory;                   ///< where segment files go, empty (default) to keep no log
+    size_t segment_size = 16 * 1024 * 1024; ///< bytes per segment file
+    size_t max_pending = 8 * 1024 * 1024;   ///< bytes of records waiting for the writer, more are dropped
+    Sync sync = SYNC_INTERVAL;
+    unsigned sync_interval_ms = 1000;
+};
+
+// Message log counters
+struct MessageLogStats
+{
+    uint64_t committed = 0; ///< messages in the log, i.e. the next sequence number
+    uint64_t dropped = 0;   ///< messages that couldn't be logged
+    uint64_t commits = 0;   ///< group commits
+    uint64_t syncs = 0;     ///< flushes to the disk
+    size_t segments = 0;    ///< segment files
+};
+
+/**
+ * Persistent, append-only log of messages (host)
+ *
+ * Messages are numbered from 0 & stored serialized, as MESSAGE packets, in fixed
+ * size segment files named after their first sequence number. Each record is a
+ * length, a CRC32C of the packet & the packet; a zero length ends a segment.
+ *
+ * append() only serializes into a pending buffer, any thread, up to max_pending
+ * bytes. A writer thread takes the whole buffer at once (group commit), copies it
+ * into the mapped active segment & syncs it per the configured policy. Committed
+ * records never change, so readers walk the mapped segments w/o copying or
+ * decoding, found through a sparse index (every INDEX_INTERVAL-th record's offset,
+ * per segment). Only the active segment stays mapped, a full one is unmapped once
+ * the next is rolled & mapped again for the duration of a read.
+ *
+ * On open, existing segments are scanned & the log resumes after the last valid
+ * record, e.g. after a crash cut the last commit short.
+ */
+class MessageLog
+{
+public:
+    static constexpr size_t INDEX_INTERVAL = 64;  ///< records per sparse index entry
+    static constexpr size_t RECORD_HEADER_SIZE = 2 * sizeof(uint32_t); ///< length & CRC
+
+    MessageLog() = default;
+    ~MessageLog() { close(); }
+
+    // non-copyable
+    MessageLog(const MessageLog&) = delete;
+    MessageLog& operator=(const MessageLog&) = delete;
+
+    // Opens the log in config.directory, recovering the existing segments, & starts the writer
+    // @return false if the directory or a segment can't be opened
+    bool open(const MessageLogConfig& config);
+
+    // Commits what's pending, syncs & stops the writer
+    void close();
+
+    bool isOpen() const { return m_writer.joinable(); }
+
+    // Appends messages, in order, w/o waiting for them to be written
+    void append(const std::vector<protocol::MessagePackage>& messages);
+
+    // Calls f(uint64_t seq, std::string_view packet) w/ up to max_count committed messages,
+    // from sequence number seq on. Packets are views into the mapped segments, only valid
+    // during the call. Stops at a segment that can't be mapped
+    template <typename F>
+    void forEachSince(uint64_t seq, size_t max_count, F&& f) const
+    {
+        for (const Slice& slice : slices(seq))
+        {
+            const std::shared_ptr<const MappedFile> file = slice.file ? slice.file : map(*slice.segment);
+            if (!file) return;
+            const uint8_t* data = file->data();
+            size_t offset = slice.offset;
+            for (uint64_t i = slice.first_seq; i < slice.end_seq && max_count; ++i)
+            {
+                const uint32_t length = load32(data + offset);
+                if (i >= seq)
+                {
+                    f(i, std::string_view(reinterpret_cast<const char*>(data + offset + RECORD_HEADER_SIZE), length));
+                    max_count--;
+                }
+                offset += RECORD_HEADER_SIZE + length;
+            }
+            if (!max_count) return;
+        }
+    }
+
+    MessageLogStats getStats() const;
+
+private:
+    struct Segment
+    {
+        uint64_t first_seq = 0;     ///< sequence number of the first record
+        size_t size = 0;            ///< file size
+        std::shared_ptr<MappedFile> file; ///< the segment file mapped whole, null once full (readers map it themselves)
+        size_t end = 0;             ///< committed bytes
+        uint64_t count = 0;         ///< committed records
+        size_t synced = 0;          ///< bytes known to be on the disk (writer only)
+        std::vector<uint32_t> index; ///< offsets of records 0, INDEX_INTERVAL, 2 * INDEX_INTERVAL...
+    };
+
+    // Committed records of a segment from an indexed record on
+    struct Slice
+    {
+        const Segment* segment;
+        std::shared_ptr<const MappedFile> file; ///< the active segment's mapping, null for a full segment
+        size_t offset;      ///< of the record first_seq
+        uint64_t first_seq;
+        uint64_t end_seq;   ///< past the last committed record
+    };
+
+    static uint32_t load32(const uint8_t* p)
+    {
+        uint32_t value;
+        memcpy(&value, p, sizeof(value));
+        return value;
+    }
+
+    // Committed parts of the segments holding seq & what follows, snapshotted under m_segments_mutex
+    std::vector<Slice> slices(uint64_t seq) const;
+
+    // Maps a full segment's file for reading
+    // @return null if it can't be mapped
+    std::shared_ptr<const MappedFile> map(const Segment& segment) const;
+
+    // Maps a segment file & finds its committed records, the last one stays mapped
+    bool recover(const std::string& path, uint64_t first_seq, bool last);
+
+    // Writer thread: commits pending records in groups
+    void write();
+
+    // Copies a batch of records into the active segment, rolling to new ones as needed,
+    // m_segments_mutex must be held
+    void commit(const std::string& records, std::vector<Segment*>& touched);
+
+    // Maps a new segment, unmapping the active one (synced first, unless SYNC_NEVER),
+    // m_segments_mutex must be held
+    Segment* roll(uint64_t first_seq);
+
+    // Forces a mapped segment's committed bytes to the disk
+    void sync(Segment& segment);
+
+    std::string segmentPath(uint64_t first_seq) const;
+
+    MessageLogConfig m_config;
+    std::vector<std::unique_ptr<Segment>> m_segments; ///< by first sequence number, the active one last
+    mutable std::shared_mutex m_segments_mutex;        ///< guards m_segments & their committed ranges
+    std::string m_pending;                             ///< serialized records waiting for the writer
+    bool m_stop = false;                               ///< tells the writer to finish up
+    std::mutex m_pending_mutex;                        ///< guards the 2 above
+    std::condition_variable m_pending_ready;           ///< signals the writer
+    std::thread m_writer;
+    std::atomic<uint64_t> m_committed{ 0 }; ///< see MessageLogStats
+    std::atomic<uint64_t> m_dropped{ 0 };   ///< see MessageLogStats
+    std::atomic<uint64_t> m_commits{ 0 };   ///< see MessageLogStats
+    std::atomic<uint64_t> m_syncs{ 0 };     ///< see MessageLogStats
+};
@@ -0,0 +1,61 @@
+﻿#pragma once
+
+#include <deque>
+#include <iterator>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+/**
+ * Direct messages held for offline users (host)
+ *
+ * Messages to a name nobody holds are queued under that name & handed over
+ * once a user w/ that name connects. Bounded per recipient & in total, so
+ * messages to mistyped or long gone names can't pile up: past either bound,
+ * new messages are refused, the sender is told.
+ *
+ * Names aren't authenticated: held messages go to whoever connects next under
+ * the name, not necessarily the user the sender had in mind (see MSG_CMD).
+ */
+class OfflineQueue
+{
+public:
+    static constexpr size_t MAX_PER_RECIPIENT = 32; ///< messages held per name
+    static constexpr size_t MAX_TOTAL = 1024;       ///< messages held for all names
+
+    struct Message
+    {
+        std::string sender;  ///< sender's name
+        std::string message; ///< text
+    };
+
+    // Holds a message for a recipient
+    // @return false if the recipient's queue or the whole queue is full
+    bool push(const std::string& recipient, const std::string& sender, const std::string& message)
+    {
+        if (m_total >= MAX_TOTAL) return false;
+        std::deque<Message>& queue = m_queues[recipient];
+        if (queue.size() >= MAX_PER_RECIPIENT) return false;
+        queue.push_back({ sender, message });
+        m_total++;
+        return true;
+    }
+
+    // Takes all messages held for a recipient, the oldest first
+    std::vector<Message> take(const std::string& recipient)
+    {
+        std::vector<Message> messages;
+        auto it = m_queues.find(recipient);
+        if (it == m_queues.end()) return messages;
+        messages.assign(std::make_move_iterator(it->second.begin()), std::make_move_iterator(it->second.end()));
+        m_total -= messages.size();
+        m_queues.erase(it);
+        return messages;
+    }
+
+    size_t size() const { return m_total; }
+
+private:
+    std::unordered_map<std::string, std::deque<Message>> m_queues; ///< messages by recipient name
+    size_t m_total = 0;                                           ///< messages held
+};
@@ -0,0 +1,85 @@
+﻿#pragma once
+
+#include <chrono>
+#include <map>
+#include <vector>
+
+#include "userinfo.h"
+
+/**
+ * Presence batching stage (host)
+ *
+ * Accumulates user joins/leaves for a short window, so a join storm results
+ * in one delta broadcast per window instead of one broadcast per user. A user
+ * joining & leaving within the same window cancels out.
+ */
+class PresenceBatcher
+{
+public:
+    typedef std::chrono::steady_clock Clock;
+
+    static constexpr std::chrono::milliseconds DEFAULT_WINDOW{ 30 };
+
+    PresenceBatcher(std::chrono::milliseconds window = DEFAULT_WINDOW) : m_window(window) {}
+
+    // A user joined
+    void add(const UserInfo& user)
+    {
+        Pending& pending = touch(user.user_id);
+        pending.op = (pending.op == REMOVE || pending.op == REPLACE) ? REPLACE : ADD;
+        pending.user = user;
+    }
+
+    // A user left
+    void remove(user_id_t user_id)
+    {
+        Pending& pending = touch(user_id);
+        if (pending.op == ADD) m_pending.erase(user_id); // never announced, cancel out
+        else pending.op = REMOVE;
+    }
+
+    // Returns true if the batch window elapsed & there are changes to flush
+    bool ready(Clock::time_point now = Clock::now()) const
+    {
+        return !m_pending.empty() && now - m_first_change >= m_window;
+    }
+
+    // Moves the pending changes out, removals are to be applied before additions
+    void flush(std::vector<user_id_t>& out_removed, std::vector<UserInfo>& out_added)
+    {
+        for (auto& [user_id, pending] : m_pending)
+        {
+            if (pending.op != ADD) out_removed.push_back(user_id);
+            if (pending.op != REMOVE) out_added.push_back(std::move(pending.user));
+        }
+        m_pending.clear();
+    }
+
+    bool empty() const { return m_pending.empty(); }
+
+private:
+    enum Op : uint8_t
+    {
+        NONE,    // no change yet
+        ADD,     // user joined
+        REMOVE,  // user left
+        REPLACE, // user left, then a new user joined under the same ID
+    };
+
+    struct Pending
+    {
+        Op op = NONE;
+        UserInfo user; ///< joined user (ADD/REPLACE)
+    };
+
+    // Returns the pending change of a user, starting the batch window if needed
+    Pending& touch(user_id_t user_id)
+    {
+        if (m_pending.empty()) m_first_change = Clock::now();
+        return m_pending[user_id];
+    }
+
+    std::chrono::milliseconds m_window;   ///< how long changes are accumulated
+    Clock::time_point m_first_change;     ///< when the current batch started
+    std::map<user_id_t, Pending> m_pending; ///< pending change per user, sorted by ID
+};
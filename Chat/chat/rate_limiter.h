@@ -0,0 +1,114 @@
+﻿#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <vector>
+
+#include "network/enet_wrapper.h"
+
+// Rates a peer may send at (host), averaged over time, w/ bursts up to the given size
+struct RateLimits
+{
+    double packets_per_second = 20.0; ///< sustained packet rate
+    double packet_burst = 40.0;       ///< packets sent at once after a pause
+    double bytes_per_second = 16384;  ///< sustained byte rate
+    double byte_burst = 65536;        ///< bytes sent at once after a pause
+    unsigned kick_after = 100;        ///< peers w/ this many drops in a row are disconnected, 0 to never kick
+};
+
+// Rate limiting counters
+struct RateLimitStats
+{
+    uint64_t dropped = 0; ///< packets over the limits
+    uint64_t kicked = 0;  ///< peers disconnected for flooding
+};
+
+/**
+ * Per-peer token buckets (host)
+ *
+ * Each received packet takes a token from its peer's packet bucket & its length
+ * from the byte bucket, before it's decoded; the buckets refill at the configured
+ * rates. Packets over either limit are dropped, & a peer that keeps flooding is
+ * kicked. Buckets are preallocated per peer ID, checks don't allocate or lock:
+ * they're made on the network thread only.
+ */
+class RateLimiter
+{
+public:
+    typedef std::chrono::steady_clock Clock;
+
+    enum Verdict
+    {
+        ACCEPT, // within the limits
+        DROP,   // over the limits
+        KICK    // over the limits for too long, disconnect the peer
+    };
+
+    RateLimiter(size_t peer_count, const RateLimits& limits) : m_limits(limits), m_buckets(peer_count) {}
+
+    // Charges a received packet to its peer
+    Verdict check(net::peer_id_t peer_id, size_t length, Clock::time_point now = Clock::now())
+    {
+        if (peer_id >= m_buckets.size()) return ACCEPT;
+        Bucket& bucket = m_buckets[peer_id];
+        if (bucket.last == Clock::time_point()) reset(bucket, now); // first packet of the peer
+
+        const double elapsed = std::chrono::duration<double>(now - bucket.last).count();
+        bucket.last = now;
+        bucket.packets = std::min(m_limits.packet_burst, bucket.packets + elapsed * m_limits.packets_per_second);
+        bucket.bytes = std::min(m_limits.byte_burst, bucket.bytes + elapsed * m_limits.bytes_per_second);
+
+        if (bucket.packets >= 1.0 && bucket.bytes >= length)
+        {
+            bucket.packets -= 1.0;
+            bucket.bytes -= length;
+            bucket.strikes = 0;
+            return ACCEPT;
+        }
+        m_dropped++;
+        if (m_limits.kick_after && ++bucket.strikes >= m_limits.kick_after)
+        {
+            reset(bucket, now);
+            m_kicked++;
+            return KICK;
+        }
+        return DROP;
+    }
+
+    // Forgets a peer's usage, e.g. when its ID is reused by a new connection
+    void reset(net::peer_id_t peer_id)
+    {
+        if (peer_id < m_buckets.size()) m_buckets[peer_id] = Bucket();
+    }
+
+    RateLimitStats getStats() const
+    {
+        RateLimitStats stats;
+        stats.dropped = m_dropped;
+        stats.kicked = m_kicked;
+        return stats;
+    }
+
+private:
+    struct Bucket
+    {
+        double packets = 0.0;    ///< packet tokens left
+        double bytes = 0.0;      ///< byte tokens left
+        unsigned strikes = 0;    ///< packets dropped in a row
+        Clock::time_point last;  ///< last refill, default until the first packet
+    };
+
+    void reset(Bucket& bucket, Clock::time_point now)
+    {
+        bucket.packets = m_limits.packet_burst;
+        bucket.bytes = m_limits.byte_burst;
+        bucket.strikes = 0;
+        bucket.last = now;
+    }
+
+    RateLimits m_limits;
+    std::vector<Bucket> m_buckets;          ///< by peer ID
+    std::atomic<uint64_t> m_dropped{ 0 };   ///< see RateLimitStats
+    std::atomic<uint64_t> m_kicked{ 0 };    ///< see RateLimitStats
+};
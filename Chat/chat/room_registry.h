@@ -0,0 +1,125 @@
+﻿#pragma once
+
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "userinfo.h"
+
+typedef uint16_t room_id_t;
+
+/**
+ * Room membership index (host)
+ *
+ * Every user is in exactly one room, the lobby until it joins another. Members are
+ * kept as a dense vector per room, w/ each user's position in it, so joins, leaves
+ * & lookups are O(1) & a room's fan-out walks only its members. Rooms other than
+ * the lobby are created on their first join & dropped w/ their last member.
+ */
+class RoomRegistry
+{
+public:
+    static constexpr room_id_t LOBBY = 0;
+    static constexpr size_t MAX_NAME_LENGTH = 32;
+    static constexpr const char* LOBBY_NAME = "lobby";
+
+    RoomRegistry()
+    {
+        m_rooms.push_back({ LOBBY_NAME, {} });
+        m_index.emplace(LOBBY_NAME, LOBBY);
+    }
+
+    // Moves a user into a room, creating it if needed (an empty name is the lobby)
+    // @return the room joined
+    room_id_t join(user_id_t user_id, const std::string& name)
+    {
+        const room_id_t room_id = findOrCreate(name.empty() ? LOBBY_NAME : name.substr(0, MAX_NAME_LENGTH));
+        if (contains(user_id) && m_memberships[user_id].room == room_id) return room_id;
+        remove(user_id);
+
+        if (user_id >= m_memberships.size()) m_memberships.resize(static_cast<size_t>(user_id) + 1);
+        std::vector<user_id_t>& members = m_rooms[room_id].members;
+        m_memberships[user_id] = { room_id, static_cast<uint32_t>(members.size()) };
+        members.push_back(user_id);
+        return room_id;
+    }
+
+    // Takes a user out of its room, e.g. on disconnect
+    void remove(user_id_t user_id)
+    {
+        if (!contains(user_id)) return;
+        const Membership membership = m_memberships[user_id];
+        std::vector<user_id_t>& members = m_rooms[membership.room].members;
+
+        // swap-remove, keeping members packed
+        const user_id_t last = members.back();
+        members[membership.index] = last;
+        m_memberships[last].index = membership.index;
+        members.pop_back();
+        m_memberships[user_id] = Membership();
+
+        if (members.empty() && membership.room != LOBBY) drop(membership.room);
+    }
+
+    bool contains(user_id_t user_id) const
+    {
+        return user_id < m_memberships.size() && m_memberships[user_id].room != NONE;
+    }
+
+    // Room of a user, the lobby if it isn't registered
+    room_id_t roomOf(user_id_t user_id) const
+    {
+        return contains(user_id) ? m_memberships[user_id].room : LOBBY;
+    }
+
+    const std::string& name(room_id_t room_id) const { return m_rooms[room_id].name; }
+    const std::vector<user_id_t>& members(room_id_t room_id) const { return m_rooms[room_id].members; }
+
+private:
+    static constexpr room_id_t NONE = 0xFFFF;
+
+    struct Room
+    {
+        std::string name;               ///< unique, empty while the slot is free
+        std::vector<user_id_t> members; ///< dense, in no particular order
+    };
+
+    struct Membership
+    {
+        room_id_t room = NONE; ///< room the user is in
+        uint32_t index = 0;    ///< position in the room's members
+    };
+
+    room_id_t findOrCreate(const std::string& name)
+    {
+        auto it = m_index.find(name);
+        if (it != m_index.end()) return it->second;
+
+        room_id_t room_id;
+        if (!m_free.empty())
+        {
+            room_id = m_free.back();
+            m_free.pop_back();
+        }
+        else
+        {
+            room_id = static_cast<room_id_t>(m_rooms.size());
+            m_rooms.emplace_back();
+        }
+        m_rooms[room_id].name = name;
+        m_index.emplace(name, room_id);
+        return room_id;
+    }
+
+    void drop(room_id_t room_id)
+    {
+        m_index.erase(m_rooms[room_id].name);
+        m_rooms[room_id].name = std::string();
+        m_free.push_back(room_id);
+    }
+
+    std::vector<Room> m_rooms;                          ///< by room ID, the lobby first
+    std::unordered_map<std::string, room_id_t> m_index; ///< room IDs by name
+    std::vector<room_id_t> m_free;                      ///< free room IDs
+    std::vector<Membership> m_memberships;              ///< by user ID
+};
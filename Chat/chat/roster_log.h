@@ -0,0 +1,75 @@
+﻿#pragma once
+
+#include <deque>
+#include <random>
+#include <vector>
+
+#include "presence_batcher.h"
+#include "userinfo.h"
+
+/**
+ * Versioned user list change log (host)
+ *
+ * Every join/leave bumps the user list version & is recorded here, so a client
+ * that already knows some version only needs the changes since then. The log is
+ * bounded: clients too far behind get a full snapshot instead.
+ *
+ * Versions are only meaningful within one host session, identified by epoch.
+ */
+class RosterLog
+{
+public:
+    static constexpr size_t DEFAULT_CAPACITY = 1024;
+
+    RosterLog(size_t capacity = DEFAULT_CAPACITY) : m_capacity(capacity)
+    {
+        std::random_device random;
+        do { m_epoch = random(); } while (m_epoch == 0); // zero means "no known version"
+    }
+
+    // A user joined
+    void add(const UserInfo& user) { record({ ++m_version, true, user }); }
+
+    // A user left
+    void remove(user_id_t user_id) { record({ ++m_version, false, UserInfo(user_id) }); }
+
+    uint32_t epoch() const { return m_epoch; }
+    uint32_t version() const { return m_version; }
+
+    // Collects the changes since the given version, compacted into removals & additions
+    // @return false if the version is not covered by the log anymore (or never was)
+    bool since(uint32_t version, std::vector<user_id_t>& out_removed, std::vector<UserInfo>& out_added) const
+    {
+        if (version > m_version) return false;
+        if (!m_changes.empty() && version + 1 < m_changes.front().version) return false;
+        if (m_changes.empty() && version != m_version) return false;
+
+        PresenceBatcher delta;
+        for (auto it = m_changes.begin() + (m_changes.size() - (m_version - version)); it != m_changes.end(); ++it)
+        {
+            if (it->added) delta.add(it->user);
+            else delta.remove(it->user.user_id);
+        }
+        delta.flush(out_removed, out_added);
+        return true;
+    }
+
+private:
+    struct Change
+    {
+        uint32_t version; ///< user list version after this change
+        bool added;       ///< joined (true) or left (false)
+        UserInfo user;    ///< user who joined, only the ID for leaves
+    };
+
+    void record(Change change)
+    {
+        if (m_changes.size() == m_capacity) m_changes.pop_front();
+        m_changes.push_back(std::move(change));
+    }
+
+    size_t m_capacity;           ///< max. number of changes kept
+    uint32_t m_epoch;            ///< host session ID, never zero
+    uint32_t m_version = 0;      ///< current user list version
+    std::deque<Change> m_changes; ///< most recent changes, oldest first
+};
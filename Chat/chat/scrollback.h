@@ -0,0 +1,73 @@
+﻿#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/**
+ * Scrollback buffer of formatted chat lines
+ *
+ * Fixed-capacity ring, once either the line or the byte cap is hit the oldest
+ * lines are evicted, so memory stays bounded however long the session runs.
+ * Lines are addressed by a monotonic sequence number, [begin(), end()).
+ */
+class Scrollback
+{
+public:
+    static constexpr size_t DEFAULT_MAX_LINES = 10000;   ///< default line cap
+    static constexpr size_t DEFAULT_MAX_BYTES = 1 << 20; ///< default text cap (1 MiB)
+
+    struct Line
+    {
+        uint8_t color = 0; ///< text color, see ChatWindow::TextColor
+        std::string text;  ///< formatted text
+    };
+
+    Scrollback(size_t max_lines = DEFAULT_MAX_LINES, size_t max_bytes = DEFAULT_MAX_BYTES)
+        : m_lines(max_lines > 0 ? max_lines : 1), m_max_bytes(max_bytes) {}
+
+    // Appends a line, evicting the oldest lines if a cap is exceeded
+    void push(uint8_t color, std::string text)
+    {
+        if (text.length() > m_max_bytes) text.resize(m_max_bytes);
+        while (size() == m_lines.size() || (size() > 0 && m_bytes + text.length() > m_max_bytes))
+        {
+            popFront();
+        }
+        Line& line = m_lines[m_end % m_lines.size()];
+        m_bytes += text.length();
+        line.color = color;
+        line.text = std::move(text);
+        m_end++;
+    }
+
+    // Drops all lines (sequence numbers keep counting)
+    void clear()
+    {
+        while (size() > 0) popFront();
+    }
+
+    // Returns line by sequence number, expects begin() <= seq < end()
+    const Line& at(uint64_t seq) const { return m_lines[seq % m_lines.size()]; }
+
+    uint64_t begin() const { return m_begin; } ///< sequence number of the oldest line
+    uint64_t end() const { return m_end; }     ///< sequence number past the newest line
+    size_t size() const { return static_cast<size_t>(m_end - m_begin); }
+    bool empty() const { return m_end == m_begin; }
+    size_t bytes() const { return m_bytes; }
+
+private:
+    void popFront()
+    {
+        Line& line = m_lines[m_begin % m_lines.size()];
+        m_bytes -= line.text.length();
+        line.text = std::string(); // release storage
+        m_begin++;
+    }
+
+    std::vector<Line> m_lines; ///< ring storage, capacity is the line cap
+    size_t m_max_bytes;        ///< cap on text bytes held
+    size_t m_bytes = 0;        ///< text bytes currently held
+    uint64_t m_begin = 0;      ///< oldest line
+    uint64_t m_end = 0;        ///< one past the newest line
+};
@@ -1,83 +1,256 @@
-﻿#pragma once
-
-#include "state.h"
-#include "quit_state.h"
-
-/**
- * Chat State: Client
- *
- * Defines chat behaviors when connected as client. The client's responsibilities include:
- *   1) Sending the local user's messages to the host
- *   2) Receiving broadcasts from the hosts of *all* user messages (including the local clients)
- *   3) Manaing replicated session state, i.e. list of users as they join/leave 
- */
-class ChatState_Client : public State
-{
-public:
-    ChatState_Client(ChatApp* app) : State(app) {}
-
-    void beginState() override
-    {
-        window()->log("Connected to session [client]...");
-        m_app->connect("127.0.0.1", protocol::DEFAULT_PORT);
-    }
-
-    void handleInput(char input[80]) override
-    {
-        if (strcmp(EXIT, input) == 0)
-        {
-            m_app->goToState(new QuitState(m_app));
-        }
-        else if (UserInfo* localUser = m_app->getLocalUserPtr())
-        {
-            window()->print(localUser->name, input, true);
-            m_app->send(0, protocol::MessagePackage(localUser->user_id, input));
-        }
-    }
-    
-    void receiveConnectionEvent(net::peer_id_t peer_id, const net::Address& address) override
-    {
-        // clients will instantly provide their username once connection is confirmed
-        m_app->send(0, protocol::UsernamePackage(config()->nickname));
-    }
-
-    void receiveDisconnectEvent(net::peer_id_t peer_id, const net::Address& address) override
-    {
-        // terminating application for now (should cycle back to main prompt?)
-        window()->log("Disconnected from host, exiting...");
-        std::this_thread::sleep_for(std::chrono::seconds(3));
-        m_app->goToState(new QuitState(m_app));
-    }
-
-    void receiveUsernameAckEvent(protocol::UsernameAckPackage& pkg) override
-    {
-        for (const UserInfo& user : pkg.users)
-        {
-            bool is_local = pkg.assigned_user_id == user.user_id;
-            m_app->addUser(user, is_local);
-        }
-    }
-
-    void receiveAddUserEvent(UserInfo* user, protocol::AddUserPackage& pkg) override
-    {
-        if (!m_app->containsUser(*user))
-        {
-            window()->log(user->name + " connected");
-            m_app->addUser(*user);
-        }
-    }
-
-    void receiveRemoveUserEvent(UserInfo* user, protocol::RemoveUserPackage& pkg) override
-    {
-        window()->log(user->name + " disconnected");
-        m_app->removeUser(user->user_id);
-    }
-
-    void receiveMessageEvent(UserInfo* user, protocol::MessagePackage& pkg) override
-    {
-        if (!m_app->isLocalUser(user))
-        {
-            window()->print(user->name, pkg.message);
-        }
-    }
-};
+﻿#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <optional>
+
+#include "state.h"
+#include "quit_state.h"
+#include "chat/message_dictionary.h"
+
+/**
+ * Chat State: Client
+ *
+ * Defines chat behaviors when connected as client. The client's responsibilities include:
+ *   1) Sending the local user's messages to the host
+ *   2) Receiving broadcasts from the hosts of *all* user messages (including the local clients)
+ *   3) Manaing replicated session state, i.e. list of users in its room as they join/leave 
+ */
+class ChatState_Client : public State
+{
+    static constexpr size_t MAX_LOGGED_DELTAS = 8; ///< larger user deltas are logged as a summary
+    static constexpr int MAX_RECONNECTS = 3;       ///< attempts in a row before giving up
+    static constexpr std::chrono::seconds RECONNECT_DELAY{ 1 };
+
+public:
+    ChatState_Client(ChatApp* app) : State(app) {}
+
+    void beginState() override
+    {
+        window()->log("Connected to session [client]...");
+        m_app->connect("127.0.0.1", protocol::DEFAULT_PORT);
+    }
+
+    void handleInput(const std::string& input) override
+    {
+        if (input == EXIT)
+        {
+            m_app->goToState(new QuitState(m_app));
+        }
+        else if (input == STATS)
+        {
+            logStats();
+        }
+        else if (std::string room; parseCommand(input, JOIN_CMD, room))
+        {
+            m_app->send(0, protocol::JoinRoomPackage(room));
+        }
+        else if (input == LEAVE_CMD)
+        {
+            m_app->send(0, protocol::JoinRoomPackage(std::string()));
+        }
+        else if (std::string argument; parseCommand(input, MSG_CMD, argument))
+        {
+            std::string recipient, text;
+            UserHandle localUser = m_app->getLocalUser();
+            if (!splitArgument(argument, recipient, text) || !localUser)
+            {
+                window()->error("Usage: " MSG_CMD " <user> <message>");
+                return;
+            }
+            if (recipient.length() > protocol::DirectMessagePackage::MAX_PEER_LENGTH)
+            {
+                window()->error("User names are at most " + std::to_string(protocol::DirectMessagePackage::MAX_PEER_LENGTH) + " bytes long");
+                return;
+            }
+            window()->print(localUser->name + " -> " + recipient, text, true);
+            const size_t max_text = m_app->maxPayload(0) - protocol::DirectMessagePackage::HEADER_SIZE - recipient.length();
+            for (const std::string& chunk : protocol::MessagePackage::split(text, max_text))
+            {
+                m_app->send(0, protocol::DirectMessagePackage(recipient, chunk));
+            }
+        }
+        else if (UserHandle localUser = m_app->getLocalUser())
+        {
+            window()->print(localUser->name, input, true);
+            // long messages are sent in chunks that fit in a datagram
+            const size_t max_text = m_app->maxPayload(0) - protocol::MessagePackage::HEADER_SIZE;
+            for (const std::string& chunk : protocol::MessagePackage::split(input, max_text))
+            {
+                m_app->send(0, protocol::MessagePackage(localUser->user_id, m_pack ? m_dictionary.load()->pack(chunk) : chunk));
+            }
+        }
+    }
+    
+    void receiveConnectionEvent(net::peer_id_t peer_id, const net::Address& address) override
+    {
+        // clients will instantly provide their username once connection is confirmed
+        // w/ an ephemeral key first, so the host can encrypt the session
+        if (config()->encryption)
+        {
+            m_key_pair = crypto::KeyPair::generate();
+            m_app->send(0, protocol::KeyExchangePackage(m_key_pair->public_key));
+        }
+        const ChatApp::RosterVersion* roster = m_app->getRosterVersion();
+        m_app->send(0, protocol::UsernamePackage(config()->nickname, roster->epoch, roster->version));
+    }
+
+    void receiveDisconnectEvent(net::peer_id_t peer_id, const net::Address& address) override
+    {
+        // a rejected client never got its USERNAME_ACK: the keys die w/ the connection
+        m_key_pair.reset();
+        m_pending_keys.reset();
+        if (m_reconnects == MAX_RECONNECTS)
+        {
+            // terminating application for now (should cycle back to main prompt?)
+            window()->log("Disconnected from host, exiting...");
+            std::this_thread::sleep_for(std::chrono::seconds(3));
+            m_app->goToState(new QuitState(m_app));
+            return;
+        }
+        m_reconnects++;
+        window()->log("Disconnected from host, reconnecting (" + std::to_string(m_reconnects) + "/" + std::to_string(MAX_RECONNECTS) + ")...");
+        m_reconnect_at = std::chrono::steady_clock::now() + RECONNECT_DELAY;
+    }
+
+    void tick() override
+    {
+        // the user list & its version are kept, so the host can catch us up w/ a delta
+        if (m_reconnect_at && std::chrono::steady_clock::now() >= *m_reconnect_at)
+        {
+            m_reconnect_at.reset();
+            m_app->connect("127.0.0.1", protocol::DEFAULT_PORT);
+        }
+    }
+
+    void receiveUsernameAckEvent(protocol::UsernameAckPackage& pkg) override
+    {
+        m_reconnects = 0;
+        // accepted: the host encrypts everything after this ACK, so do we from now on. Before
+        // the local user is set, which lets the UI thread send its first line
+        if (m_pending_keys)
+        {
+            m_app->startSession(0, *m_pending_keys);
+            m_pending_keys.reset();
+            window()->log("Session encrypted");
+        }
+        // the user list follows, either as snapshot pages or as a delta from our known version
+        m_app->setCompression((pkg.capabilities & protocol::CAP_COMPRESSION) != 0);
+        m_pack = (pkg.capabilities & protocol::CAP_DICTIONARY) != 0;
+        m_app->getRosterVersion()->epoch = pkg.roster_epoch;
+        m_app->setLocalUserID(pkg.assigned_user_id);
+    }
+
+    void receiveKeyExchangeEvent(user_id_t user_id, protocol::KeyExchangePackage& pkg) override
+    {
+        crypto::Key host_key;
+        crypto::SessionKeys keys;
+        if (!m_key_pair || !pkg.getKey(host_key) || !crypto::deriveSessionKeys(*m_key_pair, host_key, true, keys))
+        {
+            window()->error("Invalid public key received, session left unencrypted");
+            return;
+        }
+        m_pending_keys = keys; // the host may still reject our USERNAME, see receiveUsernameAckEvent
+        m_key_pair.reset(); // ephemeral
+    }
+
+    void receiveDictionaryEvent(protocol::DictionaryPackage& pkg) override
+    {
+        m_dictionary.store(std::make_shared<const MessageDictionary>(pkg.version, pkg.entries));
+    }
+
+    void receiveUserListPageEvent(protocol::UserListPagePackage& pkg) override
+    {
+        if (pkg.page_index == 0) m_app->resetUsers();
+        m_app->updateUsers({}, pkg.users);
+        if (pkg.page_index + 1 == pkg.page_count) m_app->getRosterVersion()->version = pkg.roster_version;
+    }
+
+    void receiveAddUserEvent(UserInfo* user, protocol::AddUserPackage& pkg) override
+    {
+        if (!m_app->containsUser(*user))
+        {
+            window()->log(user->name + " connected");
+            m_app->addUser(*user);
+        }
+    }
+
+    void receiveRemoveUserEvent(const UserRef* user, protocol::RemoveUserPackage& pkg) override
+    {
+        if (!user) return;
+        window()->log(user->name + " disconnected");
+        m_app->removeUser(user->user_id);
+    }
+
+    void receiveUserDeltaEvent(protocol::UserDeltaPackage& pkg) override
+    {
+        // updates of our room's user list. Deltas only apply on top of the version they were
+        // made from, others are already covered by our snapshot (we'll be caught up individually)
+        ChatApp::RosterVersion* roster = m_app->getRosterVersion();
+        if (pkg.from_version != roster->version) return;
+        roster->version = pkg.to_version;
+
+        // log individual joins/leaves (connects, disconnects & room moves), unless it's a storm
+        const bool verbose = pkg.removed.size() + pkg.added.size() <= MAX_LOGGED_DELTAS;
+        UserSnapshot users = m_app->getUsers();
+        size_t removed = 0, added = 0;
+        for (user_id_t user_id : pkg.removed)
+        {
+            std::optional<UserRef> user = users->find(user_id);
+            if (!user) continue;
+            if (verbose) window()->log(user->name + " left");
+            removed++;
+        }
+        for (const UserInfo& user : pkg.added)
+        {
+            const bool replaced = std::find(pkg.removed.begin(), pkg.removed.end(), user.user_id) != pkg.removed.end();
+            if (users->contains(user.user_id) && !replaced) continue;
+            if (verbose) window()->log(user.name + " joined");
+            added++;
+        }
+        if (!verbose) window()->log(std::to_string(added) + " users joined, " + std::to_string(removed) + " left");
+
+        m_app->updateUsers(pkg.removed, pkg.added);
+    }
+
+    void receiveMessageEvent(const UserRef* user, protocol::MessagePackage& pkg) override
+    {
+        if (user && !m_app->isLocalUser(user))
+        {
+            std::string text;
+            if (m_dictionary.load()->unpack(pkg.message, text)) window()->print(user->name, text);
+            else window()->error("Message from " + user->name + " packed against an unknown dictionary");
+        }
+    }
+
+    void receiveRoomMembersEvent(protocol::RoomMembersPackage& pkg) override
+    {
+        // the user list becomes the room's, its pages follow
+        window()->log("Joined #" + pkg.room + " (" + std::to_string(pkg.member_count) + " members)");
+        m_app->getRosterVersion()->epoch = pkg.roster_epoch;
+    }
+
+    void receiveDirectMessageEvent(const UserRef* user, protocol::DirectMessagePackage& pkg) override
+    {
+        switch (pkg.status)
+        {
+        case protocol::DirectMessagePackage::DELIVERED:
+            window()->print(pkg.peer + " -> you", pkg.message);
+            break;
+        case protocol::DirectMessagePackage::QUEUED:
+            window()->log(pkg.peer + " is offline, message held for the next user to connect as " + pkg.peer);
+            break;
+        default:
+            window()->error("Message to " + pkg.peer + " couldn't be delivered");
+            break;
+        }
+    }
+
+private:
+    std::atomic<DictionaryHandle> m_dictionary{ std::make_shared<const MessageDictionary>() }; ///< latest dictionary from the host
+    std::atomic<bool> m_pack{ false }; ///< pack sent text? (the host has CAP_DICTIONARY)
+    std::optional<crypto::KeyPair> m_key_pair; ///< sent to the host, until it replies
+    std::optional<crypto::SessionKeys> m_pending_keys; ///< agreed w/ the host, used once it accepts us (USERNAME_ACK)
+    int m_reconnects = 0; ///< attempts since the last USERNAME_ACK (network thread only)
+    std::optional<std::chrono::steady_clock::time_point> m_reconnect_at; ///< next attempt, if disconnected (network thread only)
+};
@@ -1,77 +1,652 @@
-﻿#pragma once
-
-#include "state.h"
-#include "quit_state.h"
-
-/**
- * Chat State: Host
- *
- * Defines chat behaviors when connected as host. The host has two main responsibilities:
- *   1) Broadcasting all messages as they are received from clients
- *   2) Managing the current session's state for clients, providing updates as users join/leave
- */
-class ChatState_Host : public State
-{
-public:
-    ChatState_Host(ChatApp* app) : State(app) {}
-
-    void beginState() override
-    {
-        window()->log("Started new session [hosting]...");
-        m_app->addUser(UserInfo(0, config()->nickname), true);
-        m_app->host(protocol::DEFAULT_PORT, 16);
-    }
-
-    void handleInput(char input[80]) override
-    {
-        if (strcmp(EXIT, input) == 0)
-        {
-            m_app->goToState(new QuitState(m_app));
-        }
-        else if (UserInfo* localUser = m_app->getLocalUserPtr())
-        {
-            window()->print(localUser->name, input, true);
-            m_app->broadcast(protocol::MessagePackage(0, input)); // always zero for host
-        }
-    }
-
-    void receiveConnectionEvent(net::peer_id_t peer_id, const net::Address& address) override
-    {
-        // wait until user sends name before adding to user list & broadcasting to clients
-    }
-
-    void receiveDisconnectEvent(net::peer_id_t peer_id, const net::Address& address) override
-    {
-        if (UserInfo* user = m_app->getUserInfoPtr(ChatApp::toUserID(peer_id)))
-        {
-            window()->log(user->name + " disconnected [" + user->address.str() + "]");
-            m_app->broadcast(protocol::RemoveUserPackage(user->user_id));
-            m_app->removeUser(user->user_id);
-        }
-        else
-        {
-            window()->error("Disconnect from user not found in records");
-        }
-    }
-
-    void receiveUsernameEvent(UserInfo* user, protocol::UsernamePackage& pkg) override
-    {
-        if (user)
-        {
-            m_app->addUser(*user);
-            window()->log(user->name + " connected [" + user->address.str() + "]");
-            m_app->send(user->user_id, protocol::UsernameAckPackage(user->user_id, m_app->getUserMap()));
-            m_app->broadcast(protocol::AddUserPackage(*user));
-        }
-        else
-        {
-            window()->error("Username received from missing user");
-        }
-    }
-
-    void receiveMessageEvent(UserInfo* user, protocol::MessagePackage& pkg) override
-    {
-        window()->print(user->name, pkg.message);
-        m_app->broadcast(pkg);
-    }
-};
+﻿#pragma once
+
+#include <algorithm>
+#include <array>
+#include <charconv>
+#include <unordered_map>
+
+#include "state.h"
+#include "quit_state.h"
+#include "chat/message_batcher.h"
+#include "chat/message_dictionary.h"
+#include "chat/message_encoding.h"
+#include "chat/message_history.h"
+#include "chat/message_log.h"
+#include "chat/offline_queue.h"
+#include "chat/presence_batcher.h"
+#include "chat/room_registry.h"
+#include "chat/roster_log.h"
+#include "chat/user_list_cache.h"
+
+/**
+ * Chat State: Host
+ *
+ * Defines chat behaviors when connected as host. The host has two main responsibilities:
+ *   1) Broadcasting all messages as they are received from clients
+ *   2) Managing the current session's state for clients, providing updates as users join/leave
+ */
+class ChatState_Host : public State
+{
+    static constexpr size_t LOG_LINES = 20;      ///< messages LOG_CMD shows by default
+    static constexpr size_t MAX_LOG_LINES = 500; ///< most messages LOG_CMD shows at once
+
+public:
+    ChatState_Host(ChatApp* app) : State(app),
+        m_messages([this](const std::vector<protocol::MessagePackage>& messages, const std::vector<room_id_t>& rooms) { sendMessages(messages, rooms); }) {}
+
+    void beginState() override
+    {
+        window()->log("Started new session [hosting]...");
+        UserInfo local_user(0, config()->nickname);
+        m_app->addUser(local_user, true);
+        {
+            std::lock_guard<std::mutex> lock(m_rooms_mutex);
+            m_rooms.join(0, std::string());
+            enterRoster(RoomRegistry::LOBBY, local_user);
+        }
+        m_history.emplace(config()->history);
+        if (!config()->log.directory.empty() && !m_log.open(config()->log))
+        {
+            window()->error("Couldn't open the message log in " + config()->log.directory + ", messages won't be logged");
+        }
+        m_app->host(protocol::DEFAULT_PORT, 16);
+    }
+
+    void endState() override
+    {
+        // queued lines are sent & logged, then the log commits what's pending & stops
+        m_messages.flush();
+        m_log.close();
+        State::endState();
+    }
+
+    void handleInput(const std::string& input) override
+    {
+        if (input == EXIT)
+        {
+            m_app->goToState(new QuitState(m_app));
+        }
+        else if (input == STATS)
+        {
+            logStats();
+            window()->log("Messages " + std::to_string(m_messages.messages()) + " sent in "
+                + std::to_string(m_messages.packets()) + " batches");
+            const RateLimitStats limits = m_app->getRateLimitStats();
+            window()->log("Rate limits " + std::to_string(limits.dropped) + " packets dropped, "
+                + std::to_string(limits.kicked) + " users kicked");
+            std::lock_guard<std::mutex> lock(m_dictionary_mutex);
+            window()->log("Dictionary v" + std::to_string(m_dictionary.version()) + ", " + std::to_string(m_dictionary.size())
+                + " entries, packed text " + std::to_string(m_packed_in) + " -> " + std::to_string(m_packed_out) + " bytes");
+            window()->log("History " + std::to_string(m_history->size()) + " messages kept");
+            const MessageLogStats log = m_log.getStats();
+            window()->log("Log " + std::to_string(log.committed) + " messages in " + std::to_string(log.segments) + " segments, "
+                + std::to_string(log.commits) + " commits, " + std::to_string(log.syncs) + " syncs, " + std::to_string(log.dropped) + " dropped");
+        }
+        else if (std::string room; parseCommand(input, JOIN_CMD, room))
+        {
+            moveToRoom(0, room);
+        }
+        else if (std::string count; parseCommand(input, LOG_CMD, count))
+        {
+            showLog(count);
+        }
+        else if (input == LEAVE_CMD)
+        {
+            moveToRoom(0, std::string());
+        }
+        else if (std::string argument; parseCommand(input, MSG_CMD, argument))
+        {
+            std::string recipient, text;
+            UserHandle localUser = m_app->getLocalUser();
+            if (!splitArgument(argument, recipient, text) || !localUser)
+            {
+                window()->error("Usage: " MSG_CMD " <user> <message>");
+                return;
+            }
+            window()->print(localUser->name + " -> " + recipient, text, true);
+            routeDirectMessage(0, localUser->name, recipient, text);
+        }
+        else if (UserHandle localUser = m_app->getLocalUser())
+        {
+            window()->print(localUser->name, input, true);
+            broadcastMessage(0, input); // always zero for host
+        }
+    }
+
+    void receiveConnectionEvent(net::peer_id_t peer_id, const net::Address& address) override
+    {
+        // wait until user sends name before adding to user list & broadcasting to clients
+    }
+
+    void receiveDisconnectEvent(net::peer_id_t peer_id, const net::Address& address) override
+    {
+        m_pending_keys.erase(ChatApp::toUserID(peer_id));
+        if (UserHandle user = m_app->findUser(ChatApp::toUserID(peer_id)))
+        {
+            const user_id_t user_id = user->user_id;
+            window()->log(user->name + " disconnected [" + user->address.str() + "]");
+            m_app->removeUser(user_id);
+            {
+                std::lock_guard<std::mutex> lock(m_rooms_mutex);
+                const room_id_t room_id = m_rooms.roomOf(user_id);
+                m_rooms.remove(user_id);
+                leaveRoster(room_id, user_id);
+            }
+            updateCompression();
+        }
+        else
+        {
+            window()->error("Disconnect from user not found in records");
+        }
+    }
+
+    void receiveUsernameEvent(UserInfo* user, protocol::UsernamePackage& pkg) override
+    {
+        if (user)
+        {
+            if (pkg.protocol_version < protocol::MIN_PROTOCOL_VERSION)
+            {
+                window()->error(user->name + " uses an unsupported protocol version " + std::to_string(pkg.protocol_version));
+                m_pending_keys.erase(user->user_id);
+                m_app->disconnect(user->user_id);
+                return;
+            }
+            user->capabilities = pkg.capabilities & protocol::LOCAL_CAPABILITIES;
+            setAwaitingHistory(user->user_id, true); // no live messages before the catch-up
+            if (!m_app->addUser(*user))
+            {
+                setAwaitingHistory(user->user_id, false);
+                return; // already synced
+            }
+            {
+                std::lock_guard<std::mutex> lock(m_rooms_mutex);
+                m_rooms.join(user->user_id, std::string()); // clients start in the lobby
+                enterRoster(RoomRegistry::LOBBY, *user);
+            }
+            window()->log(user->name + " connected [" + user->address.str() + "]");
+            updateCompression();
+            syncUserList(user->user_id, user->capabilities, pkg.roster_epoch, pkg.known_version);
+            if (user->capabilities & protocol::CAP_DIRECT_MESSAGES)
+            {
+                std::lock_guard<std::mutex> lock(m_direct_mutex); // after addUser, see routeDirectMessage
+                for (const OfflineQueue::Message& held : m_offline.take(user->name))
+                {
+                    m_app->send(user->user_id, protocol::DirectMessagePackage(held.sender, held.message));
+                }
+            }
+            {
+                std::lock_guard<std::mutex> lock(m_dictionary_mutex);
+                if ((user->capabilities & protocol::CAP_DICTIONARY) && m_dictionary.version())
+                {
+                    m_app->send(user->user_id, protocol::DictionaryPackage(m_dictionary.version(), m_dictionary.joined()));
+                }
+                sendHistory(user->user_id, user->capabilities);
+                m_awaiting_history.erase(ChatApp::toPeerID(user->user_id));
+            }
+        }
+        else
+        {
+            window()->error("Username received from missing user");
+        }
+    }
+
+    void receiveKeyExchangeEvent(user_id_t user_id, protocol::KeyExchangePackage& pkg) override
+    {
+        if (!config()->encryption) return; // no reply, the session stays unencrypted
+        const crypto::KeyPair own = crypto::KeyPair::generate();
+        crypto::Key client_key;
+        crypto::SessionKeys keys;
+        if (!pkg.getKey(client_key) || !crypto::deriveSessionKeys(own, client_key, false, keys))
+        {
+            window()->error("Invalid public key received, session left unencrypted");
+            return;
+        }
+        // the client's USERNAME follows in clear text, the session starts after the USERNAME_ACK
+        m_pending_keys[user_id] = keys;
+        m_app->send(user_id, protocol::KeyExchangePackage(own.public_key));
+    }
+
+    void receiveJoinRoomEvent(const UserRef* user, protocol::JoinRoomPackage& pkg) override
+    {
+        // w/o CAP_ROOMS, the client couldn't follow its user list becoming the room's
+        if (user && (user->capabilities & protocol::CAP_ROOMS)) moveToRoom(user->user_id, pkg.room);
+    }
+
+    void receiveDirectMessageEvent(const UserRef* user, protocol::DirectMessagePackage& pkg) override
+    {
+        if (user && user->user_id != 0) routeDirectMessage(user->user_id, user->name, pkg.peer, pkg.message);
+    }
+
+    void receiveMessageEvent(const UserRef* user, protocol::MessagePackage& pkg) override
+    {
+        if (!user) return;
+        std::string text;
+        if (!unpack(*user, pkg.message, text))
+        {
+            window()->error("Message from " + user->name + " packed against an unknown dictionary");
+            return;
+        }
+        if (inLocalRoom(user->user_id)) window()->print(user->name, text);
+        broadcastMessage(user->user_id, text);
+    }
+
+    void tick() override
+    {
+        m_messages.tick();
+
+        // joins/leaves are broadcast to the members of each room in batches, see PresenceBatcher
+        std::lock_guard<std::mutex> lock(m_rooms_mutex);
+        for (size_t room_id = 0; room_id < m_rosters.size(); ++room_id)
+        {
+            if (m_rosters[room_id] && m_rosters[room_id]->presence.ready()) broadcastPresence(static_cast<room_id_t>(room_id));
+        }
+    }
+
+private:
+    struct Joiner
+    {
+        user_id_t user_id; ///< user who joined since the last broadcast
+        uint32_t version;  ///< user list version it was synced to
+    };
+
+    // User list of a room, replicated to its members: clients only follow their own room's
+    struct RoomRoster
+    {
+        RosterLog log;                  ///< versioned change log of the members
+        UserListCache pages;            ///< serialized members, for users joining the room
+        PresenceBatcher presence;       ///< joins/leaves waiting to be broadcast to the members
+        uint32_t broadcast_version = 0; ///< version the members are at
+        std::vector<Joiner> joiners;    ///< members synced since the last broadcast
+    };
+
+    // Compression is host-wide in ENet, it's only turned on while every client can decompress
+    void updateCompression()
+    {
+        bool supported = true;
+        m_app->getUsers()->forEach([&supported](const UserRef& user) {
+            if (user.user_id != 0 && !(user.capabilities & protocol::CAP_COMPRESSION)) supported = false;
+        });
+        m_app->setCompression(supported);
+    }
+
+    // Queues a message for broadcast to the sender's room, split into chunks that fit in a datagram
+    void broadcastMessage(user_id_t user_id, const std::string& message)
+    {
+        train(message);
+        const size_t max_bytes = m_app->maxBroadcastPayload();
+        const size_t max_text = max_bytes - protocol::MessageBatchPackage::HEADER_SIZE - protocol::MessageBatchPackage::ENTRY_HEADER_SIZE;
+        m_messages.setMaxBytes(max_bytes);
+        room_id_t room_id;
+        {
+            std::lock_guard<std::mutex> lock(m_rooms_mutex);
+            room_id = m_rooms.roomOf(user_id);
+        }
+        for (const std::string& chunk : protocol::MessagePackage::split(message, max_text))
+        {
+            m_messages.add(protocol::MessagePackage(user_id, chunk), room_id);
+        }
+    }
+
+    // Sends a batch of messages to the members of the rooms they were said in
+    void sendMessages(const std::vector<protocol::MessagePackage>& messages, const std::vector<room_id_t>& message_rooms)
+    {
+        std::lock_guard<std::mutex> lock(m_dictionary_mutex); // packed against the dictionary clients have
+        std::lock_guard<std::mutex> rooms_lock(m_rooms_mutex);
+
+        // a batch mostly comes from a few rooms, grouped by linear search
+        std::vector<std::pair<room_id_t, std::vector<protocol::MessagePackage>>> rooms;
+        for (size_t i = 0; i < messages.size(); ++i)
+        {
+            const room_id_t room_id = message_rooms[i];
+            auto it = std::find_if(rooms.begin(), rooms.end(), [room_id](const auto& room) { return room.first == room_id; });
+            if (it == rooms.end()) it = rooms.insert(rooms.end(), { room_id, {} });
+            it->second.push_back(messages[i]);
+        }
+        UserSnapshot users = m_app->getUsers();
+        for (const auto& [room_id, room_messages] : rooms) sendToRoom(*users, room_id, room_messages);
+        m_log.append(messages); // written by the log's own thread
+
+        // newcomers start in the lobby, so that's what they catch up on. Text that would read
+        // as packed to clients w/ CAP_DICTIONARY isn't kept, it's stored as sent to the others
+        for (size_t i = 0; i < messages.size(); ++i)
+        {
+            if (message_rooms[i] == RoomRegistry::LOBBY && !MessageDictionary::isPacked(messages[i].message)) m_history->add(messages[i]);
+        }
+    }
+
+    // Replays the kept messages to a newcomer, in as few packets as fit its MTU. The
+    // stored bytes are copied as is. m_dictionary_mutex must be held
+    void sendHistory(user_id_t user_id, uint32_t capabilities)
+    {
+        if (pickEncoding(capabilities) == ENCODING_PLAIN)
+        {
+            m_history->forEach([&](std::string_view packet) { m_app->sendPacket(user_id, std::string(packet), true); });
+        }
+        else
+        {
+            m_history->forEachBatch(m_app->maxPayload(user_id), [&](const std::string& packet) { m_app->sendPacket(user_id, packet, true); });
+        }
+    }
+
+    // Holds back live messages from a user until it has caught up on the history
+    void setAwaitingHistory(user_id_t user_id, bool awaiting)
+    {
+        std::lock_guard<std::mutex> lock(m_dictionary_mutex);
+        if (awaiting) m_awaiting_history.insert(ChatApp::toPeerID(user_id));
+        else m_awaiting_history.erase(ChatApp::toPeerID(user_id));
+    }
+
+    // Sends messages to the members of a room, each in the encoding it supports. Members
+    // sharing an encoding share one packet. Both mutexes must be held
+    void sendToRoom(const UserRegistry& users, room_id_t room_id, const std::vector<protocol::MessagePackage>& messages)
+    {
+        // recipients' peers by encoding, w/ plain text first, then packed text
+        std::array<net::PeerSet, ENCODING_COUNT * 2> recipients;
+        for (user_id_t member : m_rooms.members(room_id))
+        {
+            std::optional<UserRef> user = users.find(member);
+            if (!user || member == 0) continue; // local user
+            if (m_awaiting_history.contains(ChatApp::toPeerID(member))) continue; // gets it w/ the history
+            const bool packs = (user->capabilities & protocol::CAP_DICTIONARY) != 0;
+            recipients[pickEncoding(user->capabilities) + (packs ? ENCODING_COUNT : 0)].insert(ChatApp::toPeerID(member));
+        }
+
+        EncodedMessages encoded(messages);
+        std::vector<protocol::MessagePackage> packed_messages; // packed lazily, for clients w/ CAP_DICTIONARY
+        EncodedMessages packed(packed_messages);
+        for (size_t i = 0; i < recipients.size(); ++i)
+        {
+            if (recipients[i].empty()) continue;
+            EncodedMessages* batch = &encoded;
+            if (i >= ENCODING_COUNT)
+            {
+                if (packed_messages.empty()) pack(messages, packed_messages);
+                batch = &packed;
+            }
+            const MessageEncoding encoding = static_cast<MessageEncoding>(i % ENCODING_COUNT);
+            for (const std::string& packet : batch->get(encoding)) m_app->sendPacket(recipients[i], packet);
+        }
+    }
+
+    // Moves a user to a room. The user leaves the old room's user list & joins the new one's,
+    // the members of both are told in their next presence broadcast. The user gets the new
+    // room's user list
+    void moveToRoom(user_id_t user_id, const std::string& name)
+    {
+        UserHandle user = m_app->findUser(user_id);
+        if (!user) return;
+        std::lock_guard<std::mutex> lock(m_rooms_mutex);
+        const room_id_t old_room = m_rooms.roomOf(user_id);
+        const room_id_t room = m_rooms.join(user_id, name);
+        if (room != old_room)
+        {
+            leaveRoster(old_room, user_id);
+            enterRoster(room, user->info());
+            const room_id_t local_room = m_rooms.roomOf(0);
+            if (user_id != 0 && (room == local_room || old_room == local_room))
+            {
+                window()->log(user->name + (room == local_room ? " joined" : " left") + " the room");
+            }
+        }
+
+        const std::vector<user_id_t>& members = m_rooms.members(room);
+        if (user_id == 0)
+        {
+            window()->log("Joined #" + m_rooms.name(room) + " (" + std::to_string(members.size()) + " members)");
+            return;
+        }
+        RoomRoster& roster = rosterOf(room);
+        const uint32_t version = roster.log.version();
+        const std::deque<UserListCache::Page>& pages = pagesOf(room);
+        const uint16_t page_count = static_cast<uint16_t>(pages.size());
+        m_app->send(user_id, protocol::RoomMembersPackage(m_rooms.name(room), static_cast<uint32_t>(members.size()), roster.log.epoch(), version, page_count));
+        sendPages(user_id, version, pages);
+        roster.joiners.push_back({ user_id, version });
+    }
+
+    // Sends the pending joins/leaves of a room to its members, m_rooms_mutex must be held
+    void broadcastPresence(room_id_t room_id)
+    {
+        RoomRoster& roster = rosterOf(room_id);
+        protocol::UserDeltaPackage delta(roster.broadcast_version, roster.log.version());
+        roster.presence.flush(delta.removed, delta.added);
+        std::vector<user_id_t> recipients;
+        for (user_id_t member : m_rooms.members(room_id))
+        {
+            if (member != 0) recipients.push_back(member);
+        }
+        if (!recipients.empty())
+        {
+            ByteStream s;
+            delta.serialize(s);
+            m_app->sendPacket(recipients, s.getBuf(), true);
+        }
+        roster.broadcast_version = delta.to_version;
+
+        // users who joined since the last broadcast are at a later version, which
+        // the broadcast doesn't apply to, they're caught up individually instead
+        for (const Joiner& joiner : roster.joiners)
+        {
+            if (joiner.version == roster.broadcast_version) continue;
+            protocol::UserDeltaPackage catch_up(joiner.version, roster.broadcast_version);
+            if (roster.log.since(joiner.version, catch_up.removed, catch_up.added)) m_app->send(joiner.user_id, catch_up);
+        }
+        roster.joiners.clear();
+    }
+
+    // The user list of a room, a fresh one (w/ a new epoch) for a room just created. m_rooms_mutex must be held
+    RoomRoster& rosterOf(room_id_t room_id)
+    {
+        if (room_id >= m_rosters.size()) m_rosters.resize(static_cast<size_t>(room_id) + 1);
+        if (!m_rosters[room_id]) m_rosters[room_id] = std::make_unique<RoomRoster>();
+        return *m_rosters[room_id];
+    }
+
+    // Adds a user to the user list of the room it just joined, m_rooms_mutex must be held
+    void enterRoster(room_id_t room_id, const UserInfo& user)
+    {
+        RoomRoster& roster = rosterOf(room_id);
+        roster.log.add(user);
+        roster.pages.add(user);
+        roster.presence.add(user);
+    }
+
+    // Takes a user off the user list of the room it just left, m_rooms_mutex must be held.
+    // A room dropped w/ its last member drops its list, a room reusing the ID starts over
+    void leaveRoster(room_id_t room_id, user_id_t user_id)
+    {
+        if (room_id != RoomRegistry::LOBBY && m_rooms.members(room_id).empty())
+        {
+            m_rosters[room_id].reset();
+            return;
+        }
+        RoomRoster& roster = rosterOf(room_id);
+        roster.log.remove(user_id);
+        roster.pages.invalidate();
+        roster.presence.remove(user_id);
+        std::erase_if(roster.joiners, [user_id](const Joiner& joiner) { return joiner.user_id == user_id; });
+    }
+
+    // Serialized user list of a room, m_rooms_mutex must be held
+    const std::deque<UserListCache::Page>& pagesOf(room_id_t room_id)
+    {
+        return rosterOf(room_id).pages.get(*m_app->getUsers(), m_rooms.members(room_id), m_app->maxBroadcastPayload());
+    }
+
+    void sendPages(user_id_t user_id, uint32_t version, const std::deque<UserListCache::Page>& pages)
+    {
+        const uint16_t page_count = static_cast<uint16_t>(pages.size());
+        for (uint16_t i = 0; i < page_count; ++i)
+        {
+            m_app->sendUserListPage(user_id, version, i, page_count, pages[i].count, pages[i].users);
+        }
+    }
+
+    // Delivers a direct message to the user holding a name, through the name index &
+    // w/o involving anyone else, or holds it until a user w/ that name connects
+    // @param sender_id the sending user, told if the message isn't delivered right away
+    void routeDirectMessage(user_id_t sender_id, const std::string& sender, const std::string& recipient, const std::string& text)
+    {
+        typedef protocol::DirectMessagePackage Pkg;
+
+        // locked from the lookup on, so a recipient connecting meanwhile gets the message once registered
+        std::lock_guard<std::mutex> lock(m_direct_mutex);
+        Pkg::Status status;
+        if (std::optional<UserRef> user = m_app->getUsers()->findByName(recipient))
+        {
+            if (user->user_id == 0)
+            {
+                window()->print(sender + " -> you", text);
+                return;
+            }
+            if (user->capabilities & protocol::CAP_DIRECT_MESSAGES)
+            {
+                m_app->send(user->user_id, Pkg(sender, text));
+                return;
+            }
+            status = Pkg::DROPPED; // online, but can't receive it
+        }
+        else
+        {
+            const bool held = recipient.length() <= Pkg::MAX_PEER_LENGTH && m_offline.push(recipient, sender, text);
+            status = held ? Pkg::QUEUED : Pkg::DROPPED;
+        }
+
+        if (sender_id != 0) m_app->send(sender_id, Pkg(recipient, std::string(), status));
+        else if (status == Pkg::QUEUED) window()->log(recipient + " is offline, message held for the next user to connect as " + recipient);
+        else window()->error("Message to " + recipient + " couldn't be delivered");
+    }
+
+    // Shows the last logged messages, read back from the log's segments (LOG_CMD [count])
+    void showLog(const std::string& argument)
+    {
+        size_t count = LOG_LINES;
+        if (!argument.empty() && (std::from_chars(argument.data(), argument.data() + argument.length(), count).ec != std::errc() || count == 0))
+        {
+            window()->error("Usage: " LOG_CMD " [count]");
+            return;
+        }
+        if (!m_log.isOpen())
+        {
+            window()->error("No message log is kept, start w/ --log <directory>");
+            return;
+        }
+        count = std::min(count, MAX_LOG_LINES);
+        const uint64_t committed = m_log.getStats().committed;
+        UserSnapshot users = m_app->getUsers();
+        m_log.forEachSince(committed > count ? committed - count : 0, count, [&](uint64_t seq, std::string_view packet)
+        {
+            ByteStream s(packet.data(), packet.length());
+            const protocol::MessagePackage pkg(s);
+            std::optional<UserRef> user = users->find(pkg.user_id);
+            window()->log("#" + std::to_string(seq) + " " + (user ? user->name : "user " + std::to_string(pkg.user_id)) + ": " + pkg.message);
+        });
+    }
+
+    // Is a user in the local user's room?
+    bool inLocalRoom(user_id_t user_id) const
+    {
+        std::lock_guard<std::mutex> lock(m_rooms_mutex);
+        return m_rooms.roomOf(user_id) == m_rooms.roomOf(0);
+    }
+
+    // Packs message texts against the current dictionary, m_dictionary_mutex must be held
+    void pack(const std::vector<protocol::MessagePackage>& messages, std::vector<protocol::MessagePackage>& packed)
+    {
+        packed.reserve(messages.size());
+        for (const protocol::MessagePackage& pkg : messages)
+        {
+            packed.emplace_back(pkg.user_id, m_dictionary.pack(pkg.message));
+            m_packed_in += pkg.message.length();
+            m_packed_out += packed.back().message.length();
+        }
+    }
+
+    // Unpacks a client's message text, against the current dictionary or the one it
+    // replaced (the client may not have received the current one yet)
+    bool unpack(const UserRef& user, const std::string& message, std::string& text)
+    {
+        if (!(user.capabilities & protocol::CAP_DICTIONARY) || !MessageDictionary::isPacked(message))
+        {
+            text = message;
+            return true;
+        }
+        std::lock_guard<std::mutex> lock(m_dictionary_mutex);
+        return m_dictionary.unpack(message, text) || m_previous_dictionary.unpack(message, text);
+    }
+
+    // Trains the dictionary on a message, sending clients w/ CAP_DICTIONARY a new one when due
+    void train(const std::string& message)
+    {
+        std::lock_guard<std::mutex> lock(m_dictionary_mutex);
+        if (!m_trainer.observe(message)) return;
+        const uint8_t version = static_cast<uint8_t>(m_dictionary.version() % 255 + 1); // 0 is the empty dictionary
+        MessageDictionary dictionary = m_trainer.build(version);
+        const std::string entries = dictionary.joined();
+        if (entries == m_dictionary.joined()) return; // nothing new
+
+        m_previous_dictionary = std::move(m_dictionary);
+        m_dictionary = std::move(dictionary);
+        const protocol::DictionaryPackage pkg(version, entries);
+        m_app->getUsers()->forEach([this, &pkg](const UserRef& user)
+        {
+            if (user.user_id != 0 && (user.capabilities & protocol::CAP_DICTIONARY)) m_app->send(user.user_id, pkg);
+        });
+    }
+
+    // Accepts a user: the USERNAME_ACK goes out in clear text, everything after it is
+    // encrypted if the user sent a KEY_EXCHANGE. The client only starts its own session
+    // once the ACK arrives, so a rejected client never encrypts
+    void acknowledge(user_id_t user_id, const protocol::UsernameAckPackage& ack)
+    {
+        m_app->send(user_id, ack);
+        auto keys = m_pending_keys.find(user_id);
+        if (keys != m_pending_keys.end())
+        {
+            m_app->startSession(user_id, keys->second);
+            m_pending_keys.erase(keys);
+        }
+    }
+
+protected:
+    // Brings a newly joined user's list (the lobby's) up to date: w/ the changes since its
+    // known version if the change log still covers it, otherwise w/ a paginated snapshot.
+    // Virtual for tests, to act while a newcomer is in the lobby but not caught up yet
+    virtual void syncUserList(user_id_t user_id, uint32_t capabilities, uint32_t known_epoch, uint32_t known_version)
+    {
+        std::lock_guard<std::mutex> lock(m_rooms_mutex);
+        RoomRoster& lobby = rosterOf(RoomRegistry::LOBBY);
+        const uint32_t version = lobby.log.version();
+        protocol::UserDeltaPackage delta(known_version, version);
+        if (known_epoch == lobby.log.epoch() && lobby.log.since(known_version, delta.removed, delta.added))
+        {
+            acknowledge(user_id, protocol::UsernameAckPackage(user_id, capabilities, lobby.log.epoch(), version, 0));
+            m_app->send(user_id, delta);
+        }
+        else
+        {
+            const std::deque<UserListCache::Page>& pages = pagesOf(RoomRegistry::LOBBY);
+            acknowledge(user_id, protocol::UsernameAckPackage(user_id, capabilities, lobby.log.epoch(), version, static_cast<uint16_t>(pages.size())));
+            sendPages(user_id, version, pages);
+        }
+        lobby.joiners.push_back({ user_id, version });
+    }
+
+private:
+    MessageBatcher m_messages;        ///< messages waiting to be broadcast
+    DictionaryTrainer m_trainer;      ///< learns the dictionary from broadcast messages
+    MessageDictionary m_dictionary;   ///< dictionary clients w/ CAP_DICTIONARY pack against
+    MessageDictionary m_previous_dictionary; ///< dictionary m_dictionary replaced
+    uint64_t m_packed_in = 0;         ///< message text bytes packed, for stats
+    uint64_t m_packed_out = 0;        ///< their size once packed, for stats
+    mutable std::mutex m_dictionary_mutex; ///< guards the above, used from the network & UI threads
+    std::optional<MessageHistory> m_history; ///< recent lobby messages, guarded by m_dictionary_mutex
+    net::PeerSet m_awaiting_history;         ///< newcomers not caught up yet, guarded by m_dictionary_mutex
+    MessageLog m_log;                        ///< every message sent, on disk
+    RoomRegistry m_rooms;             ///< room of each user
+    std::vector<std::unique_ptr<RoomRoster>> m_rosters; ///< user list of each room, by room ID
+    mutable std::mutex m_rooms_mutex; ///< guards m_rooms & m_rosters, used from the network & UI threads
+    OfflineQueue m_offline;           ///< direct messages to users not connected
+    std::mutex m_direct_mutex;        ///< guards m_offline, serializes routing w/ connects
+    std::unordered_map<user_id_t, crypto::SessionKeys> m_pending_keys; ///< sessions starting after the user's USERNAME_ACK
+};
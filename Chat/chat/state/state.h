@@ -1,49 +1,100 @@
-﻿#pragma once
-
-#define EXIT "/exit"
-
-#include "chat/chat_app.h"
-
-/**
- * Basic interface to implement app behaviors
- */
-class State
-{
-public:
-    State(ChatApp* app) : m_app(app) {}
-    ~State() = default;
-    
-    virtual void beginState() {}
-    virtual void endState() { window()->clearAll(); }
-    
-    // User provided input
-    // @param input string (non-empty)
-    virtual void handleInput(char input[80]) {}
-    
-    // Peer connected
-    // @param peer_id Peer ID assigned by ENet
-    // @param address Peer Address provided by ENet
-    virtual void receiveConnectionEvent(net::peer_id_t peer_id, const net::Address& address) {}
-    // Peer disconnected
-    // @param peer_id Peer ID assigned by ENet
-    // @param address Peer Address provided by ENet
-    virtual void receiveDisconnectEvent(net::peer_id_t peer_id, const net::Address& address) {}
-
-    // The following are called when data is exchanged between host/client. Each package
-    // requires specific handling depending on application is host or client
-    // @param user user associated to the package
-    // @param pkg the package, see protocol
-        
-    virtual void receiveUsernameEvent(UserInfo* user, protocol::UsernamePackage& pkg) {}
-    virtual void receiveUsernameAckEvent(protocol::UsernameAckPackage& pkg) {}
-    virtual void receiveAddUserEvent(UserInfo* user, protocol::AddUserPackage& pkg) {}
-    virtual void receiveRemoveUserEvent(UserInfo* user, protocol::RemoveUserPackage& pkg) {}
-    virtual void receiveMessageEvent(UserInfo* user, protocol::MessagePackage& pkg) {}
-
-protected:
-    ChatApp* m_app; ///< pointer to the owning chat window
-
-    // helpers to access app class members
-    ChatWindow* window() const { return m_app->getWindow(); }
-    ChatApp::ChatConfig* config() const { return m_app->getConfig(); }
-};
+﻿#pragma once
+
+#define EXIT "/exit"
+#define STATS "/stats"
+#define JOIN_CMD "/join"
+#define LEAVE_CMD "/leave"
+#define LOG_CMD "/log" // host: shows the last logged messages
+#define MSG_CMD "/msg" // to an offline name, held by the host for whoever connects next w/ that name
+
+#include "chat/chat_app.h"
+
+/**
+ * Basic interface to implement app behaviors
+ */
+class State
+{
+public:
+    State(ChatApp* app) : m_app(app) {}
+    virtual ~State() = default; // states are deleted through State*, see ChatApp::goToState
+    
+    virtual void beginState() {}
+    virtual void endState() { window()->clearAll(); }
+
+    // Called from the network thread once per network loop iteration
+    virtual void tick() {}
+    
+    // User provided input
+    // @param input string (non-empty)
+    virtual void handleInput(const std::string& input) {}
+    
+    // Peer connected
+    // @param peer_id Peer ID assigned by ENet
+    // @param address Peer Address provided by ENet
+    virtual void receiveConnectionEvent(net::peer_id_t peer_id, const net::Address& address) {}
+    // Peer disconnected
+    // @param peer_id Peer ID assigned by ENet
+    // @param address Peer Address provided by ENet
+    virtual void receiveDisconnectEvent(net::peer_id_t peer_id, const net::Address& address) {}
+
+    // The following are called when data is exchanged between host/client. Each package
+    // requires specific handling depending on application is host or client
+    // @param user user associated to the package (null if unknown)
+    // @param pkg the package, see protocol
+        
+    virtual void receiveUsernameEvent(UserInfo* user, protocol::UsernamePackage& pkg) {}
+    virtual void receiveUsernameAckEvent(protocol::UsernameAckPackage& pkg) {}
+    virtual void receiveAddUserEvent(UserInfo* user, protocol::AddUserPackage& pkg) {}
+    virtual void receiveRemoveUserEvent(const UserRef* user, protocol::RemoveUserPackage& pkg) {}
+    virtual void receiveMessageEvent(const UserRef* user, protocol::MessagePackage& pkg) {}
+    virtual void receiveUserDeltaEvent(protocol::UserDeltaPackage& pkg) {}
+    virtual void receiveUserListPageEvent(protocol::UserListPagePackage& pkg) {}
+    virtual void receiveDictionaryEvent(protocol::DictionaryPackage& pkg) {}
+    virtual void receiveKeyExchangeEvent(user_id_t user_id, protocol::KeyExchangePackage& pkg) {}
+    virtual void receiveJoinRoomEvent(const UserRef* user, protocol::JoinRoomPackage& pkg) {}
+    virtual void receiveRoomMembersEvent(protocol::RoomMembersPackage& pkg) {}
+    virtual void receiveDirectMessageEvent(const UserRef* user, protocol::DirectMessagePackage& pkg) {}
+
+protected:
+    ChatApp* m_app; ///< pointer to the owning chat window
+
+    // helpers to access app class members
+    ChatWindow* window() const { return m_app->getWindow(); }
+    ChatApp::ChatConfig* config() const { return m_app->getConfig(); }
+
+    // Parses "<command> <argument>" input
+    // @return false if the input is another command
+    static bool parseCommand(const std::string& input, const char* command, std::string& argument)
+    {
+        const size_t length = strlen(command);
+        if (input.compare(0, length, command) != 0 || (input.length() > length && input[length] != ' ')) return false;
+        argument = input.length() > length ? input.substr(length + 1) : std::string();
+        return true;
+    }
+
+    // Splits a command argument into its first word & the rest
+    // @return false if either is missing
+    static bool splitArgument(const std::string& argument, std::string& first, std::string& rest)
+    {
+        const size_t space = argument.find(' ');
+        if (space == 0 || space == std::string::npos || space + 1 == argument.length()) return false;
+        first = argument.substr(0, space);
+        rest = argument.substr(space + 1);
+        return true;
+    }
+
+    // Logs stats shared by all connected states, see /stats
+    void logStats() const
+    {
+        const net::TrafficStats traffic = m_app->getTrafficStats();
+        window()->log("UI latency " + window()->latencyStats());
+        window()->log("Packets " + std::to_string(traffic.packets) + " sent, "
+            + std::to_string(traffic.fragmented) + " fragmented, " + std::to_string(traffic.encrypted) + " encrypted, "
+            + std::to_string(traffic.rejected) + " rejected");
+        const net::CompressionStats compression = m_app->getCompressionStats();
+        window()->log("Compression " + std::to_string(compression.datagrams) + " datagrams, "
+            + std::to_string(compression.bytes_in) + " -> " + std::to_string(compression.bytes_out) + " bytes, "
+            + std::to_string(compression.compress_ns / 1000) + "us compressing, "
+            + std::to_string(compression.decompress_ns / 1000) + "us decompressing");
+    }
+};
@@ -0,0 +1,75 @@
+﻿#pragma once
+
+#include <deque>
+#include <limits>
+#include <optional>
+#include <vector>
+
+#include "user_registry.h"
+#include "network/protocol.h"
+#include "util/byte_stream.h"
+
+/**
+ * Serialized user list, as shipped in USER_LIST_PAGE packets
+ *
+ * Kept by the host so a join doesn't re-serialize every user: joins are
+ * appended in place, leaves only invalidate the pages, which are then rebuilt
+ * (once) from the registry the next time they are needed.
+ *
+ * Pages are filled up to a byte size, so each fits in one datagram. The host
+ * keeps one per room, holding the room's members.
+ */
+class UserListCache
+{
+public:
+    struct Page
+    {
+        ByteStream users;    ///< serialized users, back to back
+        uint16_t count = 0;  ///< number of users in the page
+    };
+
+    // Appends a newly registered user
+    void add(const UserInfo& user)
+    {
+        if (m_valid) append(user);
+    }
+
+    // Marks the pages stale, e.g. after a user was removed
+    void invalidate() { m_valid = false; }
+
+    // Returns the serialized pages, rebuilding them if stale or if the max. packet size changed
+    // @param members users listed, in the registry
+    // @param max_bytes max. size of a USER_LIST_PAGE packet, header included
+    const std::deque<Page>& get(const UserRegistry& users, const std::vector<user_id_t>& members, size_t max_bytes)
+    {
+        if (!m_valid || max_bytes != m_max_bytes)
+        {
+            m_max_bytes = max_bytes;
+            m_pages.clear();
+            for (user_id_t user_id : members)
+            {
+                if (std::optional<UserRef> user = users.find(user_id)) append(user->info());
+            }
+            m_valid = true;
+        }
+        return m_pages;
+    }
+
+private:
+    void append(const UserInfo& user)
+    {
+        const size_t size = protocol::codec::serializedSize(user);
+        const size_t max_body = m_max_bytes - protocol::UserListPagePackage::HEADER_SIZE;
+        if (m_pages.empty() || m_pages.back().count == std::numeric_limits<uint16_t>::max()
+            || (m_pages.back().count > 0 && m_pages.back().users.getLength() + size > max_body))
+        {
+            m_pages.emplace_back();
+        }
+        user.serialize(m_pages.back().users);
+        m_pages.back().count++;
+    }
+
+    std::deque<Page> m_pages; ///< serialized users, split into pages
+    size_t m_max_bytes = 0;   ///< max. packet size the pages were built for
+    bool m_valid = false;     ///< false if m_pages needs a rebuild
+};
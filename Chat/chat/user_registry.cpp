@@ -0,0 +1,102 @@
+﻿#include "user_registry.h"
+
+#include <algorithm>
+
+name_id_t NamePool::intern(const std::string& name, user_id_t user_id)
+{
+    auto it = m_index.find(name);
+    if (it != m_index.end())
+    {
+        m_entries[it->second].holders.push_back(user_id);
+        return it->second;
+    }
+
+    name_id_t id;
+    if (!m_free.empty())
+    {
+        id = m_free.back();
+        m_free.pop_back();
+    }
+    else
+    {
+        id = static_cast<name_id_t>(m_entries.size());
+        m_entries.emplace_back();
+    }
+    m_entries[id].name = name;
+    m_entries[id].holders.assign(1, user_id);
+    m_index.emplace(name, id);
+    return id;
+}
+
+void NamePool::release(name_id_t id, user_id_t user_id)
+{
+    Entry& entry = m_entries[id];
+    auto holder = std::find(entry.holders.begin(), entry.holders.end(), user_id);
+    if (holder != entry.holders.end()) entry.holders.erase(holder); // keeps the order, few holders per name
+    if (!entry.holders.empty()) return;
+    m_index.erase(entry.name);
+    entry.name = std::string();
+    m_free.push_back(id);
+}
+
+std::optional<name_id_t> NamePool::find(const std::string& name) const
+{
+    auto it = m_index.find(name);
+    if (it != m_index.end()) return it->second;
+    return std::nullopt;
+}
+
+bool UserRegistry::insert(const UserInfo& user)
+{
+    if (contains(user.user_id)) return false;
+    if (user.user_id >= m_slots.size()) m_slots.resize(static_cast<size_t>(user.user_id) + 1, NONE);
+
+    m_slots[user.user_id] = static_cast<uint32_t>(m_hot.size());
+    m_hot.push_back({ user.user_id, m_names.intern(user.name, user.user_id) });
+    m_cold.push_back({ user.address, user.capabilities });
+    m_version++;
+    return true;
+}
+
+bool UserRegistry::erase(user_id_t user_id)
+{
+    const uint32_t i = index(user_id);
+    if (i == NONE) return false;
+    m_names.release(m_hot[i].name, user_id);
+
+    // swap-remove, keeping records packed
+    const uint32_t last = static_cast<uint32_t>(m_hot.size() - 1);
+    if (i != last)
+    {
+        m_hot[i] = m_hot[last];
+        m_cold[i] = m_cold[last];
+        m_slots[m_hot[i].user_id] = i;
+    }
+    m_hot.pop_back();
+    m_cold.pop_back();
+    m_slots[user_id] = NONE;
+    m_version++;
+    return true;
+}
+
+std::optional<UserRef> UserRegistry::find(user_id_t user_id) const
+{
+    const uint32_t i = index(user_id);
+    if (i == NONE) return std::nullopt;
+    return ref(i);
+}
+
+std::optional<UserRef> UserRegistry::findByName(const std::string& name) const
+{
+    const std::optional<name_id_t> id = m_names.find(name);
+    if (!id) return std::nullopt;
+    return find(m_names.holders(*id).front());
+}
+
+std::vector<UserInfo> UserRegistry::list() const
+{
+    std::vector<UserInfo> users;
+    users.reserve(m_hot.size());
+    forEach([&users](const UserRef& user) { users.push_back(user.info()); });
+    return users;
+}
@@ -0,0 +1,181 @@
+﻿#pragma once
+
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <optional>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "userinfo.h"
+
+typedef uint32_t name_id_t;
+
+/**
+ * Pool of interned user names, w/ the users holding each
+ *
+ * Names are stored once & addressed by a small ID, references returned by
+ * get() stay valid until the name is released by all its users. Names aren't
+ * unique, each keeps its holders in the order they took it.
+ */
+class NamePool
+{
+public:
+    // Interns a name for a user
+    name_id_t intern(const std::string& name, user_id_t user_id);
+
+    // Drops a user's reference to a name, freeing it once unreferenced
+    void release(name_id_t id, user_id_t user_id);
+
+    // Returns an interned name
+    const std::string& get(name_id_t id) const { return m_entries[id].name; }
+
+    // Returns the users holding a name, the earliest first
+    const std::vector<user_id_t>& holders(name_id_t id) const { return m_entries[id].holders; }
+
+    // Looks up an interned name
+    std::optional<name_id_t> find(const std::string& name) const;
+
+private:
+    struct Entry
+    {
+        std::string name;               ///< the name
+        std::vector<user_id_t> holders; ///< users referencing it, mostly just one
+    };
+
+    std::deque<Entry> m_entries; ///< names by ID, deque keeps references stable
+    std::vector<name_id_t> m_free; ///< released IDs, reused first
+    std::unordered_map<std::string, name_id_t> m_index; ///< name -> ID
+};
+
+/**
+ * Read-only view of a registered user
+ *
+ * References into the registry, only valid until the registry is modified.
+ */
+struct UserRef
+{
+    user_id_t user_id;           ///< application-specific user ID
+    const std::string& name;     ///< Nickname
+    const net::Address& address; ///< Address (server only)
+    uint32_t capabilities;       ///< Negotiated protocol capabilities (server only)
+
+    UserInfo info() const
+    {
+        UserInfo user(user_id, name, address);
+        user.capabilities = capabilities;
+        return user;
+    }
+};
+
+/**
+ * Dense registry of connected users
+ *
+ * User IDs are small (peer ID + 1), so each ID maps straight to a slot, which
+ * makes lookups O(1). Records are packed contiguously (swap-remove on erase),
+ * hot fields (ID & interned name) apart from cold ones (address, capabilities).
+ *
+ * ChatApp publishes the registry as immutable snapshots (see UserSnapshot),
+ * each modification bumps the version.
+ */
+class UserRegistry
+{
+public:
+    // Adds a user
+    // @return false if the user ID is already registered
+    bool insert(const UserInfo& user);
+
+    // Removes a user
+    // @return false if the user ID is not registered
+    bool erase(user_id_t user_id);
+
+    // Returns true if the user ID is registered
+    bool contains(user_id_t user_id) const { return index(user_id) != NONE; }
+
+    // Looks up a user by ID
+    std::optional<UserRef> find(user_id_t user_id) const;
+
+    // Looks up a user by name, in O(1) through the name index. Of several users
+    // sharing a name, the one that took it first
+    std::optional<UserRef> findByName(const std::string& name) const;
+
+    // Returns a copy of all registered users
+    std::vector<UserInfo> list() const;
+
+    // Calls f(UserRef) for every registered user, in storage order
+    template <typename F>
+    void forEach(F&& f) const
+    {
+        for (size_t i = 0; i < m_hot.size(); ++i) f(ref(i));
+    }
+
+    size_t size() const { return m_hot.size(); }
+    bool empty() const { return m_hot.empty(); }
+
+    // Number of modifications applied so far
+    uint64_t version() const { return m_version; }
+
+private:
+    static constexpr uint32_t NONE = UINT32_MAX;
+
+    // Frequently accessed fields, e.g. when printing a message
+    struct HotRecord
+    {
+        user_id_t user_id; ///< user ID
+        name_id_t name;    ///< interned nickname
+    };
+
+    // Rarely accessed fields
+    struct ColdRecord
+    {
+        net::Address address;  ///< address (server only)
+        uint32_t capabilities; ///< negotiated capabilities (server only)
+    };
+
+    // Returns the record index of a user ID, or NONE
+    uint32_t index(user_id_t user_id) const
+    {
+        return user_id < m_slots.size() ? m_slots[user_id] : NONE;
+    }
+
+    UserRef ref(size_t i) const
+    {
+        return UserRef{ m_hot[i].user_id, m_names.get(m_hot[i].name), m_cold[i].address, m_cold[i].capabilities };
+    }
+
+    std::vector<uint32_t> m_slots;      ///< record index by user ID, NONE if absent
+    std::vector<HotRecord> m_hot;       ///< hot fields, packed
+    std::vector<ColdRecord> m_cold;     ///< cold fields, parallel to m_hot
+    NamePool m_names;                   ///< interned nicknames
+    uint64_t m_version = 0;             ///< modification count
+};
+
+// Immutable, shared version of the registry
+typedef std::shared_ptr<const UserRegistry> UserSnapshot;
+
+/**
+ * A user looked up in a registry snapshot
+ *
+ * Holds on to the snapshot, so the user's fields stay valid for as long as
+ * the handle lives, whatever happens to the registry meanwhile.
+ */
+class UserHandle
+{
+public:
+    UserHandle() = default;
+
+    UserHandle(UserSnapshot snapshot, user_id_t user_id)
+        : m_snapshot(std::move(snapshot)), m_ref(m_snapshot ? m_snapshot->find(user_id) : std::nullopt) {}
+
+    explicit operator bool() const { return m_ref.has_value(); }
+    const UserRef* operator->() const { return &*m_ref; }
+    const UserRef& operator*() const { return *m_ref; }
+
+    // Returns the user, or null if not found
+    const UserRef* get() const { return m_ref ? &*m_ref : nullptr; }
+
+private:
+    UserSnapshot m_snapshot;      ///< snapshot the user was found in
+    std::optional<UserRef> m_ref; ///< the user, refers into m_snapshot
+};
@@ -0,0 +1,209 @@
+﻿#pragma once
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <tuple>
+#include <type_traits>
+#include <vector>
+
+#include "util/byte_stream.h"
+
+/**
+ * Declares the serialized fields of a struct, in wire order
+ *
+ * Encoding, decoding & sizes are then derived by the codec below, so the read &
+ * write order of a struct can't drift apart.
+ */
+#define PROTOCOL_FIELDS(...) \
+    auto fields() { return std::tie(__VA_ARGS__); } \
+    auto fields() const { return std::tie(__VA_ARGS__); }
+
+/**
+ * Generic wire codec
+ *
+ * Wire format, by type:
+ *   - arithmetic/enum: raw bytes, host byte order
+ *   - std::string: u64 length, then the bytes
+ *   - std::vector: u16 count, then the elements (encoding more throws std::length_error)
+ *   - structs w/ PROTOCOL_FIELDS: the fields, back to back
+ */
+namespace protocol::codec
+{
+    template <typename T>
+    concept Scalar = std::is_arithmetic_v<T> || std::is_enum_v<T>;
+
+    template <typename T>
+    concept Fields = requires(T& t) { t.fields(); };
+
+    template <typename T>
+    struct FieldTypes;
+
+    template <typename... Ts>
+    struct FieldTypes<std::tuple<Ts&...>> { typedef std::tuple<std::remove_const_t<Ts>...> type; };
+
+    // Serialized size of T if it is the same for all values (only scalars), 0 otherwise
+    template <typename T>
+    constexpr size_t fixedSize();
+
+    template <typename... Ts>
+    constexpr size_t fixedSizeOf(std::tuple<Ts...>*)
+    {
+        return ((fixedSize<Ts>() > 0) && ...) ? (fixedSize<Ts>() + ... + 0) : 0;
+    }
+
+    template <typename T>
+    constexpr size_t fixedSize()
+    {
+        if constexpr (Scalar<T>) return sizeof(T);
+        else if constexpr (Fields<T>) return fixedSizeOf(static_cast<typename FieldTypes<decltype(std::declval<T&>().fields())>::type*>(nullptr));
+        else return 0;
+    }
+
+    // encoding
+
+    template <Scalar T>
+    void encode(ByteStream& s, T value) { s.writeBytes(&value, sizeof(T)); }
+
+    inline void encode(ByteStream& s, const std::string& value) { s.writeString(value, value.length()); }
+
+    template <Fields T>
+    void encode(ByteStream& s, const T& value);
+
+    template <typename T>
+    void encode(ByteStream& s, const std::vector<T>& values)
+    {
+        if (values.size() > UINT16_MAX) throw std::length_error("Too many elements to encode");
+        s.writeUInt16(static_cast<uint16_t>(values.size()));
+        for (const T& value : values) encode(s, value);
+    }
+
+    template <Fields T>
+    void encode(ByteStream& s, const T& value)
+    {
+        std::apply([&s](const auto&... field) { (encode(s, field), ...); }, value.fields());
+    }
+
+    // decoding, reads throw std::out_of_range past the end of the stream
+
+    template <Scalar T>
+    void decode(ByteStream& s, T& value) { memcpy(&value, s.readBytes(sizeof(T)), sizeof(T)); }
+
+    inline void decode(ByteStream& s, std::string& value) { value = s.readString(); }
+
+    template <Fields T>
+    void decode(ByteStream& s, T& value);
+
+    template <typename T>
+    void decode(ByteStream& s, std::vector<T>& values)
+    {
+        // every element takes at least a byte, a larger count can't be genuine
+        const uint16_t count = s.readUInt16();
+        if (count > s.remaining()) throw std::out_of_range("Element count exceeds the stream");
+        values.resize(count);
+        for (T& value : values) decode(s, value);
+    }
+
+    // fixed-size values are copied out of one bounds-checked span
+    template <Scalar T>
+    void decodeFixed(const char*& bytes, T& value)
+    {
+        memcpy(&value, bytes, sizeof(T));
+        bytes += sizeof(T);
+    }
+
+    template <Fields T>
+    void decodeFixed(const char*& bytes, T& value)
+    {
+        std::apply([&bytes](auto&... field) { (decodeFixed(bytes, field), ...); }, value.fields());
+    }
+
+    template <Fields T>
+    void decode(ByteStream& s, T& value)
+    {
+        if constexpr (fixedSize<T>() > 0)
+        {
+            const char* bytes = s.readBytes(fixedSize<T>());
+            decodeFixed(bytes, value);
+        }
+        else
+        {
+            std::apply([&s](auto&... field) { (decode(s, field), ...); }, value.fields());
+        }
+    }
+
+    // sizes
+
+    template <Scalar T>
+    constexpr size_t serializedSize(T) { return sizeof(T); }
+
+    inline size_t serializedSize(const std::string& value) { return sizeof(uint64_t) + value.length(); }
+
+    template <Fields T>
+    size_t serializedSize(const T& value);
+
+    template <typename T>
+    size_t serializedSize(const std::vector<T>& values)
+    {
+        if constexpr (fixedSize<T>() > 0) return sizeof(uint16_t) + values.size() * fixedSize<T>();
+        size_t size = sizeof(uint16_t);
+        for (const T& value : values) size += serializedSize(value);
+        return size;
+    }
+
+    template <Fields T>
+    size_t serializedSize(const T& value)
+    {
+        if constexpr (fixedSize<T>() > 0) return fixedSize<T>();
+        return std::apply([](const auto&... field) { return (serializedSize(field) + ... + 0); }, value.fields());
+    }
+
+    // varints: 7 bits per byte, least significant first, high bit set if more bytes follow
+
+    inline void encodeVarint(ByteStream& s, uint64_t value)
+    {
+        for (; value >= 0x80; value >>= 7) s.writeUInt8(static_cast<uint8_t>(value | 0x80));
+        s.writeUInt8(static_cast<uint8_t>(value));
+    }
+
+    inline uint64_t decodeVarint(ByteStream& s)
+    {
+        uint64_t value = 0;
+        for (int shift = 0; shift < 64; shift += 7)
+        {
+            const uint8_t byte = s.readUInt8();
+            value |= static_cast<uint64_t>(byte & 0x7F) << shift;
+            if (!(byte & 0x80)) return value;
+        }
+        throw std::out_of_range("Malformed varint");
+    }
+
+    inline size_t varintSize(uint64_t value)
+    {
+        size_t size = 1;
+        for (; value >= 0x80; value >>= 7) size++;
+        return size;
+    }
+
+    // packages: the packet type, followed by the fields
+
+    template <typename Pkg>
+    void encodePackage(ByteStream& s, const Pkg& pkg)
+    {
+        s.writeInt8(Pkg::TYPE);
+        encode(s, pkg);
+    }
+
+    template <typename Pkg>
+    void decodePackage(ByteStream& s, Pkg& pkg)
+    {
+        pkg.packet_type = s.readInt8();
+        decode(s, pkg);
+    }
+
+    template <typename Pkg>
+    size_t packageSize(const Pkg& pkg)
+    {
+        return sizeof(int8_t) + serializedSize(pkg);
+    }
+}
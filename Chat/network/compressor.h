@@ -0,0 +1,169 @@
+﻿#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <vector>
+#include <enet/enet.h>
+
+#include "util/lz_codec.h"
+
+namespace net
+{
+    // Compression algorithms, tagged in the first byte of each compressed datagram
+    enum class CompressionCodec : enet_uint8
+    {
+        RANGE_CODER = 1, // ENet's built-in adaptive range coder, denser
+        LZ = 2,          // LZ77, see util/lz_codec.h, faster
+    };
+
+    // Compression counters
+    struct CompressionStats
+    {
+        uint64_t datagrams = 0;     ///< datagrams compressed
+        uint64_t bytes_in = 0;      ///< their size before compression
+        uint64_t bytes_out = 0;     ///< their size after compression
+        uint64_t compress_ns = 0;   ///< time spent compressing (incl. attempts that didn't pay off)
+        uint64_t decompress_ns = 0; ///< time spent decompressing
+    };
+
+    /**
+     * Adaptive datagram compressor, plugged into ENet as its ENetCompressor
+     *
+     * Always able to decompress, so peers can turn compression on independently.
+     * Outgoing datagrams are only compressed while enabled, above a minimum size &
+     * while compression pays off: once the recent ratio is poor, datagrams go out
+     * raw, & only every PROBE_INTERVAL-th one is compressed to re-measure it.
+     *
+     * ENet calls it from enet_host_service/enet_host_flush, i.e. w/ the host locked.
+     */
+    class AdaptiveCompressor
+    {
+    public:
+        typedef std::chrono::steady_clock Clock;
+
+        static constexpr size_t DEFAULT_MIN_SIZE = 96;  ///< smaller datagrams rarely shrink
+        static constexpr double MAX_RATIO = 0.9;        ///< compressed/raw ratio worth the CPU time
+        static constexpr unsigned PROBE_INTERVAL = 32;  ///< datagrams between probes while not paying off
+
+        AdaptiveCompressor(CompressionCodec codec = CompressionCodec::LZ, size_t min_size = DEFAULT_MIN_SIZE)
+            : m_codec(codec), m_min_size(min_size), m_range_coder(enet_range_coder_create()) {}
+
+        ~AdaptiveCompressor()
+        {
+            if (m_range_coder) enet_range_coder_destroy(m_range_coder);
+        }
+
+        AdaptiveCompressor(const AdaptiveCompressor&) = delete;
+        AdaptiveCompressor& operator=(const AdaptiveCompressor&) = delete;
+
+        // Plugs the compressor into a host, it must outlive the host
+        void install(ENetHost* host)
+        {
+            ENetCompressor compressor;
+            compressor.context = this;
+            compressor.compress = &AdaptiveCompressor::compressCallback;
+            compressor.decompress = &AdaptiveCompressor::decompressCallback;
+            compressor.destroy = NULL;
+            enet_host_compress(host, &compressor);
+        }
+
+        // Turns compression of outgoing datagrams on/off
+        void setEnabled(bool enabled) { m_enabled = enabled; }
+        bool isEnabled() const { return m_enabled; }
+
+        CompressionStats getStats() const
+        {
+            CompressionStats stats;
+            stats.datagrams = m_datagrams;
+            stats.bytes_in = m_bytes_in;
+            stats.bytes_out = m_bytes_out;
+            stats.compress_ns = m_compress_ns;
+            stats.decompress_ns = m_decompress_ns;
+            return stats;
+        }
+
+    private:
+        static size_t ENET_CALLBACK compressCallback(void* context, const ENetBuffer* in_buffers, size_t in_buffer_count,
+            size_t in_limit, enet_uint8* out_data, size_t out_limit)
+        {
+            return static_cast<AdaptiveCompressor*>(context)->compress(in_buffers, in_buffer_count, in_limit, out_data, out_limit);
+        }
+
+        static size_t ENET_CALLBACK decompressCallback(void* context, const enet_uint8* in_data, size_t in_limit,
+            enet_uint8* out_data, size_t out_limit)
+        {
+            return static_cast<AdaptiveCompressor*>(context)->decompress(in_data, in_limit, out_data, out_limit);
+        }
+
+        size_t compress(const ENetBuffer* in_buffers, size_t in_buffer_count, size_t in_limit, enet_uint8* out_data, size_t out_limit)
+        {
+            if (!m_enabled || in_limit < m_min_size || out_limit < 2) return 0;
+            if (m_ratio > MAX_RATIO && ++m_skipped < PROBE_INTERVAL) return 0; // not paying off lately
+            m_skipped = 0;
+
+            const Clock::time_point start = Clock::now();
+            size_t size = 0;
+            if (m_codec == CompressionCodec::RANGE_CODER)
+            {
+                size = enet_range_coder_compress(m_range_coder, in_buffers, in_buffer_count, in_limit, out_data + 1, out_limit - 1);
+            }
+            else
+            {
+                // gathered first, the LZ codec works on one contiguous block
+                m_scratch.resize(in_limit);
+                enet_uint8* out = m_scratch.data();
+                for (size_t i = 0; i < in_buffer_count; ++i)
+                {
+                    memcpy(out, in_buffers[i].data, in_buffers[i].dataLength);
+                    out += in_buffers[i].dataLength;
+                }
+                size = lz::compress(m_scratch.data(), in_limit, out_data + 1, out_limit - 1);
+            }
+            m_compress_ns += std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - start).count();
+
+            // smoothed ratio, failed attempts count as not compressible
+            const size_t compressed = size ? size + 1 : in_limit;
+            m_ratio = 0.875 * m_ratio + 0.125 * (static_cast<double>(compressed) / in_limit);
+            if (!size || compressed >= in_limit) return 0;
+
+            out_data[0] = static_cast<enet_uint8>(m_codec);
+            m_datagrams++;
+            m_bytes_in += in_limit;
+            m_bytes_out += compressed;
+            return compressed;
+        }
+
+        size_t decompress(const enet_uint8* in_data, size_t in_limit, enet_uint8* out_data, size_t out_limit)
+        {
+            if (in_limit < 1) return 0;
+            const Clock::time_point start = Clock::now();
+            size_t size = 0;
+            switch (static_cast<CompressionCodec>(in_data[0]))
+            {
+                case CompressionCodec::RANGE_CODER: {
+                        size = enet_range_coder_decompress(m_range_coder, in_data + 1, in_limit - 1, out_data, out_limit);
+                        break;
+                } case CompressionCodec::LZ: {
+                        size = lz::decompress(in_data + 1, in_limit - 1, out_data, out_limit);
+                        break;
+                } default: { /* unknown codec, dropped */ }
+            }
+            m_decompress_ns += std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - start).count();
+            return size;
+        }
+
+        CompressionCodec m_codec;  ///< codec used for outgoing datagrams
+        size_t m_min_size;         ///< smaller datagrams go out raw
+        void* m_range_coder;       ///< ENet range coder context
+        std::atomic<bool> m_enabled{ false }; ///< compress outgoing datagrams?
+        double m_ratio = 0.0;      ///< smoothed compressed/raw size ratio
+        unsigned m_skipped = 0;    ///< datagrams skipped since the last probe
+        std::vector<enet_uint8> m_scratch; ///< gathered datagram, for the LZ codec
+        std::atomic<uint64_t> m_datagrams{ 0 };     ///< see CompressionStats
+        std::atomic<uint64_t> m_bytes_in{ 0 };      ///< see CompressionStats
+        std::atomic<uint64_t> m_bytes_out{ 0 };     ///< see CompressionStats
+        std::atomic<uint64_t> m_compress_ns{ 0 };   ///< see CompressionStats
+        std::atomic<uint64_t> m_decompress_ns{ 0 }; ///< see CompressionStats
+    };
+}
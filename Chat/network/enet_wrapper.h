@@ -1,265 +1,579 @@
-﻿#pragma once
-
-#include <map>
-#include <mutex>
-#include <enet/enet.h>
-
-#include "address.h"
-
-namespace net
-{
-    typedef enet_uint16 peer_id_t;
-    
-    /**
-     * RAII Wrapper for ENet
-     *
-     * Start with creating an instance of this to initialize networking.
-     * Important that it stays in scope for duration that it is needed. 
-     */
-    struct ENetContainer
-    {
-        ENetContainer() { enet_initialize(); }
-        ~ENetContainer() { enet_deinitialize(); }
-    };
-
-    // Convert ENetPeer to net::Address
-    inline Address convert(const ENetPeer* peer) { return peer ? Address(peer->address.host, peer->address.port) : Address(); }
-    // Convert ENetAddress to net::Address
-    inline Address convert(const ENetAddress& addr) { return Address(addr.host, addr.port); }
-
-    // Network traffic wrapper
-    struct NetworkTraffic
-    {
-        NetworkTraffic(const enet_uint8* pckt_d = NULL, size_t pckt_l = 0, enet_uint32 evdata = 0):
-                peer_id(0), peer_address(), peer_data(NULL), packet_data(pckt_d),
-                packet_length(pckt_l), ping(0), event_data(evdata) {}
-        
-        NetworkTraffic(ENetPeer* peer, void* data_ptr, const enet_uint8* pckt_d = NULL, size_t pckt_l = 0, enet_uint32 evdata = 0):
-                peer_id(peer->incomingPeerID), peer_address(convert(peer->address)), peer_data(data_ptr),
-                packet_data(pckt_d), packet_length(pckt_l), ping(peer->roundTripTime), event_data(evdata) {}
-        
-        peer_id_t peer_id; ///< Peer ID assigned by the library
-        Address peer_address; ///< Address from which peer connected
-        void* peer_data; ///< User data associated with the peer that sent the traffic
-        const enet_uint8* packet_data; ///< The actual data packet (empty for connect/disconnect events)
-        size_t packet_length; ///< Length of the packet data in bytes
-        unsigned ping; ///< Average round-trip time to the peer
-        enet_uint32 event_data; ///< Data associated with the event
-    };
-
-    // Convert incoming ENet data to net::NetworkTraffic
-    template <typename T>
-    NetworkTraffic convert(T& obj)
-    {
-        return NetworkTraffic(reinterpret_cast<enet_uint8*>(&obj), sizeof(T));
-    }
-
-    /**
-     * @brief Callback class prototype
-     *
-     * Inherit this class and implement functions to get network events. These events
-     *  are sent from another thread, but there will not be two simultaneous events.
-     */
-    class NetworkListener
-    {
-    public:
-        // Peer connected
-        // @param e the traffic associated with the event
-        virtual void connectionEvent(NetworkTraffic const& e) {}
-        // Peer disconnected
-        // @param e the traffic associated with the event
-        virtual void disconnectEvent(NetworkTraffic const& e) {}
-        // Peer sent some data
-        // @param e the traffic associated with the event
-        virtual void receiveEvent(NetworkTraffic const& e) {}
-    };
-    
-    class ENetWrapper
-    {
-    public:
-        // non-copyable
-        ENetWrapper(const ENetWrapper&) = delete; // non-construction-copyable
-        ENetWrapper& operator=(const ENetWrapper&) = delete; // non-copyable
-        
-        ENetWrapper(NetworkListener& listener, bool hosting = true, int port = -1, void* data = NULL, int max_connections = 16):
-                m_quit(false), m_host(NULL), m_listener(listener), m_data(data)
-        {
-            m_address.host = ENET_HOST_ANY;
-            m_address.port = port < 0 ? ENET_PORT_ANY : port;
-            m_host = enet_host_create(hosting ? &m_address : NULL, max_connections, 1, 0, 0);
-            if (!m_host) throw std::runtime_error("An error occured while trying to create an ENet host.");
-            // Start listener thread
-            m_thread = std::jthread(&ENetWrapper::listen, std::ref(*this));
-        }
-        
-        ~ENetWrapper()
-        {
-            terminate();
-            std::lock_guard<std::mutex> lock(m_mutex);
-            if (m_host)
-            {
-                ENetEvent e;
-                enet_host_service(m_host, &e, 5);
-                for (size_t i = 0; i < m_host->peerCount; ++i)
-                {
-                    enet_peer_disconnect(&m_host->peers[i], 0);
-                }
-                enet_host_destroy(m_host);
-                m_host = nullptr;
-            }
-        }
-
-        // listener thread -- DO NOT CALL DIRECTLY
-        void listen()
-        {
-            ENetEvent e;
-            while (!m_quit)
-            {
-                {
-                    std::lock_guard<std::mutex> lock(m_mutex); // ensures no other thread can access
-                    enet_host_service(m_host, &e, 0); // nonblocking
-                }
-                switch (e.type)
-                {
-                    case ENET_EVENT_TYPE_NONE: {
-                            break;
-                    } case ENET_EVENT_TYPE_CONNECT: {
-                            m_peers[e.peer->incomingPeerID] = e.peer;
-                            m_listener.connectionEvent(NetworkTraffic(e.peer, e.peer->data, NULL, 0, e.data));
-                            break;
-                    } case ENET_EVENT_TYPE_DISCONNECT: {
-                            m_listener.disconnectEvent(NetworkTraffic(e.peer, e.peer->data, NULL, 0, e.data));
-                            e.peer->data = NULL;
-                            m_peers.erase(e.peer->incomingPeerID);
-                            break;
-                    } case ENET_EVENT_TYPE_RECEIVE: {
-                            m_listener.receiveEvent(NetworkTraffic(e.peer, e.peer->data, e.packet->data, e.packet->dataLength, e.data));
-                            enet_packet_destroy(e.packet);
-                            break;
-                    }
-                }
-                std::this_thread::sleep_for(std::chrono::milliseconds(1)); // ensures events processed sequentially
-            }
-        }
-
-        /**
-         * Connect to a peer
-         * @param host the address to connect to
-         * @param port the port to connect to
-         * @param data application specific data that can be retrieved in events
-         */
-        void connect(const std::string& host, int port, void* data = NULL)
-        {
-            ENetAddress address;
-            enet_address_set_host(&address, host.c_str());
-            address.port = port;
-            // initiating connection
-            ENetPeer* peer = NULL;
-            std::lock_guard<std::mutex> lock(m_mutex);
-            peer = enet_host_connect(m_host, &address, 0, 0);
-            if (!peer) throw std::runtime_error("No available peers for initializing an ENet connection.");
-            peer->data = data;
-        }
-
-        /**
-         * Connect to a peer
-         * @param addr the address to connect to
-         * @param data application specific data that can be retrieved in events
-         */
-        void connect(const Address& addr, void* data = NULL)
-        {
-            ENetAddress address;
-            address.host = addr.host;
-            address.port = addr.port;
-            // initiating connection
-            ENetPeer* peer = NULL;
-            std::lock_guard<std::mutex> lock(m_mutex);
-            peer = enet_host_connect(m_host, &address, 0, 0);
-            if (!peer) throw std::runtime_error("No available peers for initializing an ENet connection.");
-            peer->data = data;
-        }
-
-        // Send a packet to all peers
-        void broadcast(const NetworkTraffic& msg)
-        {
-            ENetPacket* packet = enet_packet_create(msg.packet_data, msg.packet_length, 0);
-            std::lock_guard<std::mutex> lock(m_mutex);
-            enet_host_broadcast(m_host, 0, packet);
-        }
-
-        // Send a string to all peers
-        void broadcast(const std::string& msg)
-        {
-            NetworkTraffic traffic(reinterpret_cast<const enet_uint8*>(msg.c_str()), msg.length());
-            broadcast(traffic);
-        }
-
-        // send a packet to a specific peer
-        void send(peer_id_t peer_id, const NetworkTraffic& msg)
-        {
-            ENetPeer* peer = getPeerPtr(peer_id);
-            if (!peer) return;
-            ENetPacket* packet = enet_packet_create(msg.packet_data, msg.packet_length, 0);
-            std::lock_guard<std::mutex> lock(m_mutex);
-            enet_peer_send(peer, 0, packet);
-        }
-
-        // send a string to a specific peer
-        void send(peer_id_t peer_id, const std::string& msg)
-        {
-            NetworkTraffic traffic(reinterpret_cast<const enet_uint8*>(msg.c_str()), msg.length());
-            send(peer_id, traffic);
-        }
-
-        // disconnects the given peer
-        void disconnect(peer_id_t peer_id, bool force = false, uint32_t disconnection_data = 0)
-        {
-            ENetPeer* peer = getPeerPtr(peer_id);
-            if (!peer) return;
-            if (force) enet_peer_disconnect_now(peer, disconnection_data);
-            else enet_peer_disconnect(peer, disconnection_data);
-        }
-
-        // disconnects all peers
-        void disconnectAll(bool force = false, uint32_t disconnection_data = 0)
-        {
-            for (size_t i = 0; i < m_host->peerCount; ++i)
-            {
-                if (force) enet_peer_disconnect_now(&m_host->peers[i], disconnection_data);
-                else enet_peer_disconnect(&m_host->peers[i], disconnection_data);
-            }
-        }
-        
-        // returns a raw ENet peer pointer
-        ENetPeer* getPeerPtr(peer_id_t peer_id)
-        {
-            Peers::iterator it = m_peers.find(peer_id);
-            if (it != m_peers.end()) return it->second;
-            return NULL;
-        }
-
-        // get the address of the local host
-        Address getAddress() const {
-            std::lock_guard<std::mutex> lock(m_mutex);
-            return convert(m_address);
-        }
-        
-        // terminate the network thread, called on destruction
-        void terminate()
-        {
-            m_quit = true;
-            m_thread.join();
-        }
-    
-    private:
-        bool m_quit;
-        ENetAddress m_address;
-        ENetHost* m_host;
-        typedef std::map<peer_id_t, ENetPeer*> Peers;
-        Peers m_peers;
-        mutable std::mutex m_mutex;
-        std::jthread m_thread;
-        NetworkListener& m_listener;
-        void* m_data;
-    };
+﻿#pragma once
+
+#include <atomic>
+#include <initializer_list>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <span>
+#include <vector>
+#include <enet/enet.h>
+
+#include "address.h"
+#include "compressor.h"
+#include "peer_set.h"
+#include "util/crc32c.h"
+#include "util/crypto.h"
+
+namespace net
+{
+    /**
+     * RAII Wrapper for ENet
+     *
+     * Start with creating an instance of this to initialize networking.
+     * Important that it stays in scope for duration that it is needed. 
+     */
+    struct ENetContainer
+    {
+        ENetContainer() { enet_initialize(); }
+        ~ENetContainer() { enet_deinitialize(); }
+    };
+
+    // Convert ENetPeer to net::Address
+    inline Address convert(const ENetPeer* peer) { return peer ? Address(peer->address.host, peer->address.port) : Address(); }
+    // Convert ENetAddress to net::Address
+    inline Address convert(const ENetAddress& addr) { return Address(addr.host, addr.port); }
+
+    // Network traffic wrapper
+    struct NetworkTraffic
+    {
+        NetworkTraffic(const enet_uint8* pckt_d = NULL, size_t pckt_l = 0, enet_uint32 evdata = 0):
+                peer_id(0), peer_address(), peer_data(NULL), packet_data(pckt_d),
+                packet_length(pckt_l), ping(0), event_data(evdata) {}
+        
+        NetworkTraffic(ENetPeer* peer, void* data_ptr, const enet_uint8* pckt_d = NULL, size_t pckt_l = 0, enet_uint32 evdata = 0):
+                peer_id(peer->incomingPeerID), peer_address(convert(peer->address)), peer_data(data_ptr),
+                packet_data(pckt_d), packet_length(pckt_l), ping(peer->roundTripTime), event_data(evdata) {}
+        
+        peer_id_t peer_id; ///< Peer ID assigned by the library
+        Address peer_address; ///< Address from which peer connected
+        void* peer_data; ///< User data associated with the peer that sent the traffic
+        const enet_uint8* packet_data; ///< The actual data packet (empty for connect/disconnect events)
+        size_t packet_length; ///< Length of the packet data in bytes
+        unsigned ping; ///< Average round-trip time to the peer
+        enet_uint32 event_data; ///< Data associated with the event
+    };
+
+    // Convert incoming ENet data to net::NetworkTraffic
+    template <typename T>
+    NetworkTraffic convert(T& obj)
+    {
+        return NetworkTraffic(reinterpret_cast<enet_uint8*>(&obj), sizeof(T));
+    }
+
+    // Outgoing traffic counters
+    struct TrafficStats
+    {
+        uint64_t packets = 0;    ///< packets queued for sending (a broadcast counts once)
+        uint64_t fragmented = 0; ///< packets exceeding the MTU, i.e. split into fragments by ENet
+        uint64_t encrypted = 0;  ///< packets sealed for a peer w/ a session (a broadcast counts per peer)
+        uint64_t rejected = 0;   ///< received packets dropped for failing authentication
+    };
+
+    /**
+     * @brief Callback class prototype
+     *
+     * Inherit this class and implement functions to get network events. These events
+     *  are sent from another thread, but there will not be two simultaneous events.
+     */
+    class NetworkListener
+    {
+    public:
+        // Peer connected
+        // @param e the traffic associated with the event
+        virtual void connectionEvent(NetworkTraffic const& e) {}
+        // Peer disconnected
+        // @param e the traffic associated with the event
+        virtual void disconnectEvent(NetworkTraffic const& e) {}
+        // Peer sent some data
+        // @param e the traffic associated with the event
+        virtual void receiveEvent(NetworkTraffic const& e) {}
+        // Called once per iteration of the network loop (~1ms), after any event,
+        // e.g. to flush batched work
+        virtual void tickEvent() {}
+    };
+    
+    class ENetWrapper
+    {
+    public:
+        // non-copyable
+        ENetWrapper(const ENetWrapper&) = delete; // non-construction-copyable
+        ENetWrapper& operator=(const ENetWrapper&) = delete; // non-copyable
+        
+        ENetWrapper(NetworkListener& listener, bool hosting = true, int port = -1, void* data = NULL, int max_connections = 16):
+                m_quit(false), m_host(NULL), m_listener(listener), m_data(data)
+        {
+            m_address.host = ENET_HOST_ANY;
+            m_address.port = port < 0 ? ENET_PORT_ANY : port;
+            m_host = enet_host_create(hosting ? &m_address : NULL, max_connections, 1, 0, 0);
+            if (!m_host) throw std::runtime_error("An error occured while trying to create an ENet host.");
+            m_compressor.install(m_host);
+            m_sessions.resize(m_host->peerCount);
+            // Start listener thread
+            m_thread = std::jthread(&ENetWrapper::listen, std::ref(*this));
+        }
+        
+        ~ENetWrapper()
+        {
+            terminate();
+            std::lock_guard<std::mutex> lock(m_mutex);
+            if (m_host)
+            {
+                ENetEvent e;
+                enet_host_service(m_host, &e, 5);
+                for (size_t i = 0; i < m_host->peerCount; ++i)
+                {
+                    enet_peer_disconnect(&m_host->peers[i], 0);
+                }
+                enet_host_destroy(m_host);
+                m_host = nullptr;
+            }
+        }
+
+        // listener thread -- DO NOT CALL DIRECTLY
+        void listen()
+        {
+            ENetEvent e;
+            while (!m_quit)
+            {
+                {
+                    std::lock_guard<std::mutex> lock(m_mutex); // ensures no other thread can access
+                    enet_host_service(m_host, &e, 0); // nonblocking
+                }
+                switch (e.type)
+                {
+                    case ENET_EVENT_TYPE_NONE: {
+                            break;
+                    } case ENET_EVENT_TYPE_CONNECT: {
+                            endSession(e.peer->incomingPeerID);
+                            m_peers[e.peer->incomingPeerID] = e.peer;
+                            m_listener.connectionEvent(NetworkTraffic(e.peer, e.peer->data, NULL, 0, e.data));
+                            break;
+                    } case ENET_EVENT_TYPE_DISCONNECT: {
+                            m_listener.disconnectEvent(NetworkTraffic(e.peer, e.peer->data, NULL, 0, e.data));
+                            e.peer->data = NULL;
+                            m_peers.erase(e.peer->incomingPeerID);
+                            endSession(e.peer->incomingPeerID);
+                            break;
+                    } case ENET_EVENT_TYPE_RECEIVE: {
+                            enet_uint8* data = e.packet->data;
+                            size_t length = e.packet->dataLength;
+                            if (unseal(e.peer->incomingPeerID, data, length))
+                            {
+                                m_listener.receiveEvent(NetworkTraffic(e.peer, e.peer->data, data, length, e.data));
+                            }
+                            enet_packet_destroy(e.packet);
+                            break;
+                    }
+                }
+                m_listener.tickEvent();
+                std::this_thread::sleep_for(std::chrono::milliseconds(1)); // ensures events processed sequentially
+            }
+        }
+
+        /**
+         * Connect to a peer
+         * @param host the address to connect to
+         * @param port the port to connect to
+         * @param data application specific data that can be retrieved in events
+         */
+        void connect(const std::string& host, int port, void* data = NULL)
+        {
+            ENetAddress address;
+            enet_address_set_host(&address, host.c_str());
+            address.port = port;
+            // initiating connection
+            ENetPeer* peer = NULL;
+            std::lock_guard<std::mutex> lock(m_mutex);
+            peer = enet_host_connect(m_host, &address, 0, 0);
+            if (!peer) throw std::runtime_error("No available peers for initializing an ENet connection.");
+            peer->data = data;
+        }
+
+        /**
+         * Connect to a peer
+         * @param addr the address to connect to
+         * @param data application specific data that can be retrieved in events
+         */
+        void connect(const Address& addr, void* data = NULL)
+        {
+            ENetAddress address;
+            address.host = addr.host;
+            address.port = addr.port;
+            // initiating connection
+            ENetPeer* peer = NULL;
+            std::lock_guard<std::mutex> lock(m_mutex);
+            peer = enet_host_connect(m_host, &address, 0, 0);
+            if (!peer) throw std::runtime_error("No available peers for initializing an ENet connection.");
+            peer->data = data;
+        }
+
+        // Send a packet to all peers (reliable packets are resent until acknowledged)
+        void broadcast(const NetworkTraffic& msg, bool reliable = false)
+        {
+            ENetPacket* packet = enet_packet_create(msg.packet_data, msg.packet_length, packetFlags(reliable));
+            std::lock_guard<std::mutex> lock(m_mutex);
+            countPacket(packet->dataLength, maxPayload(minMTU(), m_session_count > 0));
+            broadcastLocked(packet);
+        }
+
+        // Send a string to all peers
+        void broadcast(const std::string& msg, bool reliable = false)
+        {
+            NetworkTraffic traffic(reinterpret_cast<const enet_uint8*>(msg.c_str()), msg.length());
+            broadcast(traffic, reliable);
+        }
+
+        // send a packet to a specific peer
+        void send(peer_id_t peer_id, const NetworkTraffic& msg, bool reliable = false)
+        {
+            ENetPeer* peer = getPeerPtr(peer_id);
+            if (!peer) return;
+            ENetPacket* packet = enet_packet_create(msg.packet_data, msg.packet_length, packetFlags(reliable));
+            std::lock_guard<std::mutex> lock(m_mutex);
+            countPacket(packet->dataLength, maxPayload(peer->mtu, hasSession(peer_id)));
+            sendLocked(peer, packet);
+        }
+
+        // send a string to a specific peer
+        void send(peer_id_t peer_id, const std::string& msg, bool reliable = false)
+        {
+            NetworkTraffic traffic(reinterpret_cast<const enet_uint8*>(msg.c_str()), msg.length());
+            send(peer_id, traffic, reliable);
+        }
+
+        // send several buffers to a specific peer, gathered into a single packet
+        // (buffers are read in place, e.g. a cached payload shared by many sends)
+        void send(peer_id_t peer_id, std::initializer_list<NetworkTraffic> parts, bool reliable = false)
+        {
+            ENetPeer* peer = getPeerPtr(peer_id);
+            if (!peer) return;
+            ENetPacket* packet = gather(parts, reliable);
+            std::lock_guard<std::mutex> lock(m_mutex);
+            countPacket(packet->dataLength, maxPayload(peer->mtu, hasSession(peer_id)));
+            sendLocked(peer, packet);
+        }
+
+        // send several buffers to all peers, gathered into a single packet
+        void broadcast(std::initializer_list<NetworkTraffic> parts, bool reliable = false)
+        {
+            ENetPacket* packet = gather(parts, reliable);
+            std::lock_guard<std::mutex> lock(m_mutex);
+            countPacket(packet->dataLength, maxPayload(minMTU(), m_session_count > 0));
+            broadcastLocked(packet);
+        }
+
+        // send a packet to several peers: one (refcounted) packet, copied once & queued on
+        // every listed peer under a single lock. Peers w/ a session get their own sealed copy
+        void sendToMany(std::span<const peer_id_t> peer_ids, const NetworkTraffic& msg, bool reliable = false)
+        {
+            if (peer_ids.empty()) return;
+            sendShared(msg, reliable, [&](auto&& queue) { for (peer_id_t peer_id : peer_ids) queue(peer_id); });
+        }
+
+        // send a string to several peers, sharing one packet
+        void sendToMany(std::span<const peer_id_t> peer_ids, const std::string& msg, bool reliable = false)
+        {
+            NetworkTraffic traffic(reinterpret_cast<const enet_uint8*>(msg.c_str()), msg.length());
+            sendToMany(peer_ids, traffic, reliable);
+        }
+
+        // send a packet to a precomputed set of peers, sharing one packet
+        void sendToMany(const PeerSet& peers, const NetworkTraffic& msg, bool reliable = false)
+        {
+            if (peers.empty()) return;
+            sendShared(msg, reliable, [&](auto&& queue) { peers.forEach(queue); });
+        }
+
+        // send a string to a precomputed set of peers, sharing one packet
+        void sendToMany(const PeerSet& peers, const std::string& msg, bool reliable = false)
+        {
+            NetworkTraffic traffic(reinterpret_cast<const enet_uint8*>(msg.c_str()), msg.length());
+            sendToMany(peers, traffic, reliable);
+        }
+
+        // largest payload sent to the given peer w/o ENet fragmenting it
+        size_t getMaxPayload(peer_id_t peer_id)
+        {
+            ENetPeer* peer = getPeerPtr(peer_id);
+            std::lock_guard<std::mutex> lock(m_mutex);
+            return maxPayload(peer ? peer->mtu : m_host->mtu, hasSession(peer_id));
+        }
+
+        // largest payload broadcast w/o ENet fragmenting it, i.e. for the smallest peer MTU
+        size_t getMaxBroadcastPayload()
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            return maxPayload(minMTU(), m_session_count > 0);
+        }
+
+        TrafficStats getStats() const
+        {
+            TrafficStats stats;
+            stats.packets = m_packets_sent;
+            stats.fragmented = m_packets_fragmented;
+            stats.encrypted = m_packets_encrypted;
+            stats.rejected = m_packets_rejected;
+            return stats;
+        }
+
+        // Encrypts all further traffic w/ a peer, in both directions: packets are sealed w/
+        // ChaCha20-Poly1305, & received ones that fail authentication (or replay an older
+        // counter) are dropped, see seal. The keys are agreed on by the application
+        void startSession(peer_id_t peer_id, const crypto::SessionKeys& keys)
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            if (peer_id >= m_sessions.size()) return;
+            if (!m_sessions[peer_id]) m_session_count++;
+            m_sessions[peer_id] = std::make_unique<Session>(keys);
+        }
+
+        // turns CRC32C datagram checksums on/off, datagrams failing the check are dropped
+        // (set before connecting: ENet checks every datagram, the handshake included, so this
+        // can't be negotiated & peers w/ different settings never connect)
+        void setChecksum(bool enabled)
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_host->checksum = enabled ? &ENetWrapper::checksum : NULL;
+        }
+
+        // ENet checksum callback, CRC32C of a datagram's buffers
+        static enet_uint32 ENET_CALLBACK checksum(const ENetBuffer* buffers, size_t buffer_count)
+        {
+            uint32_t crc = 0;
+            for (size_t i = 0; i < buffer_count; ++i) crc = crc32c::extend(crc, buffers[i].data, buffers[i].dataLength);
+            return crc;
+        }
+
+        // turns compression of outgoing datagrams on/off (incoming ones are always decompressed)
+        void setCompression(bool enabled) { m_compressor.setEnabled(enabled); }
+
+        CompressionStats getCompressionStats() const { return m_compressor.getStats(); }
+
+        // disconnects the given peer
+        void disconnect(peer_id_t peer_id, bool force = false, uint32_t disconnection_data = 0)
+        {
+            ENetPeer* peer = getPeerPtr(peer_id);
+            if (!peer) return;
+            if (force) enet_peer_disconnect_now(peer, disconnection_data);
+            else enet_peer_disconnect(peer, disconnection_data);
+        }
+
+        // disconnects all peers
+        void disconnectAll(bool force = false, uint32_t disconnection_data = 0)
+        {
+            for (size_t i = 0; i < m_host->peerCount; ++i)
+            {
+                if (force) enet_peer_disconnect_now(&m_host->peers[i], disconnection_data);
+                else enet_peer_disconnect(&m_host->peers[i], disconnection_data);
+            }
+        }
+        
+        // returns a raw ENet peer pointer
+        ENetPeer* getPeerPtr(peer_id_t peer_id)
+        {
+            Peers::iterator it = m_peers.find(peer_id);
+            if (it != m_peers.end()) return it->second;
+            return NULL;
+        }
+
+        // get the address of the local host
+        Address getAddress() const {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            return convert(m_address);
+        }
+        
+        // terminate the network thread, called on destruction
+        void terminate()
+        {
+            m_quit = true;
+            m_thread.join();
+        }
+    
+    private:
+        static enet_uint32 packetFlags(bool reliable)
+        {
+            return reliable ? ENET_PACKET_FLAG_RELIABLE : 0;
+        }
+
+        // smallest MTU of the connected peers, m_mutex must be held
+        enet_uint32 minMTU() const
+        {
+            enet_uint32 mtu = m_host->mtu;
+            for (size_t i = 0; i < m_host->peerCount; ++i)
+            {
+                const ENetPeer& peer = m_host->peers[i];
+                if (peer.state == ENET_PEER_STATE_CONNECTED && peer.mtu < mtu) mtu = peer.mtu;
+            }
+            return mtu;
+        }
+
+        // payload bytes that fit in one datagram, see fragment length in enet_peer_send
+        size_t maxPayload(enet_uint32 mtu, bool encrypted) const
+        {
+            size_t overhead = sizeof(ENetProtocolHeader) + sizeof(ENetProtocolSendFragment);
+            if (m_host->checksum) overhead += sizeof(enet_uint32);
+            if (encrypted) overhead += SEAL_OVERHEAD;
+            return mtu - overhead;
+        }
+
+        // Encrypted session w/ a peer, one key & nonce counter per direction
+        struct Session
+        {
+            Session(const crypto::SessionKeys& keys) : tx(keys.tx), rx(keys.rx) {}
+
+            crypto::Aead tx;
+            crypto::Aead rx;
+            uint64_t tx_nonce = 0; ///< nonce of the next packet sent
+            uint64_t rx_nonce = 0; ///< lowest nonce still accepted
+        };
+
+        // sealed packet: u64 nonce, ciphertext, tag
+        static constexpr size_t SEAL_OVERHEAD = sizeof(uint64_t) + crypto::TAG_SIZE;
+
+        // m_mutex must be held
+        bool hasSession(peer_id_t peer_id) const
+        {
+            return peer_id < m_sessions.size() && m_sessions[peer_id];
+        }
+
+        void endSession(peer_id_t peer_id)
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            if (!hasSession(peer_id)) return;
+            m_sessions[peer_id].reset();
+            m_session_count--;
+        }
+
+        // Encrypts a packet for a session, into a new packet w/ the same flags, m_mutex must be held
+        ENetPacket* seal(Session& session, const ENetPacket* packet)
+        {
+            const size_t length = packet->dataLength;
+            ENetPacket* sealed = enet_packet_create(NULL, length + SEAL_OVERHEAD, packet->flags);
+            const uint64_t nonce = session.tx_nonce++;
+            for (size_t i = 0; i < sizeof(nonce); ++i) sealed->data[i] = static_cast<enet_uint8>(nonce >> (8 * i));
+            enet_uint8* body = sealed->data + sizeof(nonce);
+            memcpy(body, packet->data, length);
+            session.tx.seal(nonce, NULL, 0, body, length, body + length);
+            m_packets_encrypted++;
+            return sealed;
+        }
+
+        // Authenticates & decrypts a received packet in place, if the peer has a session
+        // @return false if the packet must be dropped
+        bool unseal(peer_id_t peer_id, enet_uint8*& data, size_t& length)
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            if (!hasSession(peer_id)) return true; // plain
+            Session& session = *m_sessions[peer_id];
+            uint64_t nonce = 0;
+            if (length >= SEAL_OVERHEAD)
+            {
+                for (size_t i = 0; i < sizeof(nonce); ++i) nonce |= static_cast<uint64_t>(data[i]) << (8 * i);
+                enet_uint8* body = data + sizeof(nonce);
+                const size_t body_length = length - SEAL_OVERHEAD;
+                if (nonce >= session.rx_nonce && session.rx.open(nonce, NULL, 0, body, body_length, body + body_length))
+                {
+                    session.rx_nonce = nonce + 1;
+                    data = body;
+                    length = body_length;
+                    return true;
+                }
+            }
+            m_packets_rejected++;
+            return false;
+        }
+
+        // Sends a packet to a peer, sealed if it has a session, m_mutex must be held
+        void sendLocked(ENetPeer* peer, ENetPacket* packet)
+        {
+            if (hasSession(peer->incomingPeerID))
+            {
+                ENetPacket* sealed = seal(*m_sessions[peer->incomingPeerID], packet);
+                enet_packet_destroy(packet);
+                packet = sealed;
+            }
+            enet_peer_send(peer, 0, packet);
+        }
+
+        // Sends a packet to all peers, m_mutex must be held. The plain packet is shared by
+        // all peers w/o a session, the others each get it sealed w/ their own key
+        void broadcastLocked(ENetPacket* packet)
+        {
+            if (!m_session_count)
+            {
+                enet_host_broadcast(m_host, 0, packet);
+                return;
+            }
+            for (size_t i = 0; i < m_host->peerCount; ++i)
+            {
+                ENetPeer* peer = &m_host->peers[i];
+                if (peer->state == ENET_PEER_STATE_CONNECTED) queueShared(peer, packet);
+            }
+            if (packet->referenceCount == 0) enet_packet_destroy(packet);
+        }
+
+        // Creates one packet & queues it on the peers visited by forEachPeer(queue), w/
+        // m_mutex held throughout. Unknown & disconnected peers are skipped
+        template <typename F>
+        void sendShared(const NetworkTraffic& msg, bool reliable, F&& forEachPeer)
+        {
+            ENetPacket* packet = enet_packet_create(msg.packet_data, msg.packet_length, packetFlags(reliable));
+            std::lock_guard<std::mutex> lock(m_mutex);
+            countPacket(packet->dataLength, maxPayload(minMTU(), m_session_count > 0));
+            forEachPeer([this, packet](peer_id_t peer_id)
+            {
+                if (peer_id >= m_host->peerCount) return;
+                ENetPeer* peer = &m_host->peers[peer_id];
+                if (peer->state == ENET_PEER_STATE_CONNECTED) queueShared(peer, packet);
+            });
+            if (packet->referenceCount == 0) enet_packet_destroy(packet);
+        }
+
+        // Queues a packet shared w/ other peers, or a sealed copy if the peer has a session.
+        // m_mutex must be held, the caller destroys the packet if no peer took it
+        void queueShared(ENetPeer* peer, ENetPacket* packet)
+        {
+            if (hasSession(peer->incomingPeerID)) enet_peer_send(peer, 0, seal(*m_sessions[peer->incomingPeerID], packet));
+            else enet_peer_send(peer, 0, packet);
+        }
+
+        void countPacket(size_t length, size_t max_payload)
+        {
+            m_packets_sent++;
+            if (length > max_payload) m_packets_fragmented++;
+        }
+
+        // creates a packet from the concatenated buffers
+        static ENetPacket* gather(std::initializer_list<NetworkTraffic> parts, bool reliable)
+        {
+            size_t length = 0;
+            for (const NetworkTraffic& part : parts) length += part.packet_length;
+            ENetPacket* packet = enet_packet_create(NULL, length, packetFlags(reliable));
+            enet_uint8* out = packet->data;
+            for (const NetworkTraffic& part : parts)
+            {
+                memcpy(out, part.packet_data, part.packet_length);
+                out += part.packet_length;
+            }
+            return packet;
+        }
+
+        bool m_quit;
+        std::atomic<uint64_t> m_packets_sent{ 0 };       ///< see TrafficStats
+        std::atomic<uint64_t> m_packets_fragmented{ 0 }; ///< see TrafficStats
+        std::atomic<uint64_t> m_packets_encrypted{ 0 };  ///< see TrafficStats
+        std::atomic<uint64_t> m_packets_rejected{ 0 };   ///< see TrafficStats
+        std::vector<std::unique_ptr<Session>> m_sessions; ///< by peer ID, guarded by m_mutex
+        size_t m_session_count = 0;                       ///< peers w/ a session
+        AdaptiveCompressor m_compressor; ///< installed in m_host, which is destroyed first
+        ENetAddress m_address;
+        ENetHost* m_host;
+        typedef std::map<peer_id_t, ENetPeer*> Peers;
+        Peers m_peers;
+        mutable std::mutex m_mutex;
+        std::jthread m_thread;
+        NetworkListener& m_listener;
+        void* m_data;
+    };
 }
\ No newline at end of file
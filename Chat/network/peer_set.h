@@ -0,0 +1,76 @@
+﻿#pragma once
+
+#include <algorithm>
+#include <bit>
+#include <cstdint>
+#include <vector>
+
+namespace net
+{
+    typedef uint16_t peer_id_t; ///< ENet's incoming peer ID, an index into the host's peers
+
+    /**
+     * Set of peer IDs as a bitmap
+     *
+     * Peer IDs are small & dense, so a set of them fits in a few words: e.g. the
+     * recipients of a fan-out, computed once & reused while they don't change.
+     * Iterates in ascending order, skipping empty words.
+     */
+    class PeerSet
+    {
+    public:
+        PeerSet() = default;
+        explicit PeerSet(size_t peer_count) : m_words((peer_count + 63) / 64) {}
+
+        void insert(peer_id_t peer_id)
+        {
+            const size_t word = peer_id / 64;
+            if (word >= m_words.size()) m_words.resize(word + 1);
+            m_words[word] |= uint64_t(1) << (peer_id % 64);
+        }
+
+        void erase(peer_id_t peer_id)
+        {
+            const size_t word = peer_id / 64;
+            if (word < m_words.size()) m_words[word] &= ~(uint64_t(1) << (peer_id % 64));
+        }
+
+        bool contains(peer_id_t peer_id) const
+        {
+            const size_t word = peer_id / 64;
+            return word < m_words.size() && (m_words[word] >> (peer_id % 64)) & 1;
+        }
+
+        size_t size() const
+        {
+            size_t count = 0;
+            for (uint64_t word : m_words) count += std::popcount(word);
+            return count;
+        }
+
+        bool empty() const
+        {
+            for (uint64_t word : m_words) if (word) return false;
+            return true;
+        }
+
+        // Removes all peers, keeping the capacity
+        void clear() { std::fill(m_words.begin(), m_words.end(), 0); }
+
+        // Calls f(peer_id_t) for every peer in the set, in ascending order
+        template <typename F>
+        void forEach(F&& f) const
+        {
+            for (size_t i = 0; i < m_words.size(); ++i)
+            {
+                for (uint64_t word = m_words[i]; word; word &= word - 1) // clears the lowest bit
+                {
+                    f(static_cast<peer_id_t>(i * 64 + std::countr_zero(word)));
+                }
+            }
+        }
+
+    private:
+        std::vector<uint64_t> m_words; ///< bit i of word w is peer w * 64 + i
+    };
+}
@@ -1,158 +1,585 @@
-﻿#pragma once
-#include <utility>
-#include <vector>
-
-#include "util/byte_stream.h"
-
-namespace protocol
-{
-    const unsigned DEFAULT_PORT = 7777;
-
-    /**
-     * @brief Contains all possible message types
-     */
-    enum PacketType : int8_t
-    {
-        USERNAME = 0,       // First packet from client containing username [client -> server]
-        USERNAME_ACK = 1,   // Ack packet to client w/ current chat state, i.e. list of connected users [server -> client]
-        STATE_ADD_USER = 2, // Chat state delta, new user added to chat
-        STATE_REM_USER = 3, // Chat state delta, user removed from chat
-        MESSAGE = 4,        // Chat message
-    };
-    
-    struct Package
-    {
-        int8_t packet_type;
-    
-        Package(int8_t packet_type) : packet_type(packet_type) {}
-    
-        virtual void serialize(ByteStream& s) const
-        {
-            s.writeInt8(packet_type);
-        }
-    };
-
-    // [client -> server]
-    // Provides a client's username to the server
-    struct UsernamePackage : Package
-    {
-        std::string username;
-
-        UsernamePackage(std::string username)
-            : Package(USERNAME), username(std::move(username)) {}
-
-        UsernamePackage(ByteStream& s) : Package(s.readInt8())
-        {
-            username = s.readString();
-        }
-
-        void serialize(ByteStream& s) const override
-        {
-            Package::serialize(s);
-            s.writeString(username, username.length());
-        }
-    };
-
-    // [server -> client]
-    // Provides a client their assigned User ID and current session state
-    struct UsernameAckPackage : Package
-    {
-        user_id_t assigned_user_id;
-        std::vector<UserInfo> users;
-
-        UsernameAckPackage(user_id_t user_id, const UserMap& user_map)
-            : Package(USERNAME_ACK), assigned_user_id(user_id)
-        {
-            for (const auto& pair : user_map) users.push_back(pair.second);
-        }
-        
-        UsernameAckPackage(ByteStream& s)
-            : Package(s.readInt8())
-        {
-            assigned_user_id = s.readUInt16();
-            while (!s.end())
-            {
-                user_id_t id = s.readUInt16();
-                UserInfo user(id, s.readString());
-                users.push_back(user);
-            }
-        }
-
-        void serialize(ByteStream& s) const override
-        {
-            Package::serialize(s);
-            s.writeUInt16(assigned_user_id);
-            for (UserInfo user : users) user.serialize(s);
-        }
-    };
-
-    // [server -> client]
-    // Notifies clients to add a new user to their user list/map
-    struct AddUserPackage : Package
-    {
-        UserInfo user;
-
-        AddUserPackage(UserInfo user)
-            : Package(STATE_ADD_USER), user(std::move(user)) {}
-
-        AddUserPackage(ByteStream& s)
-            : Package(s.readInt8()), user()
-        {
-            user.user_id = s.readUInt16();
-            user.name = s.readString();
-        }
-
-        void serialize(ByteStream& s) const override
-        {
-            Package::serialize(s);
-            user.serialize(s); 
-        }
-    };
-
-    // [server -> client]
-    // Notifies clients to remove a new user to their user list/map
-    struct RemoveUserPackage : Package
-    {
-        user_id_t user_id;
-
-        RemoveUserPackage(user_id_t user_id)
-            : Package(STATE_REM_USER), user_id(user_id) {}
-        
-        RemoveUserPackage(ByteStream& s)
-            : Package(s.readInt8())
-        {
-            user_id = s.readUInt16();
-        }
-
-        void serialize(ByteStream& s) const override
-        {
-            Package::serialize(s);
-            s.writeUInt16(user_id);
-        }
-    };
-
-    // [client -> server, server -> client]
-    // A new message to be posted in the chat
-    struct MessagePackage : Package
-    {
-        user_id_t user_id;
-        std::string message;
-
-        MessagePackage(user_id_t user_id, const std::string& msg)
-            : Package(MESSAGE), user_id(user_id), message(msg) {}
-
-        MessagePackage(ByteStream& s)
-            : Package(s.readInt8())
-        {
-            user_id = s.readUInt16();
-            message = s.readString();
-        }
-
-        void serialize(ByteStream& s) const override
-        {
-            Package::serialize(s);
-            s.writeUInt16(user_id);
-            s.writeString(message, message.length());
-        }
-    };
-}
+﻿#pragma once
+#include <algorithm>
+#include <utility>
+#include <vector>
+
+#include "codec.h"
+#include "util/byte_stream.h"
+#include "util/crypto.h"
+
+namespace protocol
+{
+    const unsigned DEFAULT_PORT = 7777;
+
+    const uint16_t PROTOCOL_VERSION = 3;     ///< wire format version, bumped on incompatible changes
+    const uint16_t MIN_PROTOCOL_VERSION = 3; ///< oldest version the host still accepts (2 had session-wide user lists)
+
+    /**
+     * @brief Optional features, negotiated per peer in the USERNAME handshake
+     *
+     * A peer advertises what it supports, the host acks what both support. The host
+     * then picks each peer's encodings from those, so old & new clients can mix.
+     */
+    enum Capability : uint32_t
+    {
+        CAP_MESSAGE_BATCH = 1 << 0, // understands MESSAGE_BATCH
+        CAP_VARINT = 1 << 1,        // understands MESSAGE_BATCH_VARINT
+        CAP_COMPRESSION = 1 << 2,   // decompresses datagrams, see net::AdaptiveCompressor
+        CAP_DICTIONARY = 1 << 3,    // understands DICTIONARY & packed message text, see MessageDictionary
+        CAP_ROOMS = 1 << 4,         // understands ROOM_MEMBERS, may JOIN_ROOM
+        CAP_DIRECT_MESSAGES = 1 << 5, // understands DIRECT_MESSAGE
+    };
+
+    const uint32_t LOCAL_CAPABILITIES = CAP_MESSAGE_BATCH | CAP_VARINT | CAP_COMPRESSION | CAP_DICTIONARY | CAP_ROOMS | CAP_DIRECT_MESSAGES; ///< supported by this build
+
+    /**
+     * @brief Contains all possible message types
+     */
+    enum PacketType : int8_t
+    {
+        USERNAME = 0,       // First packet from client containing username [client -> server]
+        USERNAME_ACK = 1,   // Ack packet to client w/ assigned user ID & user list version [server -> client]
+        STATE_ADD_USER = 2, // Chat state delta, new user added to chat
+        STATE_REM_USER = 3, // Chat state delta, user removed from chat
+        MESSAGE = 4,        // Chat message
+        STATE_USER_DELTA = 5, // Chat state delta, batch of users removed & added
+        USER_LIST_PAGE = 6,   // Page of the user list snapshot, follows USERNAME_ACK or ROOM_MEMBERS [server -> client]
+        MESSAGE_BATCH = 7,    // Several chat messages in one packet [server -> client]
+        MESSAGE_BATCH_VARINT = 8, // MESSAGE_BATCH w/ varint encoded IDs & lengths [server -> client]
+        DICTIONARY = 9,           // Shared dictionary for message text [server -> client]
+        KEY_EXCHANGE = 10,        // Ephemeral public key, precedes USERNAME to encrypt the session
+        JOIN_ROOM = 11,           // Moves the sender to another room [client -> server]
+        ROOM_MEMBERS = 12,        // Room just joined, its user list follows [server -> client]
+        DIRECT_MESSAGE = 13,      // Private message to/from one user, routed by the host
+    };
+    
+    // Which end may send a package (SENDERS), packages from the other end are dropped
+    // before decoding, see the dispatch tables in ChatApp
+    enum Sender : uint8_t
+    {
+        FROM_CLIENT = 1 << 0,
+        FROM_HOST = 1 << 1,
+    };
+
+    // Common base of all packages. Not polymorphic: packages are always handled as
+    // their concrete type, see PackageList & the dispatch table in ChatApp.
+    // Packages declare their fields w/ PROTOCOL_FIELDS, the wire format follows from
+    // those, see codec.h
+    struct Package
+    {
+        int8_t packet_type;
+    
+        Package(int8_t packet_type) : packet_type(packet_type) {}
+    };
+
+    // [client -> server]
+    // Provides a client's username to the server, along w/ its protocol version & capabilities,
+    // and the last user list version it knows of (if reconnecting), so the server can reply w/
+    // only the changes since then
+    struct UsernamePackage : Package
+    {
+        static constexpr PacketType TYPE = USERNAME;
+        static constexpr uint8_t SENDERS = FROM_CLIENT;
+
+        uint16_t protocol_version; ///< sender's PROTOCOL_VERSION, always the first field
+        uint32_t capabilities;     ///< sender's supported Capability bits
+        std::string username;
+        uint32_t roster_epoch;  ///< user list the known version belongs to (the lobby's or a room's), 0 if none
+        uint32_t known_version; ///< last applied user list version
+
+        PROTOCOL_FIELDS(protocol_version, capabilities, username, roster_epoch, known_version)
+
+        UsernamePackage(std::string username, uint32_t roster_epoch = 0, uint32_t known_version = 0)
+            : Package(TYPE), protocol_version(PROTOCOL_VERSION), capabilities(LOCAL_CAPABILITIES),
+              username(std::move(username)), roster_epoch(roster_epoch), known_version(known_version) {}
+
+        UsernamePackage(ByteStream& s)
+            : Package(TYPE)
+        {
+            codec::decodePackage(s, *this);
+        }
+
+        void serialize(ByteStream& s) const
+        {
+            codec::encodePackage(s, *this);
+        }
+    };
+
+    // [server -> client]
+    // Provides a client their assigned User ID & how the user list (of the lobby, where
+    // clients start) follows: either as page_count USER_LIST_PAGE packets (snapshot), or
+    // as a single STATE_USER_DELTA from the client's known version (page_count is zero)
+    struct UsernameAckPackage : Package
+    {
+        static constexpr PacketType TYPE = USERNAME_ACK;
+        static constexpr uint8_t SENDERS = FROM_HOST;
+
+        uint16_t protocol_version; ///< host's PROTOCOL_VERSION, always the first field
+        uint32_t capabilities;     ///< Capability bits negotiated for this client
+        user_id_t assigned_user_id;
+        uint32_t roster_epoch;   ///< the lobby's user list, versions are only comparable within one
+        uint32_t roster_version; ///< user list version the client is brought up to
+        uint16_t page_count;     ///< number of USER_LIST_PAGE packets that follow
+
+        PROTOCOL_FIELDS(protocol_version, capabilities, assigned_user_id, roster_epoch, roster_version, page_count)
+
+        UsernameAckPackage(user_id_t user_id, uint32_t capabilities, uint32_t roster_epoch, uint32_t roster_version, uint16_t page_count)
+            : Package(TYPE), protocol_version(PROTOCOL_VERSION), capabilities(capabilities),
+              assigned_user_id(user_id), roster_epoch(roster_epoch),
+              roster_version(roster_version), page_count(page_count) {}
+        
+        UsernameAckPackage(ByteStream& s)
+            : Package(TYPE)
+        {
+            codec::decodePackage(s, *this);
+        }
+
+        void serialize(ByteStream& s) const
+        {
+            codec::encodePackage(s, *this);
+        }
+    };
+
+    // [server -> client]
+    // One page of the user list at roster_version, the first page replaces the client's list
+    struct UserListPagePackage : Package
+    {
+        static constexpr PacketType TYPE = USER_LIST_PAGE;
+        static constexpr uint8_t SENDERS = FROM_HOST;
+
+        uint32_t roster_version;
+        uint16_t page_index;
+        uint16_t page_count;
+        std::vector<UserInfo> users;
+
+        PROTOCOL_FIELDS(roster_version, page_index, page_count, users)
+
+        // Serialized size w/o the users: type, version, page index & count, user count
+        static constexpr size_t HEADER_SIZE = sizeof(int8_t) + sizeof(uint32_t) + 3 * sizeof(uint16_t);
+
+        UserListPagePackage(uint32_t roster_version, uint16_t page_index, uint16_t page_count)
+            : Package(TYPE), roster_version(roster_version), page_index(page_index), page_count(page_count) {}
+
+        UserListPagePackage(ByteStream& s)
+            : Package(TYPE)
+        {
+            codec::decodePackage(s, *this);
+        }
+
+        void serialize(ByteStream& s) const
+        {
+            codec::encodePackage(s, *this);
+        }
+
+        // Writes everything but the users (same layout as serialize), which may follow
+        // pre-serialized, see UserListCache
+        static void serializeHeader(ByteStream& s, uint32_t roster_version, uint16_t page_index, uint16_t page_count, uint16_t user_count)
+        {
+            s.writeInt8(USER_LIST_PAGE);
+            s.writeUInt32(roster_version);
+            s.writeUInt16(page_index);
+            s.writeUInt16(page_count);
+            s.writeUInt16(user_count);
+        }
+    };
+
+    // [server -> client]
+    // Notifies clients to add a new user to their user list/map
+    struct AddUserPackage : Package
+    {
+        static constexpr PacketType TYPE = STATE_ADD_USER;
+        static constexpr uint8_t SENDERS = FROM_HOST;
+
+        UserInfo user;
+
+        PROTOCOL_FIELDS(user)
+
+        AddUserPackage(UserInfo user)
+            : Package(TYPE), user(std::move(user)) {}
+
+        AddUserPackage(ByteStream& s)
+            : Package(TYPE), user()
+        {
+            codec::decodePackage(s, *this);
+        }
+
+        void serialize(ByteStream& s) const
+        {
+            codec::encodePackage(s, *this);
+        }
+    };
+
+    // [server -> client]
+    // Notifies clients to remove a new user to their user list/map
+    struct RemoveUserPackage : Package
+    {
+        static constexpr PacketType TYPE = STATE_REM_USER;
+        static constexpr uint8_t SENDERS = FROM_HOST;
+
+        user_id_t user_id;
+
+        PROTOCOL_FIELDS(user_id)
+
+        RemoveUserPackage(user_id_t user_id)
+            : Package(TYPE), user_id(user_id) {}
+        
+        RemoveUserPackage(ByteStream& s)
+            : Package(TYPE)
+        {
+            codec::decodePackage(s, *this);
+        }
+
+        void serialize(ByteStream& s) const
+        {
+            codec::encodePackage(s, *this);
+        }
+    };
+
+    // [client -> server, server -> client]
+    // A new message to be posted in the chat. Between peers w/ CAP_DICTIONARY, the
+    // text may be packed against the session's dictionary, see MessageDictionary
+    struct MessagePackage : Package
+    {
+        static constexpr PacketType TYPE = MESSAGE;
+        static constexpr uint8_t SENDERS = FROM_CLIENT | FROM_HOST;
+
+        user_id_t user_id;
+        std::string message;
+
+        PROTOCOL_FIELDS(user_id, message)
+
+        // Serialized size w/o the message text: type, user ID & text length
+        static constexpr size_t HEADER_SIZE = sizeof(int8_t) + sizeof(user_id_t) + sizeof(uint64_t);
+
+        MessagePackage(user_id_t user_id = 0, const std::string& msg = std::string())
+            : Package(TYPE), user_id(user_id), message(msg) {}
+
+        MessagePackage(ByteStream& s)
+            : Package(TYPE)
+        {
+            codec::decodePackage(s, *this);
+        }
+
+        void serialize(ByteStream& s) const
+        {
+            codec::encodePackage(s, *this);
+        }
+
+        // Splits a message text into chunks of at most max_bytes, which can be sent (and
+        // shown) independently. Cuts on UTF-8 character boundaries where possible
+        static std::vector<std::string> split(const std::string& message, size_t max_bytes)
+        {
+            max_bytes = std::max<size_t>(max_bytes, 4); // fits any UTF-8 character
+            std::vector<std::string> chunks;
+            size_t begin = 0;
+            while (message.length() - begin > max_bytes)
+            {
+                size_t end = begin + max_bytes;
+                while (end > begin && (static_cast<unsigned char>(message[end]) & 0xC0) == 0x80) end--; // continuation byte
+                if (end == begin) end = begin + max_bytes; // not UTF-8
+                chunks.push_back(message.substr(begin, end - begin));
+                begin = end;
+            }
+            chunks.push_back(message.substr(begin));
+            return chunks;
+        }
+    };
+
+    // [server -> client]
+    // Several chat messages, in the order they were posted
+    struct MessageBatchPackage : Package
+    {
+        static constexpr PacketType TYPE = MESSAGE_BATCH;
+        static constexpr uint8_t SENDERS = FROM_HOST;
+
+        std::vector<MessagePackage> messages; ///< encoded w/o their packet type
+
+        PROTOCOL_FIELDS(messages)
+
+        static constexpr size_t HEADER_SIZE = sizeof(int8_t) + sizeof(uint16_t);          ///< type & count
+        static constexpr size_t ENTRY_HEADER_SIZE = sizeof(user_id_t) + sizeof(uint64_t); ///< user ID & text length
+
+        MessageBatchPackage()
+            : Package(TYPE) {}
+
+        MessageBatchPackage(ByteStream& s)
+            : Package(TYPE)
+        {
+            codec::decodePackage(s, *this);
+        }
+
+        void serialize(ByteStream& s) const
+        {
+            codec::encodePackage(s, *this);
+        }
+
+        static size_t entrySize(const MessagePackage& pkg)
+        {
+            return codec::serializedSize(pkg);
+        }
+    };
+
+    // [server -> client]
+    // MESSAGE_BATCH in a denser encoding, for clients w/ CAP_VARINT: count, user IDs &
+    // text lengths are varints, which saves ~8 bytes per message
+    struct MessageBatchVarintPackage : Package
+    {
+        static constexpr PacketType TYPE = MESSAGE_BATCH_VARINT;
+        static constexpr uint8_t SENDERS = FROM_HOST;
+
+        std::vector<MessagePackage> messages;
+
+        MessageBatchVarintPackage()
+            : Package(TYPE) {}
+
+        MessageBatchVarintPackage(ByteStream& s)
+            : Package(s.readInt8())
+        {
+            // each message takes at least 2 bytes, a larger count can't be genuine
+            const uint64_t count = codec::decodeVarint(s);
+            if (count > s.remaining() / 2) throw std::out_of_range("Message count exceeds the packet");
+            messages.resize(static_cast<size_t>(count));
+            for (MessagePackage& pkg : messages)
+            {
+                pkg.user_id = static_cast<user_id_t>(codec::decodeVarint(s));
+                const size_t length = codec::decodeVarint(s);
+                pkg.message.assign(s.readBytes(length), length);
+            }
+        }
+
+        void serialize(ByteStream& s) const
+        {
+            s.writeInt8(TYPE);
+            codec::encodeVarint(s, messages.size());
+            for (const MessagePackage& pkg : messages)
+            {
+                codec::encodeVarint(s, pkg.user_id);
+                codec::encodeVarint(s, pkg.message.length());
+                s.writeBytes(pkg.message.data(), pkg.message.length());
+            }
+        }
+    };
+
+    // [server -> client]
+    // Notifies the members of a room of a batch of users leaving & joining it (connecting,
+    // disconnecting or moving), removals apply first. Only applies on top of from_version,
+    // clients at any other version ignore it
+    struct UserDeltaPackage : Package
+    {
+        static constexpr PacketType TYPE = STATE_USER_DELTA;
+        static constexpr uint8_t SENDERS = FROM_HOST;
+
+        uint32_t from_version;
+        uint32_t to_version;
+        std::vector<user_id_t> removed;
+        std::vector<UserInfo> added;
+
+        PROTOCOL_FIELDS(from_version, to_version, removed, added)
+
+        UserDeltaPackage(uint32_t from_version = 0, uint32_t to_version = 0)
+            : Package(TYPE), from_version(from_version), to_version(to_version) {}
+
+        UserDeltaPackage(ByteStream& s)
+            : Package(TYPE)
+        {
+            codec::decodePackage(s, *this);
+        }
+
+        void serialize(ByteStream& s) const
+        {
+            codec::encodePackage(s, *this);
+        }
+    };
+
+    // [server -> client]
+    // Replaces the dictionary message text is packed against, for clients w/ CAP_DICTIONARY.
+    // Sent reliably, so it arrives before any message packed against it
+    struct DictionaryPackage : Package
+    {
+        static constexpr PacketType TYPE = DICTIONARY;
+        static constexpr uint8_t SENDERS = FROM_HOST;
+
+        uint8_t version;
+        std::string entries; ///< NUL-separated
+
+        PROTOCOL_FIELDS(version, entries)
+
+        DictionaryPackage(uint8_t version = 0, const std::string& entries = std::string())
+            : Package(TYPE), version(version), entries(entries) {}
+
+        DictionaryPackage(ByteStream& s)
+            : Package(TYPE)
+        {
+            codec::decodePackage(s, *this);
+        }
+
+        void serialize(ByteStream& s) const
+        {
+            codec::encodePackage(s, *this);
+        }
+    };
+
+    // [client -> server, server -> client]
+    // Starts an encrypted session: the client sends its ephemeral X25519 public key right
+    // before USERNAME, a host willing to encrypt replies w/ its own (sent in clear text).
+    // Both ends encrypt everything after the USERNAME_ACK (itself in clear text), so a
+    // client the host rejects never starts encrypting, see ENetWrapper::startSession.
+    // Hosts that don't reply leave the session unencrypted
+    struct KeyExchangePackage : Package
+    {
+        static constexpr PacketType TYPE = KEY_EXCHANGE;
+        static constexpr uint8_t SENDERS = FROM_CLIENT | FROM_HOST;
+
+        std::string public_key;
+
+        PROTOCOL_FIELDS(public_key)
+
+        KeyExchangePackage(const crypto::Key& key)
+            : Package(TYPE), public_key(reinterpret_cast<const char*>(key.data()), key.size()) {}
+
+        KeyExchangePackage(ByteStream& s)
+            : Package(TYPE)
+        {
+            codec::decodePackage(s, *this);
+        }
+
+        void serialize(ByteStream& s) const
+        {
+            codec::encodePackage(s, *this);
+        }
+
+        // @return false if the key has the wrong size
+        bool getKey(crypto::Key& key) const
+        {
+            if (public_key.length() != key.size()) return false;
+            memcpy(key.data(), public_key.data(), key.size());
+            return true;
+        }
+    };
+
+    // [client -> server]
+    // Moves the sender to a room, created on its first join. Messages are only delivered
+    // to the members of the sender's room; users start in the lobby (empty name)
+    struct JoinRoomPackage : Package
+    {
+        static constexpr PacketType TYPE = JOIN_ROOM;
+        static constexpr uint8_t SENDERS = FROM_CLIENT;
+
+        std::string room;
+
+        PROTOCOL_FIELDS(room)
+
+        JoinRoomPackage(const std::string& room = std::string())
+            : Package(TYPE), room(room) {}
+
+        JoinRoomPackage(ByteStream& s)
+            : Package(TYPE)
+        {
+            codec::decodePackage(s, *this);
+        }
+
+        void serialize(ByteStream& s) const
+        {
+            codec::encodePackage(s, *this);
+        }
+    };
+
+    // [server -> client]
+    // Reply to JOIN_ROOM, for clients w/ CAP_ROOMS. A client's user list is the members of
+    // its room: page_count USER_LIST_PAGE packets follow w/ the new room's members, then
+    // STATE_USER_DELTA updates from roster_version on, like after a USERNAME_ACK
+    struct RoomMembersPackage : Package
+    {
+        static constexpr PacketType TYPE = ROOM_MEMBERS;
+        static constexpr uint8_t SENDERS = FROM_HOST;
+
+        std::string room;
+        uint32_t member_count;
+        uint32_t roster_epoch;   ///< the room's user list, versions are only comparable within one
+        uint32_t roster_version; ///< user list version the pages are at
+        uint16_t page_count;     ///< number of USER_LIST_PAGE packets that follow
+
+        PROTOCOL_FIELDS(room, member_count, roster_epoch, roster_version, page_count)
+
+        RoomMembersPackage(const std::string& room = std::string(), uint32_t member_count = 0, uint32_t roster_epoch = 0,
+            uint32_t roster_version = 0, uint16_t page_count = 0)
+            : Package(TYPE), room(room), member_count(member_count), roster_epoch(roster_epoch),
+              roster_version(roster_version), page_count(page_count) {}
+
+        RoomMembersPackage(ByteStream& s)
+            : Package(TYPE)
+        {
+            codec::decodePackage(s, *this);
+        }
+
+        void serialize(ByteStream& s) const
+        {
+            codec::encodePackage(s, *this);
+        }
+    };
+
+    // Private message, for peers w/ CAP_DIRECT_MESSAGES. Client -> server: the recipient's
+    // name & the text. Server -> client: the sender's name & the text (DELIVERED), or
+    // the fate of a message the client sent (QUEUED, DROPPED) w/ the recipient's name.
+    // Names rather than IDs, since the sender may be gone when a queued message arrives
+    struct DirectMessagePackage : Package
+    {
+        static constexpr PacketType TYPE = DIRECT_MESSAGE;
+        static constexpr uint8_t SENDERS = FROM_CLIENT | FROM_HOST;
+
+        enum Status : uint8_t
+        {
+            DELIVERED = 0, // a message for the recipient
+            QUEUED = 1,    // the recipient is offline, the message is held until it connects
+            DROPPED = 2    // the recipient is offline & its queue is full
+        };
+
+        std::string peer; ///< recipient (client -> server) or sender (server -> client)
+        std::string message;
+        uint8_t status;   ///< see Status
+
+        PROTOCOL_FIELDS(peer, message, status)
+
+        // Serialized size w/o the name & the text: type, name length, text length & status
+        static constexpr size_t HEADER_SIZE = sizeof(int8_t) + 2 * sizeof(uint64_t) + sizeof(uint8_t);
+        static constexpr size_t MAX_PEER_LENGTH = 64; ///< longest recipient name, leaves the text room in a datagram
+
+        DirectMessagePackage(const std::string& peer = std::string(), const std::string& msg = std::string(), Status status = DELIVERED)
+            : Package(TYPE), peer(peer), message(msg), status(status) {}
+
+        DirectMessagePackage(ByteStream& s)
+            : Package(TYPE)
+        {
+            codec::decodePackage(s, *this);
+        }
+
+        void serialize(ByteStream& s) const
+        {
+            codec::encodePackage(s, *this);
+        }
+    };
+
+    // Compile-time registry of all packages, each identified by its TYPE
+    template <typename... Packages>
+    struct PackageList {};
+
+    typedef PackageList<
+        UsernamePackage,
+        UsernameAckPackage,
+        AddUserPackage,
+        RemoveUserPackage,
+        MessagePackage,
+        UserDeltaPackage,
+        UserListPagePackage,
+        MessageBatchPackage,
+        MessageBatchVarintPackage,
+        DictionaryPackage,
+        KeyExchangePackage,
+        JoinRoomPackage,
+        RoomMembersPackage,
+        DirectMessagePackage
+    > Packages;
+
+    // PacketType values are dense, starting at zero
+    constexpr size_t PACKET_TYPE_COUNT = DIRECT_MESSAGE + 1;
+}
\ No newline at end of file
@@ -0,0 +1,108 @@
+﻿#include "crc32c.h"
+
+#include <array>
+#include <cstring>
+
+#if defined(_M_X64) || defined(__x86_64__)
+#define CRC32C_X64
+#include <nmmintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#define CRC32C_TARGET
+#else
+#include <cpuid.h>
+#define CRC32C_TARGET __attribute__((target("sse4.2")))
+#endif
+#endif
+
+namespace
+{
+    const uint32_t POLYNOMIAL = 0x82F63B78; // reversed Castagnoli polynomial
+
+    typedef std::array<std::array<uint32_t, 256>, 8> Tables;
+
+    // TABLES[0] is the classic byte table, TABLES[k][b] the CRC of b followed by k zero bytes
+    constexpr Tables makeTables()
+    {
+        Tables tables{};
+        for (uint32_t b = 0; b < 256; ++b)
+        {
+            uint32_t crc = b;
+            for (int bit = 0; bit < 8; ++bit) crc = (crc >> 1) ^ (POLYNOMIAL & (0 - (crc & 1)));
+            tables[0][b] = crc;
+        }
+        for (uint32_t b = 0; b < 256; ++b)
+        {
+            for (size_t k = 1; k < 8; ++k) tables[k][b] = (tables[k - 1][b] >> 8) ^ tables[0][tables[k - 1][b] & 0xFF];
+        }
+        return tables;
+    }
+
+    constexpr Tables TABLES = makeTables();
+
+    // slicing-by-8: 8 bytes per iteration, one lookup per byte in independent tables
+    uint32_t extendSoftware(uint32_t crc, const uint8_t* p, size_t length)
+    {
+        for (; length >= 8; p += 8, length -= 8)
+        {
+            uint32_t low, high;
+            memcpy(&low, p, 4);
+            memcpy(&high, p + 4, 4);
+            low ^= crc; // little-endian
+            crc = TABLES[7][low & 0xFF] ^ TABLES[6][(low >> 8) & 0xFF] ^ TABLES[5][(low >> 16) & 0xFF] ^ TABLES[4][low >> 24]
+                ^ TABLES[3][high & 0xFF] ^ TABLES[2][(high >> 8) & 0xFF] ^ TABLES[1][(high >> 16) & 0xFF] ^ TABLES[0][high >> 24];
+        }
+        for (; length; ++p, --length) crc = (crc >> 8) ^ TABLES[0][(crc ^ *p) & 0xFF];
+        return crc;
+    }
+
+#ifdef CRC32C_X64
+    CRC32C_TARGET uint32_t extendHardware(uint32_t crc, const uint8_t* p, size_t length)
+    {
+        uint64_t crc64 = crc;
+        for (; length >= 8; p += 8, length -= 8)
+        {
+            uint64_t value;
+            memcpy(&value, p, 8);
+            crc64 = _mm_crc32_u64(crc64, value);
+        }
+        crc = static_cast<uint32_t>(crc64);
+        for (; length; ++p, --length) crc = _mm_crc32_u8(crc, *p);
+        return crc;
+    }
+
+    bool hasSSE42()
+    {
+#ifdef _MSC_VER
+        int info[4];
+        __cpuid(info, 1);
+        return (info[2] & (1 << 20)) != 0;
+#else
+        unsigned eax, ebx, ecx, edx;
+        return __get_cpuid(1, &eax, &ebx, &ecx, &edx) && (ecx & bit_SSE4_2);
+#endif
+    }
+#endif
+
+    typedef uint32_t (*Implementation)(uint32_t crc, const uint8_t* p, size_t length);
+
+    Implementation pickImplementation()
+    {
+#ifdef CRC32C_X64
+        if (hasSSE42()) return &extendHardware;
+#endif
+        return &extendSoftware;
+    }
+
+    const Implementation IMPLEMENTATION = pickImplementation();
+}
+
+uint32_t crc32c::extend(uint32_t crc, const void* data, size_t length)
+{
+    return ~IMPLEMENTATION(~crc, static_cast<const uint8_t*>(data), length);
+}
+
+bool crc32c::isHardwareAccelerated()
+{
+    return IMPLEMENTATION != &extendSoftware;
+}
@@ -0,0 +1,22 @@
+﻿#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+/**
+ * CRC32C (Castagnoli), e.g. for datagram checksums
+ *
+ * Uses the SSE4.2 crc32 instruction where the CPU has it (detected once, at
+ * runtime), & a slicing-by-8 table implementation otherwise.
+ */
+namespace crc32c
+{
+    // Extends the CRC of some data w/ the data that follows it
+    // @param crc CRC of the preceding data, 0 for none
+    uint32_t extend(uint32_t crc, const void* data, size_t length);
+
+    inline uint32_t compute(const void* data, size_t length) { return extend(0, data, length); }
+
+    // true if the SSE4.2 implementation is used
+    bool isHardwareAccelerated();
+}
@@ -0,0 +1,442 @@
+﻿#include "crypto.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+
+#ifdef _WIN32
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#include <bcrypt.h>
+#else
+#include <sys/random.h>
+#endif
+
+namespace
+{
+    uint32_t load32(const uint8_t* p)
+    {
+        return p[0] | static_cast<uint32_t>(p[1]) << 8 | static_cast<uint32_t>(p[2]) << 16 | static_cast<uint32_t>(p[3]) << 24;
+    }
+
+    void store32(uint8_t* p, uint32_t value)
+    {
+        for (int i = 0; i < 4; ++i) p[i] = static_cast<uint8_t>(value >> (8 * i));
+    }
+
+    void store64(uint8_t* p, uint64_t value)
+    {
+        for (int i = 0; i < 8; ++i) p[i] = static_cast<uint8_t>(value >> (8 * i));
+    }
+
+    // Fills a buffer from the OS's CSPRNG, throws if it's unavailable
+    void randomBytes(uint8_t* out, size_t length)
+    {
+#ifdef _WIN32
+        if (!BCRYPT_SUCCESS(BCryptGenRandom(NULL, out, static_cast<ULONG>(length), BCRYPT_USE_SYSTEM_PREFERRED_RNG)))
+        {
+            throw std::runtime_error("BCryptGenRandom failed");
+        }
+#else
+        while (length > 0)
+        {
+            const ssize_t got = getrandom(out, length, 0);
+            if (got < 0)
+            {
+                if (errno == EINTR) continue;
+                throw std::runtime_error("getrandom failed");
+            }
+            out += got;
+            length -= static_cast<size_t>(got);
+        }
+#endif
+    }
+
+    // ChaCha20 (RFC 8439)
+
+    typedef std::array<uint32_t, 16> ChaChaState;
+
+    uint32_t rotl(uint32_t x, int n) { return (x << n) | (x >> (32 - n)); }
+
+    void quarterRound(ChaChaState& x, int a, int b, int c, int d)
+    {
+        x[a] += x[b]; x[d] = rotl(x[d] ^ x[a], 16);
+        x[c] += x[d]; x[b] = rotl(x[b] ^ x[c], 12);
+        x[a] += x[b]; x[d] = rotl(x[d] ^ x[a], 8);
+        x[c] += x[d]; x[b] = rotl(x[b] ^ x[c], 7);
+    }
+
+    void doubleRounds(ChaChaState& x)
+    {
+        for (int i = 0; i < 10; ++i)
+        {
+            quarterRound(x, 0, 4, 8, 12);
+            quarterRound(x, 1, 5, 9, 13);
+            quarterRound(x, 2, 6, 10, 14);
+            quarterRound(x, 3, 7, 11, 15);
+            quarterRound(x, 0, 5, 10, 15);
+            quarterRound(x, 1, 6, 11, 12);
+            quarterRound(x, 2, 7, 8, 13);
+            quarterRound(x, 3, 4, 9, 14);
+        }
+    }
+
+    // state for key & a 16-byte input: block counter + nonce, or the HChaCha20 nonce
+    ChaChaState initState(const crypto::Key& key, const uint8_t* input)
+    {
+        ChaChaState state = { 0x61707865, 0x3320646e, 0x79622d32, 0x6b206574 }; // "expand 32-byte k"
+        for (int i = 0; i < 8; ++i) state[4 + i] = load32(key.data() + 4 * i);
+        for (int i = 0; i < 4; ++i) state[12 + i] = load32(input + 4 * i);
+        return state;
+    }
+
+    void chachaBlock(const ChaChaState& state, uint8_t* out)
+    {
+        ChaChaState x = state;
+        doubleRounds(x);
+        for (int i = 0; i < 16; ++i) store32(out + 4 * i, x[i] + state[i]);
+    }
+
+    // XORs data w/ the key stream starting at block `counter`
+    void chachaXor(const crypto::Key& key, uint32_t counter, const uint8_t* nonce, uint8_t* data, size_t length)
+    {
+        uint8_t input[16];
+        store32(input, counter);
+        memcpy(input + 4, nonce, 12);
+        ChaChaState state = initState(key, input);
+        uint8_t block[64];
+        for (size_t offset = 0; offset < length; offset += 64)
+        {
+            chachaBlock(state, block);
+            state[12]++;
+            const size_t n = std::min<size_t>(64, length - offset);
+            for (size_t i = 0; i < n; ++i) data[offset + i] ^= block[i];
+        }
+    }
+
+    // HChaCha20, derives a key from a key & a 16-byte nonce
+    crypto::Key hchacha(const crypto::Key& key, const uint8_t* nonce)
+    {
+        ChaChaState x = initState(key, nonce);
+        doubleRounds(x);
+        crypto::Key out;
+        for (int i = 0; i < 4; ++i)
+        {
+            store32(out.data() + 4 * i, x[i]);
+            store32(out.data() + 16 + 4 * i, x[12 + i]);
+        }
+        return out;
+    }
+
+    // Poly1305 (RFC 8439), 26-bit limbs
+
+    class Poly1305
+    {
+    public:
+        Poly1305(const uint8_t* key)
+        {
+            m_r[0] = load32(key) & 0x3ffffff;
+            m_r[1] = (load32(key + 3) >> 2) & 0x3ffff03;
+            m_r[2] = (load32(key + 6) >> 4) & 0x3ffc0ff;
+            m_r[3] = (load32(key + 9) >> 6) & 0x3f03fff;
+            m_r[4] = (load32(key + 12) >> 8) & 0x00fffff;
+            for (int i = 0; i < 4; ++i) m_pad[i] = load32(key + 16 + 4 * i);
+        }
+
+        // Hashes data, zero-padded to a multiple of 16 bytes
+        void updatePadded(const uint8_t* data, size_t length)
+        {
+            for (; length >= 16; data += 16, length -= 16) block(data);
+            if (length)
+            {
+                uint8_t last[16] = {};
+                memcpy(last, data, length);
+                block(last);
+            }
+        }
+
+        void finish(uint8_t* tag)
+        {
+            uint32_t h0 = m_h[0], h1 = m_h[1], h2 = m_h[2], h3 = m_h[3], h4 = m_h[4];
+            uint32_t c = h1 >> 26; h1 &= 0x3ffffff;
+            h2 += c; c = h2 >> 26; h2 &= 0x3ffffff;
+            h3 += c; c = h3 >> 26; h3 &= 0x3ffffff;
+            h4 += c; c = h4 >> 26; h4 &= 0x3ffffff;
+            h0 += c * 5; c = h0 >> 26; h0 &= 0x3ffffff;
+            h1 += c;
+
+            // h - p, selected if h >= p
+            uint32_t g0 = h0 + 5; c = g0 >> 26; g0 &= 0x3ffffff;
+            uint32_t g1 = h1 + c; c = g1 >> 26; g1 &= 0x3ffffff;
+            uint32_t g2 = h2 + c; c = g2 >> 26; g2 &= 0x3ffffff;
+            uint32_t g3 = h3 + c; c = g3 >> 26; g3 &= 0x3ffffff;
+            uint32_t g4 = h4 + c - (1u << 26);
+            uint32_t mask = (g4 >> 31) - 1;
+            h0 = (h0 & ~mask) | (g0 & mask);
+            h1 = (h1 & ~mask) | (g1 & mask);
+            h2 = (h2 & ~mask) | (g2 & mask);
+            h3 = (h3 & ~mask) | (g3 & mask);
+            h4 = (h4 & ~mask) | (g4 & mask);
+
+            // h + pad, mod 2^128
+            const uint32_t words[4] = { h0 | h1 << 26, h1 >> 6 | h2 << 20, h2 >> 12 | h3 << 14, h3 >> 18 | h4 << 8 };
+            uint64_t f = 0;
+            for (int i = 0; i < 4; ++i)
+            {
+                f = static_cast<uint64_t>(words[i]) + m_pad[i] + (f >> 32);
+                store32(tag + 4 * i, static_cast<uint32_t>(f));
+            }
+        }
+
+    private:
+        void block(const uint8_t* m)
+        {
+            const uint32_t r0 = m_r[0], r1 = m_r[1], r2 = m_r[2], r3 = m_r[3], r4 = m_r[4];
+            const uint32_t s1 = r1 * 5, s2 = r2 * 5, s3 = r3 * 5, s4 = r4 * 5;
+            uint32_t h0 = m_h[0] + (load32(m) & 0x3ffffff);
+            uint32_t h1 = m_h[1] + ((load32(m + 3) >> 2) & 0x3ffffff);
+            uint32_t h2 = m_h[2] + ((load32(m + 6) >> 4) & 0x3ffffff);
+            uint32_t h3 = m_h[3] + ((load32(m + 9) >> 6) & 0x3ffffff);
+            uint32_t h4 = m_h[4] + ((load32(m + 12) >> 8) | (1u << 24));
+
+            typedef uint64_t u64;
+            u64 d0 = (u64)h0 * r0 + (u64)h1 * s4 + (u64)h2 * s3 + (u64)h3 * s2 + (u64)h4 * s1;
+            u64 d1 = (u64)h0 * r1 + (u64)h1 * r0 + (u64)h2 * s4 + (u64)h3 * s3 + (u64)h4 * s2;
+            u64 d2 = (u64)h0 * r2 + (u64)h1 * r1 + (u64)h2 * r0 + (u64)h3 * s4 + (u64)h4 * s3;
+            u64 d3 = (u64)h0 * r3 + (u64)h1 * r2 + (u64)h2 * r1 + (u64)h3 * r0 + (u64)h4 * s4;
+            u64 d4 = (u64)h0 * r4 + (u64)h1 * r3 + (u64)h2 * r2 + (u64)h3 * r1 + (u64)h4 * r0;
+
+            uint32_t c = static_cast<uint32_t>(d0 >> 26); h0 = d0 & 0x3ffffff;
+            d1 += c; c = static_cast<uint32_t>(d1 >> 26); h1 = d1 & 0x3ffffff;
+            d2 += c; c = static_cast<uint32_t>(d2 >> 26); h2 = d2 & 0x3ffffff;
+            d3 += c; c = static_cast<uint32_t>(d3 >> 26); h3 = d3 & 0x3ffffff;
+            d4 += c; c = static_cast<uint32_t>(d4 >> 26); h4 = d4 & 0x3ffffff;
+            h0 += c * 5; c = h0 >> 26; h0 &= 0x3ffffff;
+            h1 += c;
+
+            m_h[0] = h0; m_h[1] = h1; m_h[2] = h2; m_h[3] = h3; m_h[4] = h4;
+        }
+
+        uint32_t m_r[5];
+        uint32_t m_h[5] = {};
+        uint32_t m_pad[4];
+    };
+
+    void aeadTag(const crypto::Key& key, const uint8_t* nonce, const uint8_t* ad, size_t ad_length,
+        const uint8_t* ciphertext, size_t length, uint8_t* tag)
+    {
+        uint8_t poly_key[64] = {};
+        chachaXor(key, 0, nonce, poly_key, sizeof(poly_key)); // one-time key from block 0
+        Poly1305 poly(poly_key);
+        poly.updatePadded(ad, ad_length);
+        poly.updatePadded(ciphertext, length);
+        uint8_t lengths[16];
+        store64(lengths, ad_length);
+        store64(lengths + 8, length);
+        poly.updatePadded(lengths, sizeof(lengths));
+        poly.finish(tag);
+    }
+
+    // 96-bit nonce: the 32-bit constant, then the 64-bit counter (RFC 8439 section 2.8)
+    void makeNonce(uint32_t constant, uint64_t counter, uint8_t* nonce)
+    {
+        store32(nonce, constant);
+        store64(nonce + 4, counter);
+    }
+
+    // X25519 (RFC 7748), field elements as 16 signed 16-bit limbs (after TweetNaCl)
+
+    typedef int64_t Field[16];
+
+    void carry(Field o)
+    {
+        for (int i = 0; i < 16; ++i)
+        {
+            o[i] += 1LL << 16;
+            const int64_t c = o[i] >> 16;
+            if (i < 15) o[i + 1] += c - 1;
+            else o[0] += 38 * (c - 1);
+            o[i] -= c * (1LL << 16);
+        }
+    }
+
+    // swaps p & q if b is 1, in constant time
+    void select(Field p, Field q, int64_t b)
+    {
+        const int64_t mask = ~(b - 1);
+        for (int i = 0; i < 16; ++i)
+        {
+            const int64_t t = mask & (p[i] ^ q[i]);
+            p[i] ^= t;
+            q[i] ^= t;
+        }
+    }
+
+    void pack(uint8_t* out, const Field n)
+    {
+        Field m, t;
+        for (int i = 0; i < 16; ++i) t[i] = n[i];
+        carry(t);
+        carry(t);
+        carry(t);
+        for (int j = 0; j < 2; ++j)
+        {
+            m[0] = t[0] - 0xffed;
+            for (int i = 1; i < 15; ++i)
+            {
+                m[i] = t[i] - 0xffff - ((m[i - 1] >> 16) & 1);
+                m[i - 1] &= 0xffff;
+            }
+            m[15] = t[15] - 0x7fff - ((m[14] >> 16) & 1);
+            const int64_t b = (m[15] >> 16) & 1;
+            m[14] &= 0xffff;
+            select(t, m, 1 - b);
+        }
+        for (int i = 0; i < 16; ++i)
+        {
+            out[2 * i] = static_cast<uint8_t>(t[i] & 0xff);
+            out[2 * i + 1] = static_cast<uint8_t>(t[i] >> 8);
+        }
+    }
+
+    void unpack(Field o, const uint8_t* n)
+    {
+        for (int i = 0; i < 16; ++i) o[i] = n[2 * i] + (static_cast<int64_t>(n[2 * i + 1]) << 8);
+        o[15] &= 0x7fff;
+    }
+
+    void add(Field o, const Field a, const Field b) { for (int i = 0; i < 16; ++i) o[i] = a[i] + b[i]; }
+    void sub(Field o, const Field a, const Field b) { for (int i = 0; i < 16; ++i) o[i] = a[i] - b[i]; }
+
+    void mul(Field o, const Field a, const Field b)
+    {
+        int64_t t[31] = {};
+        for (int i = 0; i < 16; ++i)
+        {
+            for (int j = 0; j < 16; ++j) t[i + j] += a[i] * b[j];
+        }
+        for (int i = 0; i < 15; ++i) t[i] += 38 * t[i + 16];
+        for (int i = 0; i < 16; ++i) o[i] = t[i];
+        carry(o);
+        carry(o);
+    }
+
+    void square(Field o, const Field a) { mul(o, a, a); }
+
+    // o = i^(p-2)
+    void invert(Field o, const Field i)
+    {
+        Field c;
+        for (int a = 0; a < 16; ++a) c[a] = i[a];
+        for (int a = 253; a >= 0; --a)
+        {
+            square(c, c);
+            if (a != 2 && a != 4) mul(c, c, i);
+        }
+        for (int a = 0; a < 16; ++a) o[a] = c[a];
+    }
+}
+
+crypto::KeyPair crypto::KeyPair::generate()
+{
+    KeyPair pair;
+    randomBytes(pair.secret.data(), KEY_SIZE);
+    Key base = {};
+    base[0] = 9;
+    x25519(pair.public_key, pair.secret, base);
+    return pair;
+}
+
+bool crypto::x25519(Key& out, const Key& scalar, const Key& point)
+{
+    static const Field A24 = { 0xDB41, 1 }; // 121665
+
+    uint8_t z[32];
+    memcpy(z, scalar.data(), 32);
+    z[31] = (z[31] & 127) | 64; // clamped
+    z[0] &= 248;
+
+    Field x, a = {}, b, c = {}, d = {}, e, f;
+    unpack(x, point.data());
+    for (int i = 0; i < 16; ++i) b[i] = x[i];
+    a[0] = d[0] = 1;
+
+    // Montgomery ladder
+    for (int i = 254; i >= 0; --i)
+    {
+        const int64_t bit = (z[i >> 3] >> (i & 7)) & 1;
+        select(a, b, bit);
+        select(c, d, bit);
+        add(e, a, c);
+        sub(a, a, c);
+        add(c, b, d);
+        sub(b, b, d);
+        square(d, e);
+        square(f, a);
+        mul(a, c, a);
+        mul(c, b, e);
+        add(e, a, c);
+        sub(a, a, c);
+        square(b, a);
+        sub(c, d, f);
+        mul(a, c, A24);
+        add(a, a, d);
+        mul(c, c, a);
+        mul(a, d, f);
+        mul(d, b, x);
+        square(b, e);
+        select(a, b, bit);
+        select(c, d, bit);
+    }
+    invert(c, c);
+    mul(a, a, c);
+    pack(out.data(), a);
+
+    uint8_t any = 0;
+    for (uint8_t byte : out) any |= byte;
+    return any != 0;
+}
+
+bool crypto::deriveSessionKeys(const KeyPair& own, const Key& peer_public, bool initiator, SessionKeys& keys)
+{
+    Key shared;
+    if (!x25519(shared, own.secret, peer_public)) return false;
+
+    // the raw shared secret isn't uniformly random, hashed first (as NaCl's crypto_box does)
+    const uint8_t zero[16] = {};
+    const Key key = hchacha(shared, zero);
+    uint8_t stream[64] = {};
+    chachaXor(key, 0, zero, stream, sizeof(stream));
+    const uint8_t* initiator_key = stream;
+    const uint8_t* responder_key = stream + KEY_SIZE;
+    memcpy(keys.tx.data(), initiator ? initiator_key : responder_key, KEY_SIZE);
+    memcpy(keys.rx.data(), initiator ? responder_key : initiator_key, KEY_SIZE);
+    return true;
+}
+
+void crypto::Aead::seal(uint64_t nonce, const uint8_t* ad, size_t ad_length, uint8_t* data, size_t length, uint8_t* tag) const
+{
+    uint8_t nonce_bytes[12];
+    makeNonce(m_constant, nonce, nonce_bytes);
+    chachaXor(m_key, 1, nonce_bytes, data, length);
+    aeadTag(m_key, nonce_bytes, ad, ad_length, data, length, tag);
+}
+
+bool crypto::Aead::open(uint64_t nonce, const uint8_t* ad, size_t ad_length, uint8_t* data, size_t length, const uint8_t* tag) const
+{
+    uint8_t nonce_bytes[12];
+    makeNonce(m_constant, nonce, nonce_bytes);
+    uint8_t expected[TAG_SIZE];
+    aeadTag(m_key, nonce_bytes, ad, ad_length, data, length, expected);
+    uint8_t diff = 0; // constant time
+    for (size_t i = 0; i < TAG_SIZE; ++i) diff |= expected[i] ^ tag[i];
+    if (diff) return false;
+    chachaXor(m_key, 1, nonce_bytes, data, length);
+    return true;
+}
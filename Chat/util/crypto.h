@@ -0,0 +1,69 @@
+﻿#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+/**
+ * Transport encryption primitives
+ *
+ * X25519 key agreement (RFC 7748) & ChaCha20-Poly1305 AEAD (RFC 8439), in portable
+ * C++. Keys are agreed on w/o authenticating the peers, which protects against
+ * eavesdropping, not against an active man-in-the-middle.
+ */
+namespace crypto
+{
+    constexpr size_t KEY_SIZE = 32;
+    constexpr size_t TAG_SIZE = 16;
+
+    typedef std::array<uint8_t, KEY_SIZE> Key;
+
+    // Ephemeral X25519 key pair
+    struct KeyPair
+    {
+        Key secret;
+        Key public_key;
+
+        // Generates a key pair from the OS's CSPRNG (BCryptGenRandom/getrandom)
+        static KeyPair generate();
+    };
+
+    // One key per direction, so both sides can count nonces from zero
+    struct SessionKeys
+    {
+        Key tx; ///< encrypts what we send
+        Key rx; ///< decrypts what we receive
+    };
+
+    // Computes scalar * point on Curve25519
+    // @return false if the result is zero, i.e. the point has a small order
+    bool x25519(Key& out, const Key& scalar, const Key& point);
+
+    // Derives the session keys from our key pair & the peer's public key
+    // @param initiator true on the side that sent its public key first (the client)
+    // @return false if the peer's public key is unusable
+    bool deriveSessionKeys(const KeyPair& own, const Key& peer_public, bool initiator, SessionKeys& keys);
+
+    /**
+     * ChaCha20-Poly1305 w/ a fixed key, encrypting & decrypting in place
+     *
+     * The 96-bit nonce is a 32-bit constant (zero for sessions) & a 64-bit counter,
+     * which must never repeat for a key.
+     */
+    class Aead
+    {
+    public:
+        Aead(const Key& key, uint32_t constant = 0) : m_key(key), m_constant(constant) {}
+
+        // Encrypts data[0:length] & computes the tag over ad & the ciphertext
+        void seal(uint64_t nonce, const uint8_t* ad, size_t ad_length, uint8_t* data, size_t length, uint8_t* tag) const;
+
+        // Checks the tag, then decrypts data[0:length]
+        // @return false (w/ data untouched) if the tag doesn't match
+        bool open(uint64_t nonce, const uint8_t* ad, size_t ad_length, uint8_t* data, size_t length, const uint8_t* tag) const;
+
+    private:
+        Key m_key;
+        uint32_t m_constant; ///< nonce prefix, little-endian on the wire
+    };
+}
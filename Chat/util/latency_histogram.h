@@ -0,0 +1,64 @@
+﻿#pragma once
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <string>
+
+/**
+ * Log2-bucketed latency histogram (not thread-safe)
+ *
+ * Bucket i counts samples in [2^i, 2^(i+1)) microseconds, percentiles are
+ * reported as the upper bound of the bucket they fall in (capped at the max).
+ */
+class LatencyHistogram
+{
+public:
+    static constexpr size_t BUCKETS = 32;
+
+    // Records a sample
+    void record(std::chrono::nanoseconds latency)
+    {
+        const uint64_t us = static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::microseconds>(latency).count());
+        size_t bucket = 0;
+        while (bucket + 1 < BUCKETS && (us >> (bucket + 1)) > 0) bucket++;
+        m_buckets[bucket]++;
+        m_count++;
+        if (us > m_max_us) m_max_us = us;
+    }
+
+    // Returns the upper bound (in microseconds) of the bucket holding the p-th percentile, p in [0, 1]
+    uint64_t percentile(double p) const
+    {
+        if (m_count == 0) return 0;
+        const uint64_t rank = static_cast<uint64_t>(p * static_cast<double>(m_count - 1)) + 1;
+        uint64_t seen = 0;
+        for (size_t i = 0; i < BUCKETS; ++i)
+        {
+            seen += m_buckets[i];
+            if (seen >= rank) return std::min(uint64_t(1) << (i + 1), m_max_us);
+        }
+        return m_max_us;
+    }
+
+    uint64_t count() const { return m_count; }
+    uint64_t max() const { return m_max_us; }
+
+    void reset() { *this = LatencyHistogram(); }
+
+    // Formats a one-line summary, e.g. "n=120 p50<=2048us p90<=32768us p99<=32768us max=30112us"
+    std::string str() const
+    {
+        return "n=" + std::to_string(m_count)
+            + " p50<=" + std::to_string(percentile(0.50)) + "us"
+            + " p90<=" + std::to_string(percentile(0.90)) + "us"
+            + " p99<=" + std::to_string(percentile(0.99)) + "us"
+            + " max=" + std::to_string(m_max_us) + "us";
+    }
+
+private:
+    std::array<uint64_t, BUCKETS> m_buckets{}; ///< sample count per bucket
+    uint64_t m_count = 0;  ///< total samples
+    uint64_t m_max_us = 0; ///< largest sample
+};
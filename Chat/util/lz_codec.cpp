@@ -0,0 +1,140 @@
+﻿#include "lz_codec.h"
+
+#include <cstring>
+
+namespace
+{
+    const size_t MIN_MATCH = 4;
+    const size_t MAX_OFFSET = 65535;
+    const int HASH_BITS = 12;
+
+    uint32_t read32(const uint8_t* p)
+    {
+        uint32_t value;
+        memcpy(&value, p, sizeof(value));
+        return value;
+    }
+
+    uint32_t hash(uint32_t value)
+    {
+        return (value * 2654435761u) >> (32 - HASH_BITS);
+    }
+
+    // Writes the extension bytes of a nibble that reads 15
+    bool writeLength(uint8_t*& op, const uint8_t* out_end, size_t length)
+    {
+        for (; length >= 255; length -= 255)
+        {
+            if (op == out_end) return false;
+            *op++ = 255;
+        }
+        if (op == out_end) return false;
+        *op++ = static_cast<uint8_t>(length);
+        return true;
+    }
+
+    // Reads the extension bytes of a nibble that reads 15
+    bool readLength(const uint8_t*& ip, const uint8_t* in_end, size_t& length)
+    {
+        uint8_t byte;
+        do
+        {
+            if (ip == in_end) return false;
+            byte = *ip++;
+            length += byte;
+        } while (byte == 255);
+        return true;
+    }
+
+    // Writes a token, the literals & (if match_length > 0) the match offset
+    bool writeSequence(uint8_t*& op, const uint8_t* out_end, const uint8_t* literals, size_t literal_count,
+        size_t match_length, size_t offset)
+    {
+        if (op == out_end) return false;
+        uint8_t* token = op++;
+        const size_t match_code = match_length ? match_length - MIN_MATCH : 0;
+        *token = static_cast<uint8_t>((literal_count < 15 ? literal_count : 15) << 4 | (match_code < 15 ? match_code : 15));
+
+        if (literal_count >= 15 && !writeLength(op, out_end, literal_count - 15)) return false;
+        if (static_cast<size_t>(out_end - op) < literal_count) return false;
+        if (literal_count) memcpy(op, literals, literal_count);
+        op += literal_count;
+
+        if (!match_length) return true;
+        if (out_end - op < 2) return false;
+        *op++ = static_cast<uint8_t>(offset);
+        *op++ = static_cast<uint8_t>(offset >> 8);
+        return match_code < 15 || writeLength(op, out_end, match_code - 15);
+    }
+}
+
+size_t lz::compress(const uint8_t* in, size_t in_length, uint8_t* out, size_t out_limit)
+{
+    uint32_t table[1 << HASH_BITS];
+    memset(table, 0xFF, sizeof(table)); // no candidates yet
+
+    uint8_t* op = out;
+    const uint8_t* out_end = out + out_limit;
+    size_t anchor = 0; // first literal not yet written
+    size_t i = 0;
+    while (i + MIN_MATCH <= in_length)
+    {
+        const uint32_t value = read32(in + i);
+        uint32_t& slot = table[hash(value)];
+        const size_t candidate = slot;
+        slot = static_cast<uint32_t>(i);
+
+        if (candidate == UINT32_MAX || i - candidate > MAX_OFFSET || read32(in + candidate) != value)
+        {
+            i++;
+            continue;
+        }
+
+        size_t length = MIN_MATCH;
+        while (i + length < in_length && in[candidate + length] == in[i + length]) length++;
+
+        if (!writeSequence(op, out_end, in + anchor, i - anchor, length, i - candidate)) return 0;
+        i += length;
+        anchor = i;
+    }
+
+    // trailing literals end the block
+    if (!writeSequence(op, out_end, in + anchor, in_length - anchor, 0, 0)) return 0;
+    return op - out;
+}
+
+size_t lz::decompress(const uint8_t* in, size_t in_length, uint8_t* out, size_t out_limit)
+{
+    const uint8_t* ip = in;
+    const uint8_t* in_end = in + in_length;
+    uint8_t* op = out;
+    const uint8_t* out_end = out + out_limit;
+
+    while (ip < in_end)
+    {
+        const uint8_t token = *ip++;
+
+        size_t literal_count = token >> 4;
+        if (literal_count == 15 && !readLength(ip, in_end, literal_count)) return 0;
+        if (static_cast<size_t>(in_end - ip) < literal_count || static_cast<size_t>(out_end - op) < literal_count) return 0;
+        memcpy(op, ip, literal_count);
+        ip += literal_count;
+        op += literal_count;
+
+        if (ip == in_end) break; // last sequence, no match
+
+        if (in_end - ip < 2) return 0;
+        const size_t offset = ip[0] | static_cast<size_t>(ip[1]) << 8;
+        ip += 2;
+        size_t match_length = token & 0x0F;
+        if (match_length == 15 && !readLength(ip, in_end, match_length)) return 0;
+        match_length += MIN_MATCH;
+
+        if (offset == 0 || offset > static_cast<size_t>(op - out)) return 0;
+        if (static_cast<size_t>(out_end - op) < match_length) return 0;
+        const uint8_t* match = op - offset;
+        for (size_t k = 0; k < match_length; ++k) op[k] = match[k]; // may overlap
+        op += match_length;
+    }
+    return op - out;
+}
@@ -0,0 +1,23 @@
+﻿#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+/**
+ * Small, fast LZ77 codec (LZ4-like), for compressing datagrams
+ *
+ * A compressed block is a sequence of:
+ *   token (literal count << 4 | match length - 4), each nibble extended by
+ *   255-valued bytes when it reads 15, the literals, then a little-endian u16
+ *   match offset, unless the block ends after the literals.
+ */
+namespace lz
+{
+    // Compresses in[0:in_length] into out, writing at most out_limit bytes
+    // @return compressed size, 0 if it doesn't fit in out_limit
+    size_t compress(const uint8_t* in, size_t in_length, uint8_t* out, size_t out_limit);
+
+    // Decompresses in[0:in_length] into out, writing at most out_limit bytes
+    // @return decompressed size, 0 if the input is malformed or doesn't fit
+    size_t decompress(const uint8_t* in, size_t in_length, uint8_t* out, size_t out_limit);
+}
@@ -0,0 +1,124 @@
+﻿#include "mapped_file.h"
+
+#ifdef _WIN32
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#ifdef _WIN32
+
+bool MappedFile::open(const std::string& path, size_t size)
+{
+    close();
+    HANDLE file = CreateFileA(path.c_str(), GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ, NULL, OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (file == INVALID_HANDLE_VALUE) return false;
+
+    // the file's clusters are allocated up front, a full disk fails here rather than in a write
+    // through the view; the mapping then extends the file to its size
+    const uint64_t length = size;
+    LARGE_INTEGER current;
+    if (!GetFileSizeEx(file, &current))
+    {
+        CloseHandle(file);
+        return false;
+    }
+    if (static_cast<uint64_t>(current.QuadPart) < length)
+    {
+        FILE_ALLOCATION_INFO allocation;
+        allocation.AllocationSize.QuadPart = static_cast<LONGLONG>(length);
+        if (!SetFileInformationByHandle(file, FileAllocationInfo, &allocation, sizeof(allocation)))
+        {
+            CloseHandle(file);
+            return false;
+        }
+    }
+    HANDLE mapping = CreateFileMappingA(file, NULL, PAGE_READWRITE, static_cast<DWORD>(length >> 32), static_cast<DWORD>(length), NULL);
+    void* view = mapping ? MapViewOfFile(mapping, FILE_MAP_ALL_ACCESS, 0, 0, size) : NULL;
+    if (!view)
+    {
+        if (mapping) CloseHandle(mapping);
+        CloseHandle(file);
+        return false;
+    }
+    m_file = file;
+    m_mapping = mapping;
+    m_data = static_cast<uint8_t*>(view);
+    m_size = size;
+    return true;
+}
+
+void MappedFile::close()
+{
+    if (m_data) UnmapViewOfFile(m_data);
+    if (m_mapping) CloseHandle(m_mapping);
+    if (m_file) CloseHandle(m_file);
+    m_data = nullptr;
+    m_mapping = nullptr;
+    m_file = nullptr;
+    m_size = 0;
+}
+
+bool MappedFile::flush(size_t offset, size_t length)
+{
+    if (!m_data || offset + length > m_size) return false;
+    return FlushViewOfFile(m_data + offset, length) && FlushFileBuffers(m_file);
+}
+
+#else
+
+bool MappedFile::open(const std::string& path, size_t size)
+{
+    close();
+    const int fd = ::open(path.c_str(), O_RDWR | O_CREAT, 0644);
+    if (fd < 0) return false;
+
+    // the blocks are allocated, not just the size set (a sparse file would SIGBUS on a full
+    // disk when written through the mapping): a full disk fails here instead
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (static_cast<size_t>(st.st_size) < size && posix_fallocate(fd, 0, static_cast<off_t>(size)) != 0))
+    {
+        ::close(fd);
+        return false;
+    }
+    void* view = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (view == MAP_FAILED)
+    {
+        ::close(fd);
+        return false;
+    }
+    m_fd = fd;
+    m_data = static_cast<uint8_t*>(view);
+    m_size = size;
+    return true;
+}
+
+void MappedFile::close()
+{
+    if (m_data) munmap(m_data, m_size);
+    if (m_fd >= 0) ::close(m_fd);
+    m_data = nullptr;
+    m_fd = -1;
+    m_size = 0;
+}
+
+bool MappedFile::flush(size_t offset, size_t length)
+{
+    if (!m_data || offset + length > m_size) return false;
+
+    // msync wants a page-aligned start
+    const size_t page = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+    const size_t begin = offset / page * page;
+    return msync(m_data + begin, offset + length - begin, MS_SYNC) == 0;
+}
+
+#endif
@@ -0,0 +1,49 @@
+﻿#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+/**
+ * Fixed-size file mapped into memory, read-write
+ *
+ * The file is created (or extended) to the requested size when opened, w/ its
+ * space allocated, so a full disk fails open() rather than a write through the
+ * mapping. Writes through data() reach the file eventually, flush() forces them
+ * to the disk.
+ * Win32 file mappings on Windows, mmap elsewhere.
+ */
+class MappedFile
+{
+public:
+    MappedFile() = default;
+    ~MappedFile() { close(); }
+
+    // non-copyable
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    // Opens or creates a file & maps size bytes of it
+    // @return false if the file can't be opened or mapped
+    bool open(const std::string& path, size_t size);
+
+    // Unmaps & closes the file
+    void close();
+
+    // Writes [offset, offset + length) of the mapping to the disk, blocking until it's durable
+    bool flush(size_t offset, size_t length);
+
+    bool isOpen() const { return m_data != nullptr; }
+    uint8_t* data() const { return m_data; }
+    size_t size() const { return m_size; }
+
+private:
+    uint8_t* m_data = nullptr; ///< mapped view, null while closed
+    size_t m_size = 0;         ///< mapped bytes
+#ifdef _WIN32
+    void* m_file = nullptr;    ///< file HANDLE
+    void* m_mapping = nullptr; ///< file mapping HANDLE
+#else
+    int m_fd = -1;             ///< file descriptor
+#endif
+};
@@ -0,0 +1,61 @@
+﻿#pragma once
+
+#include <atomic>
+#include <utility>
+
+/**
+ * Unbounded multi-producer, single-consumer queue
+ *
+ * Lock-free (intrusive linked list w/ a stub node, after D. Vyukov): push
+ * never blocks & may be called from any thread, pop must only be called from
+ * the one consumer thread.
+ */
+template <typename T>
+class MPSCQueue
+{
+    struct Node
+    {
+        std::atomic<Node*> next{ nullptr };
+        T value{};
+    };
+
+public:
+    MPSCQueue() : m_head(new Node()), m_tail(m_head.load()) {}
+
+    ~MPSCQueue()
+    {
+        T value;
+        while (pop(value)) {}
+        delete m_tail;
+    }
+
+    // non-copyable
+    MPSCQueue(const MPSCQueue&) = delete;
+    MPSCQueue& operator=(const MPSCQueue&) = delete;
+
+    // Pushes a value, any thread
+    void push(T value)
+    {
+        Node* node = new Node();
+        node->value = std::move(value);
+        Node* prev = m_head.exchange(node, std::memory_order_acq_rel);
+        prev->next.store(node, std::memory_order_release);
+    }
+
+    // Pops the oldest value, consumer thread only
+    // @return false if the queue is empty
+    bool pop(T& out_value)
+    {
+        Node* tail = m_tail;
+        Node* next = tail->next.load(std::memory_order_acquire);
+        if (!next) return false;
+        out_value = std::move(next->value);
+        m_tail = next; // next becomes the new stub
+        delete tail;
+        return true;
+    }
+
+private:
+    alignas(64) std::atomic<Node*> m_head; ///< most recently pushed node, producers
+    alignas(64) Node* m_tail;              ///< stub node, consumer
+};
@@ -0,0 +1,90 @@
+﻿#pragma once
+
+#include <cstddef>
+#include <string>
+#include <string_view>
+
+/**
+ * UTF-8 helpers, counting code points rather than bytes
+ *
+ * Continuation bytes (10xxxxxx) never start a code point, so text is only cut
+ * between characters. Malformed text degrades to counting its other bytes.
+ */
+namespace utf8
+{
+    inline bool isContinuation(char byte)
+    {
+        return (static_cast<unsigned char>(byte) & 0xC0) == 0x80;
+    }
+
+    // Number of code points in the text
+    inline size_t length(std::string_view text)
+    {
+        size_t count = 0;
+        for (char byte : text) count += !isContinuation(byte);
+        return count;
+    }
+
+    // Byte offset count code points past offset, clamped to the end of the text
+    inline size_t advance(std::string_view text, size_t offset, size_t count)
+    {
+        while (offset < text.length() && count > 0)
+        {
+            offset++;
+            while (offset < text.length() && isContinuation(text[offset])) offset++;
+            count--;
+        }
+        return offset;
+    }
+
+    // Byte offset count code points before offset, clamped to the start of the text
+    inline size_t retreat(std::string_view text, size_t offset, size_t count)
+    {
+        while (offset > 0 && count > 0)
+        {
+            offset--;
+            while (offset > 0 && isContinuation(text[offset])) offset--;
+            count--;
+        }
+        return offset;
+    }
+
+    // Bytes in the sequence a lead byte starts, 0 if it can't start one
+    inline size_t sequenceLength(char byte)
+    {
+        const unsigned char lead = static_cast<unsigned char>(byte);
+        if (lead < 0x80) return 1;
+        if (lead >= 0xC2 && lead <= 0xDF) return 2;
+        if (lead >= 0xE0 && lead <= 0xEF) return 3;
+        if (lead >= 0xF0 && lead <= 0xF4) return 4;
+        return 0;
+    }
+
+    // Appends the encoding of a code point, U+FFFD for surrogates & values past U+10FFFF
+    inline void append(std::string& text, char32_t code_point)
+    {
+        if ((code_point >= 0xD800 && code_point <= 0xDFFF) || code_point > 0x10FFFF) code_point = 0xFFFD;
+        if (code_point < 0x80)
+        {
+            text += static_cast<char>(code_point);
+        }
+        else if (code_point < 0x800)
+        {
+            text += static_cast<char>(0xC0 | (code_point >> 6));
+            text += static_cast<char>(0x80 | (code_point & 0x3F));
+        }
+        else if (code_point < 0x10000)
+        {
+            text += static_cast<char>(0xE0 | (code_point >> 12));
+            text += static_cast<char>(0x80 | ((code_point >> 6) & 0x3F));
+            text += static_cast<char>(0x80 | (code_point & 0x3F));
+        }
+        else
+        {
+            text += static_cast<char>(0xF0 | (code_point >> 18));
+            text += static_cast<char>(0x80 | ((code_point >> 12) & 0x3F));
+            text += static_cast<char>(0x80 | ((code_point >> 6) & 0x3F));
+            text += static_cast<char>(0x80 | (code_point & 0x3F));
+        }
+    }
+}
@@ -0,0 +1,168 @@
+﻿#include <thread>
+
+#include "test.h"
+#include "chat/message_batcher.h"
+#include "chat/presence_batcher.h"
+
+namespace
+{
+    const size_t PEERS = 500; ///< recipients of every broadcast
+
+    protocol::MessagePackage makeMessage(size_t i)
+    {
+        return protocol::MessagePackage(static_cast<user_id_t>(1 + i % PEERS), "message number " + std::to_string(i) + ", a typical short chat line");
+    }
+
+    struct Traffic
+    {
+        uint64_t messages = 0;
+        uint64_t packets = 0;  ///< datagrams sent, all peers
+        double busy_ms = 0.0;  ///< time spent queueing, encoding & flushing
+    };
+
+    // Runs the host's broadcast path for a second at a steady message rate, driven like the listener
+    // thread: whatever arrived, then a tick, then a 1 ms sleep. Each broadcast is encoded once & counts
+    // as one datagram per peer (ENet's own per-packet cost isn't included)
+    Traffic broadcastFor1s(size_t rate, bool batched)
+    {
+        Traffic traffic;
+        ByteStream s;
+        MessageBatcher batcher([&](const std::vector<protocol::MessagePackage>& messages, const std::vector<room_id_t>&)
+        {
+            protocol::MessageBatchPackage pkg;
+            pkg.messages = messages;
+            s.clear();
+            pkg.serialize(s);
+            traffic.packets += PEERS;
+        });
+
+        const test::Clock::time_point start = test::Clock::now();
+        while (traffic.messages < rate)
+        {
+            const size_t due = std::min(rate, static_cast<size_t>(test::secondsSince(start) * rate) + 1);
+            const test::Clock::time_point work = test::Clock::now();
+            for (; traffic.messages < due; ++traffic.messages)
+            {
+                const protocol::MessagePackage pkg = makeMessage(traffic.messages);
+                if (batched) batcher.add(pkg);
+                else
+                {
+                    s.clear();
+                    pkg.serialize(s);
+                    traffic.packets += PEERS;
+                }
+            }
+            batcher.tick();
+            traffic.busy_ms += test::secondsSince(work) * 1000.0;
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+        batcher.tick(test::Clock::now() + MessageBatcher::DEFAULT_BUDGET); // what's left
+        return traffic;
+    }
+}
+
+TEST(batcher_flushes_batches_that_fill_a_datagram)
+{
+    const size_t max_bytes = 200;
+    std::vector<size_t> sizes;
+    size_t flushed = 0;
+    MessageBatcher batcher([&](const std::vector<protocol::MessagePackage>& messages, const std::vector<room_id_t>&)
+    {
+        protocol::MessageBatchPackage pkg;
+        pkg.messages = messages;
+        sizes.push_back(protocol::codec::packageSize(pkg));
+        flushed += messages.size();
+    }, std::chrono::milliseconds(1000), max_bytes);
+
+    for (size_t i = 0; i < 10; ++i) batcher.add(makeMessage(i));
+    CHECK(sizes.size() >= 3); // w/o waiting for the budget
+    batcher.tick(MessageBatcher::Clock::now() + std::chrono::milliseconds(1000));
+    CHECK(flushed == 10);
+    for (size_t size : sizes) CHECK(size <= max_bytes);
+    CHECK(batcher.messages() == 10 && batcher.packets() == sizes.size());
+}
+
+TEST(batcher_holds_lines_for_the_latency_budget)
+{
+    size_t flushed = 0;
+    MessageBatcher batcher([&flushed](const std::vector<protocol::MessagePackage>& messages, const std::vector<room_id_t>&) { flushed += messages.size(); });
+    batcher.add(makeMessage(0));
+    batcher.add(makeMessage(1));
+    batcher.tick();
+    CHECK(flushed == 0);
+    batcher.tick(MessageBatcher::Clock::now() + MessageBatcher::DEFAULT_BUDGET);
+    CHECK(flushed == 2);
+}
+
+TEST(presence_join_then_leave_cancels_out)
+{
+    PresenceBatcher presence;
+    presence.add(UserInfo(3, "joined"));
+    presence.remove(3);
+    CHECK(presence.empty());
+    CHECK(!presence.ready(PresenceBatcher::Clock::now() + PresenceBatcher::DEFAULT_WINDOW));
+}
+
+TEST(presence_leave_then_join_replaces_the_user)
+{
+    PresenceBatcher presence;
+    presence.remove(3); // announced in an earlier window
+    presence.add(UserInfo(3, "newcomer"));
+    presence.add(UserInfo(5, "other"));
+
+    std::vector<user_id_t> removed;
+    std::vector<UserInfo> added;
+    presence.flush(removed, added);
+    CHECK(removed == std::vector<user_id_t>{ 3 });
+    CHECK(added.size() == 2 && added[0].user_id == 3 && added[0].name == "newcomer" && added[1].user_id == 5);
+    CHECK(presence.empty());
+
+    // & leaving again before that's announced is a removal, the first user is gone either way
+    presence.remove(3);
+    presence.add(UserInfo(3, "again"));
+    presence.remove(3);
+    removed.clear();
+    added.clear();
+    presence.flush(removed, added);
+    CHECK(removed == std::vector<user_id_t>{ 3 } && added.empty());
+}
+
+TEST(presence_window_starts_w_the_first_change)
+{
+    const std::chrono::milliseconds window(30);
+    PresenceBatcher presence(window);
+    const PresenceBatcher::Clock::time_point before = PresenceBatcher::Clock::now();
+    presence.add(UserInfo(3, "first"));
+    const PresenceBatcher::Clock::time_point after = PresenceBatcher::Clock::now();
+    presence.add(UserInfo(4, "second")); // doesn't extend the window
+
+    CHECK(!presence.ready(before + window - std::chrono::microseconds(1)));
+    CHECK(presence.ready(after + window));
+
+    std::vector<user_id_t> removed;
+    std::vector<UserInfo> added;
+    presence.flush(removed, added);
+    CHECK(added.size() == 2);
+    CHECK(!presence.ready(after + window)); // nothing left
+
+    // the next change starts a new window
+    const PresenceBatcher::Clock::time_point next = PresenceBatcher::Clock::now();
+    presence.remove(4);
+    CHECK(!presence.ready(next + window - std::chrono::microseconds(1)));
+    CHECK(presence.ready(PresenceBatcher::Clock::now() + window));
+}
+
+// Datagrams per second & busy time of the broadcast path, for 500 peers, batched vs a packet per line
+BENCH(broadcast_500_peers)
+{
+    for (size_t rate : { 1000, 10000 })
+    {
+        const std::string at = std::to_string(rate) + " msg/s x 500 peers, ";
+        const Traffic single = broadcastFor1s(rate, false);
+        const Traffic batched = broadcastFor1s(rate, true);
+        test::report(at + "packet per line", static_cast<double>(single.packets), "packets/s");
+        test::report(at + "batched", static_cast<double>(batched.packets), "packets/s");
+        test::report(at + "packet per line, busy", single.busy_ms, "ms/s");
+        test::report(at + "batched, busy", batched.busy_ms, "ms/s");
+    }
+}
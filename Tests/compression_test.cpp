@@ -0,0 +1,122 @@
+﻿#include "test.h"
+#include "chat/userinfo.h"
+#include "network/compressor.h"
+#include "network/protocol.h"
+
+namespace
+{
+    // A full MESSAGE_BATCH of chat-like lines, as the host broadcasts them
+    std::string chatDatagram(size_t max_bytes = 1200)
+    {
+        static const char* lines[] = {
+            "hey everyone, what's up?", "anyone up for a game later tonight?", "lol", "brb, getting coffee",
+            "did you see the patch notes for the new version?", "yeah the servers were down for a while this morning",
+            "ok see you all later", "thanks! that fixed it", "no idea, try restarting the client",
+        };
+        protocol::MessageBatchPackage pkg;
+        for (size_t i = 0; protocol::codec::packageSize(pkg) < max_bytes - 64; ++i)
+        {
+            pkg.messages.push_back(protocol::MessagePackage(static_cast<user_id_t>(1 + i * 7 % 23), lines[i * 5 % 9]));
+        }
+        ByteStream s;
+        pkg.serialize(s);
+        return s.getBuf();
+    }
+
+    // A USER_LIST_PAGE of generated names
+    std::string userListDatagram()
+    {
+        protocol::UserListPagePackage pkg(1, 0, 1);
+        for (size_t i = 0; protocol::codec::packageSize(pkg) < 1100; ++i)
+        {
+            pkg.users.push_back(UserInfo(static_cast<user_id_t>(i + 1), "player_" + std::to_string(1000 + i * 37)));
+        }
+        ByteStream s;
+        pkg.serialize(s);
+        return s.getBuf();
+    }
+
+    // An AdaptiveCompressor plugged into a host, called as ENet does when sending & receiving
+    struct Compressor
+    {
+        ENetHost host{};
+        net::AdaptiveCompressor compressor;
+
+        Compressor(net::CompressionCodec codec) : compressor(codec)
+        {
+            compressor.install(&host);
+            compressor.setEnabled(true);
+        }
+
+        size_t compress(const std::string& in, std::vector<enet_uint8>& out)
+        {
+            ENetBuffer buffer;
+            buffer.data = const_cast<char*>(in.data());
+            buffer.dataLength = in.length();
+            out.resize(in.length());
+            return host.compressor.compress(host.compressor.context, &buffer, 1, in.length(), out.data(), out.size());
+        }
+
+        size_t decompress(const std::vector<enet_uint8>& in, size_t length, std::vector<enet_uint8>& out)
+        {
+            out.resize(ENET_PROTOCOL_MAXIMUM_MTU);
+            return host.compressor.decompress(host.compressor.context, in.data(), length, out.data(), out.size());
+        }
+    };
+}
+
+TEST(lz_round_trips_and_rejects_malformed_blocks)
+{
+    const std::string in = chatDatagram();
+    std::vector<uint8_t> packed(in.length() * 2), unpacked(in.length());
+    const size_t size = lz::compress(reinterpret_cast<const uint8_t*>(in.data()), in.length(), packed.data(), packed.size());
+    CHECK(size > 0 && size < in.length());
+    CHECK(lz::decompress(packed.data(), size, unpacked.data(), unpacked.size()) == in.length());
+    CHECK(memcmp(unpacked.data(), in.data(), in.length()) == 0);
+
+    CHECK(lz::decompress(packed.data(), size, unpacked.data(), in.length() - 1) == 0); // doesn't fit
+    for (size_t length = 1; length < size; ++length) lz::decompress(packed.data(), length, unpacked.data(), unpacked.size()); // no overrun
+    const uint8_t bad_offset[] = { 0x10, 'a', 0xFF, 0x00 }; // match before the start
+    CHECK(lz::decompress(bad_offset, sizeof(bad_offset), unpacked.data(), unpacked.size()) == 0);
+}
+
+TEST(compressor_round_trips_through_the_enet_callbacks)
+{
+    Compressor lz(net::CompressionCodec::LZ);
+    const std::string in = chatDatagram();
+    std::vector<enet_uint8> packed, unpacked;
+    const size_t size = lz.compress(in, packed);
+    CHECK(size > 0 && size < in.length() && packed[0] == static_cast<enet_uint8>(net::CompressionCodec::LZ));
+    CHECK(lz.decompress(packed, size, unpacked) == in.length());
+    CHECK(memcmp(unpacked.data(), in.data(), in.length()) == 0);
+
+    // small datagrams go out raw
+    CHECK(lz.compress(in.substr(0, net::AdaptiveCompressor::DEFAULT_MIN_SIZE - 1), packed) == 0);
+}
+
+// Ratio & cost per datagram of both codecs, on chat & user list traffic
+BENCH(compression_per_datagram)
+{
+    uint64_t sum = 0;
+    for (net::CompressionCodec codec : { net::CompressionCodec::LZ, net::CompressionCodec::RANGE_CODER })
+    {
+        const std::string name = codec == net::CompressionCodec::LZ ? "LZ" : "range coder";
+        for (const auto& [kind, in] : { std::make_pair("chat", chatDatagram()), std::make_pair("user list", userListDatagram()) })
+        {
+            Compressor compressor(codec);
+            std::vector<enet_uint8> packed, unpacked;
+            const size_t size = compressor.compress(in, packed);
+            const std::string what = name + ", " + kind + " " + std::to_string(in.length()) + "B";
+            if (size == 0)
+            {
+                test::report(what, "not compressed");
+                continue;
+            }
+            test::report(what + ", compressed size", 100.0 * size / in.length(), "%");
+            test::report(what + ", compress", test::nsPerCall([&]() { sum += compressor.compress(in, packed); }) / 1000.0, "us");
+            compressor.compress(in, packed);
+            test::report(what + ", decompress", test::nsPerCall([&]() { sum += compressor.decompress(packed, size, unpacked); }) / 1000.0, "us");
+        }
+    }
+    test::keep(sum);
+}
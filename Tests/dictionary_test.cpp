@@ -0,0 +1,99 @@
+﻿#include <random>
+
+#include "test.h"
+#include "chat/message_dictionary.h"
+#include "chat/userinfo.h"
+#include "network/protocol.h"
+
+namespace
+{
+    // Synthetic chat corpus: lines of 2 to 14 words drawn w/ a Zipf-like distribution from a chat
+    // vocabulary, the same on every run. Stands in for a recorded session, which the repo doesn't ship
+    std::vector<std::string> chatCorpus(size_t lines)
+    {
+        static const char* words[] = {
+            "the", "you", "to", "it", "and", "is", "that", "lol", "for", "what", "in", "was", "have", "just",
+            "this", "are", "so", "but", "not", "with", "can", "like", "on", "yeah", "get", "be", "do", "know",
+            "game", "about", "all", "think", "if", "one", "out", "now", "server", "there", "good", "time",
+            "anyone", "really", "going", "right", "people", "back", "again", "haha", "thanks", "tonight",
+            "someone", "because", "update", "playing", "everyone", "something", "tomorrow", "probably",
+            "actually", "connection", "restart", "download", "yesterday", "channel", "message", "working",
+            "character", "inventory", "dungeon", "matchmaking", "leaderboard", "screenshot", "settings",
+            "weekend", "awesome", "seriously", "definitely", "interesting", "afternoon", "whatever",
+        };
+        const size_t vocabulary = sizeof(words) / sizeof(words[0]);
+        std::vector<double> weights(vocabulary);
+        for (size_t i = 0; i < vocabulary; ++i) weights[i] = 1.0 / (i + 1);
+
+        std::mt19937 random(7);
+        std::discrete_distribution<size_t> word(weights.begin(), weights.end());
+        std::uniform_int_distribution<size_t> length(2, 14);
+        std::vector<std::string> corpus(lines);
+        for (std::string& line : corpus)
+        {
+            for (size_t i = length(random); i > 0; --i) line += std::string(words[word(random)]) + (i > 1 ? " " : "");
+        }
+        return corpus;
+    }
+}
+
+TEST(dictionary_pack_round_trips)
+{
+    const MessageDictionary dictionary(3, std::vector<std::string>{ "hello ", "world", "everyone " });
+    for (const std::string& text : { std::string("hello world"), std::string("hello everyone hello"),
+        std::string("\0starts w/ NUL", 14), std::string("no entries here"), std::string() })
+    {
+        const std::string packed = dictionary.pack(text);
+        std::string unpacked;
+        CHECK(dictionary.unpack(packed, unpacked) && unpacked == text);
+        CHECK(packed.length() <= text.length() || text[0] == MessageDictionary::MARKER);
+    }
+    CHECK(dictionary.pack("hello everyone hello").length() < 20);
+
+    // the client drops text packed against a version it doesn't have, & malformed references
+    std::string text;
+    CHECK(!MessageDictionary(4, std::vector<std::string>{ "hello " }).unpack(dictionary.pack("hello world"), text));
+    CHECK(!dictionary.unpack(std::string("\0\x03\0", 3), text));
+    CHECK(!dictionary.unpack(std::string("\0\x03\0\x09", 4), text));
+}
+
+TEST(dictionary_survives_the_wire_format)
+{
+    const MessageDictionary dictionary(5, std::vector<std::string>{ "alpha ", "beta", "gamma " });
+    const MessageDictionary received(dictionary.version(), dictionary.joined());
+    CHECK(received.size() == 3);
+    std::string text;
+    CHECK(received.unpack(dictionary.pack("alpha beta gamma beta"), text) && text == "alpha beta gamma beta");
+}
+
+// Text bytes saved on a chat corpus, w/ a dictionary trained the way the host does (every
+// RETRAIN_INTERVAL messages), & the cost of packing & unpacking a line
+BENCH(dictionary_on_a_chat_corpus)
+{
+    const std::vector<std::string> corpus = chatCorpus(20000);
+    DictionaryTrainer trainer;
+    MessageDictionary dictionary;
+    uint8_t version = 0;
+    uint64_t raw = 0, packed = 0;
+    for (const std::string& line : corpus)
+    {
+        raw += line.length();
+        packed += dictionary.pack(line).length();
+        if (trainer.observe(line)) dictionary = trainer.build(++version);
+    }
+    test::report("text bytes, raw", static_cast<double>(raw), "B");
+    test::report("text bytes, packed", static_cast<double>(packed), "B");
+    test::report("packed/raw, incl. the untrained start", 100.0 * packed / raw, "%");
+    const uint64_t headers = corpus.size() * protocol::MessageBatchPackage::ENTRY_HEADER_SIZE;
+    test::report("MESSAGE_BATCH entry bytes per line, raw", static_cast<double>(raw + headers) / corpus.size(), "B");
+    test::report("MESSAGE_BATCH entry bytes per line, packed", static_cast<double>(packed + headers) / corpus.size(), "B");
+
+    size_t next = 0;
+    uint64_t sum = 0;
+    test::report("pack a line", test::nsPerCall([&]() { sum += dictionary.pack(corpus[next++ % corpus.size()]).length(); }), "ns");
+    std::vector<std::string> packed_lines;
+    for (size_t i = 0; i < 1000; ++i) packed_lines.push_back(dictionary.pack(corpus[i]));
+    std::string text;
+    test::report("unpack a line", test::nsPerCall([&]() { dictionary.unpack(packed_lines[next++ % packed_lines.size()], text); sum += text.length(); }), "ns");
+    test::keep(sum);
+}
@@ -0,0 +1,200 @@
+﻿#include <atomic>
+#include <thread>
+
+#include "test.h"
+#include "chat/state/state.h"
+
+namespace
+{
+    // Counts the packages handed to the state
+    class RecordingState : public State
+    {
+    public:
+        RecordingState(ChatApp* app) : State(app) {}
+
+        void receiveUsernameEvent(UserInfo* user, protocol::UsernamePackage& pkg) override { received++; }
+        void receiveUsernameAckEvent(protocol::UsernameAckPackage& pkg) override { received++; }
+        void receiveMessageEvent(const UserRef* user, protocol::MessagePackage& pkg) override
+        {
+            received++;
+            sender = user ? user->user_id : 0;
+        }
+        void receiveUserDeltaEvent(protocol::UserDeltaPackage& pkg) override { received++; }
+        void receiveUserListPageEvent(protocol::UserListPagePackage& pkg) override { received++; }
+        void receiveDictionaryEvent(protocol::DictionaryPackage& pkg) override { received++; }
+        void receiveJoinRoomEvent(const UserRef* user, protocol::JoinRoomPackage& pkg) override { received++; }
+        void receiveRoomMembersEvent(protocol::RoomMembersPackage& pkg) override { received++; }
+
+        size_t received = 0; ///< packages handled (a batch counts per message)
+        user_id_t sender = 0; ///< user the last message was attributed to, 0 if unknown
+    };
+
+    // Notes whether it's deleted while the network thread is inside its tick()
+    class TickingState : public State
+    {
+    public:
+        static inline std::atomic<size_t> ticks{ 0 };
+        static inline std::atomic<size_t> overlaps{ 0 }; ///< deletes during a tick
+
+        TickingState(ChatApp* app) : State(app) {}
+        ~TickingState() override { if (m_ticking) overlaps++; }
+
+        void tick() override
+        {
+            m_ticking = true;
+            std::this_thread::sleep_for(std::chrono::microseconds(200)); // widens the window
+            ticks++;
+            m_ticking = false;
+        }
+
+    private:
+        std::atomic<bool> m_ticking{ false };
+    };
+
+    // Hands packets straight to the app, as the network thread would (from peer 0, i.e. user 1)
+    class TestApp : public ChatApp
+    {
+    public:
+        RecordingState* state = new RecordingState(this);
+
+        // w/o rate limits, unless given
+        explicit TestApp(bool hosting, const RateLimits* limits = nullptr)
+        {
+            getConfig()->checksum = false;
+            getConfig()->encryption = false;
+            getConfig()->rate_limits.packets_per_second = getConfig()->rate_limits.packet_burst = 1e12;
+            getConfig()->rate_limits.bytes_per_second = getConfig()->rate_limits.byte_burst = 1e15;
+            if (limits) getConfig()->rate_limits = *limits;
+            if (hosting) host(-1);
+            else connect("127.0.0.1", protocol::DEFAULT_PORT);
+            goToState(state);
+        }
+
+        template <typename Pkg>
+        void receive(const Pkg& pkg)
+        {
+            ByteStream s;
+            pkg.serialize(s);
+            receive(s);
+        }
+
+        void receive(const ByteStream& s)
+        {
+            receiveEvent(net::NetworkTraffic(reinterpret_cast<const enet_uint8*>(s.getBufPtr()), s.getLength()));
+        }
+    };
+
+    protocol::MessageBatchPackage makeBatch()
+    {
+        protocol::MessageBatchPackage pkg;
+        pkg.messages.push_back(protocol::MessagePackage(1, "hello"));
+        return pkg;
+    }
+
+    protocol::MessageBatchVarintPackage makeVarintBatch()
+    {
+        protocol::MessageBatchVarintPackage pkg;
+        pkg.messages.push_back(protocol::MessagePackage(1, "hello"));
+        return pkg;
+    }
+}
+
+TEST(host_drops_packages_only_the_host_sends)
+{
+    TestApp app(true);
+    app.receive(protocol::UsernameAckPackage(1, 0, 1, 1, 0));
+    app.receive(protocol::UserListPagePackage(1, 0, 1));
+    app.receive(makeBatch());
+    app.receive(makeVarintBatch());
+    app.receive(protocol::UserDeltaPackage(0, 1));
+    app.receive(protocol::DictionaryPackage(1, "entry"));
+    app.receive(protocol::RoomMembersPackage("room"));
+    CHECK(app.state->received == 0);
+
+    app.receive(protocol::JoinRoomPackage("room"));
+    app.receive(protocol::MessagePackage(1, "hello"));
+    CHECK(app.state->received == 2);
+}
+
+TEST(client_drops_packages_only_clients_send)
+{
+    TestApp app(false);
+    app.receive(protocol::UsernamePackage("mallory"));
+    app.receive(protocol::JoinRoomPackage("room"));
+    CHECK(app.state->received == 0);
+
+    app.receive(makeBatch());
+    app.receive(protocol::UserListPagePackage(1, 0, 1));
+    app.receive(protocol::MessagePackage(1, "hello"));
+    CHECK(app.state->received == 3);
+}
+
+TEST(host_attributes_messages_to_the_sending_peer)
+{
+    TestApp app(true);
+    app.addUser(UserInfo(1, "alice"));
+    app.addUser(UserInfo(5, "bob"));
+    app.receive(protocol::MessagePackage(5, "from alice, claiming to be bob")); // from peer 0, i.e. user 1
+    CHECK(app.state->received == 1);
+    CHECK(app.state->sender == 1);
+}
+
+// Batches from a client are dropped undecoded, but the limiter has charged them by then:
+// a flood of batches still uses up the client's budget, & gets it kicked
+TEST(host_charges_dropped_batches_to_the_limiter)
+{
+    RateLimits limits;
+    limits.packets_per_second = 0.001;
+    limits.packet_burst = 3.0;
+    limits.kick_after = 2;
+    TestApp app(true, &limits);
+    for (int i = 0; i < 3; ++i) app.receive(makeBatch());
+    CHECK(app.state->received == 0);
+    CHECK(app.getRateLimitStats().dropped == 0);
+
+    app.receive(protocol::JoinRoomPackage("room")); // would be handled, but the budget is gone
+    CHECK(app.state->received == 0);
+    CHECK(app.getRateLimitStats().dropped == 1);
+    app.receive(makeBatch());
+    CHECK(app.getRateLimitStats().dropped == 2);
+    CHECK(app.getRateLimitStats().kicked == 1);
+}
+
+// States are swapped on the UI thread while the network thread ticks them every ~1 ms,
+// the old one is only deleted once it's out of its tick
+TEST(state_swaps_wait_for_the_network_thread)
+{
+    TestApp app(true); // its listener thread ticks the state
+    for (int i = 0; i < 100; ++i)
+    {
+        app.goToState(new TickingState(&app));
+        const size_t ticks = TickingState::ticks;
+        const test::Clock::time_point start = test::Clock::now();
+        while (TickingState::ticks == ticks && test::secondsSince(start) < 1.0) std::this_thread::yield();
+        std::this_thread::sleep_for(std::chrono::microseconds(100 * (i % 12))); // swaps at all points of the loop
+    }
+    app.goToState(new State(&app));
+    CHECK(TickingState::ticks >= 100);
+    CHECK(TickingState::overlaps == 0);
+}
+
+// Cost of receiving a packet up to the state, i.e. the copy into a ByteStream, table lookup, decoding &
+// user lookup, vs a packet dropped by the table
+BENCH(dispatch_per_packet)
+{
+    TestApp client(false);
+    ByteStream message, batch, username;
+    protocol::MessagePackage(1, "a typical short chat line").serialize(message);
+    protocol::MessageBatchPackage pkg;
+    pkg.messages.assign(16, protocol::MessagePackage(1, "a typical short chat line"));
+    pkg.serialize(batch);
+    protocol::UsernamePackage("mallory").serialize(username);
+
+    test::report("client, MESSAGE", test::nsPerCall([&]() { client.receive(message); }), "ns");
+    test::report("client, MESSAGE_BATCH of 16", test::nsPerCall([&]() { client.receive(batch); }), "ns");
+    test::report("client, USERNAME (dropped)", test::nsPerCall([&]() { client.receive(username); }), "ns");
+
+    TestApp host(true);
+    test::report("host, MESSAGE_BATCH of 16 (dropped)", test::nsPerCall([&]() { host.receive(batch); }), "ns");
+    test::keep(client.state->received + host.state->received);
+}
@@ -0,0 +1,257 @@
+﻿#include <algorithm>
+#include <cstring>
+#include <string>
+#include <thread>
+
+#include "test.h"
+#include "loopback.h"
+#include "chat/state/chat_state_client.h"
+
+namespace
+{
+    // A client w/ the real client state, fed packets as if from the host (peer 0)
+    class ClientApp : public ChatApp
+    {
+    public:
+        ClientApp()
+        {
+            getConfig()->encryption = true;
+            getConfig()->nickname = "client";
+            goToState(new ChatState_Client(this)); // connects
+            connectionEvent(net::NetworkTraffic()); // sends KEY_EXCHANGE & USERNAME
+        }
+
+        template <typename Pkg>
+        void receive(const Pkg& pkg)
+        {
+            ByteStream s;
+            pkg.serialize(s);
+            receiveEvent(net::NetworkTraffic(reinterpret_cast<const enet_uint8*>(s.getBufPtr()), s.getLength()));
+        }
+    };
+
+    // Seals & opens messages of a given size, as a session does for every packet
+    struct SealedMessage
+    {
+        crypto::Aead aead{ crypto::Key{ 1, 2, 3 } };
+        std::vector<uint8_t> data, sealed, opened;
+        uint8_t tag[crypto::TAG_SIZE];
+        uint64_t nonce = 0;
+
+        explicit SealedMessage(size_t size) : data(size, 'x')
+        {
+            sealed = data;
+            aead.seal(0, NULL, 0, sealed.data(), sealed.size(), tag);
+        }
+
+        void seal() { aead.seal(nonce++, NULL, 0, data.data(), data.size(), tag); }
+
+        // opens a copy of the message sealed w/ nonce 0, so every call decrypts
+        bool open()
+        {
+            opened = sealed;
+            return aead.open(0, NULL, 0, opened.data(), opened.size(), tag);
+        }
+    };
+
+    std::vector<uint8_t> fromHex(const char* hex)
+    {
+        std::vector<uint8_t> bytes;
+        for (size_t i = 0; hex[i] && hex[i + 1]; i += 2) bytes.push_back(static_cast<uint8_t>(std::stoi(std::string(hex + i, 2), nullptr, 16)));
+        return bytes;
+    }
+
+    crypto::Key keyFromHex(const char* hex)
+    {
+        const std::vector<uint8_t> bytes = fromHex(hex);
+        crypto::Key key = {};
+        std::copy(bytes.begin(), bytes.begin() + std::min(bytes.size(), key.size()), key.begin());
+        return key;
+    }
+
+    // A packet as a client w/ a session sends it: u64 nonce, ciphertext, tag (see ENetWrapper::seal)
+    std::string sealPacket(const crypto::Aead& aead, uint64_t nonce, const std::string& text)
+    {
+        std::string packet(sizeof(nonce) + text.length() + crypto::TAG_SIZE, '\0');
+        uint8_t* data = reinterpret_cast<uint8_t*>(packet.data());
+        for (size_t i = 0; i < sizeof(nonce); ++i) data[i] = static_cast<uint8_t>(nonce >> (8 * i));
+        memcpy(data + sizeof(nonce), text.data(), text.length());
+        aead.seal(nonce, NULL, 0, data + sizeof(nonce), text.length(), data + sizeof(nonce) + text.length());
+        return packet;
+    }
+
+    // Broadcasts per second to all the loopback's clients, timed in rounds of `count` broadcasts
+    double broadcastsPerSecond(test::Loopback& loopback, const std::string& message, size_t count = 200)
+    {
+        double seconds = 0.0;
+        size_t sent = 0;
+        while (seconds < 0.3)
+        {
+            const test::Clock::time_point start = test::Clock::now();
+            for (size_t i = 0; i < count; ++i) loopback.host.broadcast(message);
+            seconds += test::secondsSince(start);
+            sent += count;
+            loopback.drain(); // untimed, the clients' share
+        }
+        return sent / seconds;
+    }
+}
+
+TEST(client_encrypts_only_once_accepted)
+{
+    ClientApp app;
+    const size_t plain = app.maxPayload(0);
+    const crypto::KeyPair host_keys = crypto::KeyPair::generate();
+    app.receive(protocol::KeyExchangePackage(host_keys.public_key));
+    CHECK(app.maxPayload(0) == plain); // a host rejecting the USERNAME never sends the ACK
+
+    app.receive(protocol::UsernameAckPackage(2, 0, 1, 1, 0));
+    CHECK(app.maxPayload(0) < plain); // sealed from the ACK on
+}
+
+// RFC 7748 section 5.2: scalar multiplication, once & iterated
+TEST(x25519_matches_rfc7748_vectors)
+{
+    crypto::Key out;
+    CHECK(crypto::x25519(out, keyFromHex("a546e36bf0527c9d3b16154b82465edd62144c0ac1fc5a18506a2244ba449ac4"),
+        keyFromHex("e6db6867583030db3594c1a424b15f7c726624ec26b3353b10a903a6d0ab1c4c")));
+    CHECK(out == keyFromHex("c3da55379de9c6908e94ea4df28d084f32eccf03491c71f754b4075577a28552"));
+    CHECK(crypto::x25519(out, keyFromHex("4b66e9d4d1b4673c5ad22691957d6af5c11b6421e0ea01d42ca4169e7918ba0d"),
+        keyFromHex("e5210f12786811d3f4b7959d0538ae2c31dbe7106fc03c3efc4cd549c715a493")));
+    CHECK(out == keyFromHex("95cbde9476e8907d7aade45cb4b873f88b595a68799fa152e6f8f7647aac7957"));
+
+    crypto::Key k = { 9 }, u = { 9 };
+    for (int i = 1; i <= 1000; ++i)
+    {
+        CHECK(crypto::x25519(out, k, u));
+        u = k;
+        k = out;
+        if (i == 1) CHECK(k == keyFromHex("422c8e7a6227d7bca1350b3e2bb7279f7897b87bb6854b783c60e80311ae3079"));
+    }
+    CHECK(k == keyFromHex("684cf59ba83309552800ef566f2f4d3c1c3887c49360e3875f2eb94d99532c51"));
+}
+
+// RFC 7748 section 6.1: both sides of a Diffie-Hellman exchange
+TEST(x25519_agrees_on_the_rfc7748_shared_secret)
+{
+    const crypto::Key base = { 9 };
+    const crypto::Key alice = keyFromHex("77076d0a7318a57d3c16c17251b26645df4c2f87ebc0992ab177fba51db92c2a");
+    const crypto::Key bob = keyFromHex("5dab087e624a8a4b79e17f8b83800ee66f3bb1292618b6fd1c2f8b27ff88e0eb");
+    crypto::Key alice_public, bob_public, alice_shared, bob_shared;
+    CHECK(crypto::x25519(alice_public, alice, base) && crypto::x25519(bob_public, bob, base));
+    CHECK(alice_public == keyFromHex("8520f0098930a754748b7ddcb43ef75a0dbf3a0d26381af4eba4a98eaa9b4e6a"));
+    CHECK(bob_public == keyFromHex("de9edb7d7b7dc1b4d35b61c2ece435373f8343c85b78674dadfc7e146f882b4f"));
+    CHECK(crypto::x25519(alice_shared, alice, bob_public) && crypto::x25519(bob_shared, bob, alice_public));
+    CHECK(alice_shared == bob_shared);
+    CHECK(alice_shared == keyFromHex("4a5d9d5ba4ce2de1728e3bf480350f25e07e21c947d19e3376f09b3c1e161742"));
+}
+
+// RFC 8439 section 2.8.2: encryption (nonce constant 7, counter 0x4746454443424140)
+TEST(aead_seal_matches_rfc8439_vector)
+{
+    crypto::Key key;
+    for (size_t i = 0; i < key.size(); ++i) key[i] = static_cast<uint8_t>(0x80 + i);
+    const crypto::Aead aead(key, 7);
+    const std::vector<uint8_t> ad = fromHex("50515253c0c1c2c3c4c5c6c7");
+    const std::string text = "Ladies and Gentlemen of the class of '99: If I could offer you only one tip for the future, sunscreen would be it.";
+    std::vector<uint8_t> data(text.begin(), text.end());
+    uint8_t tag[crypto::TAG_SIZE];
+    aead.seal(0x4746454443424140, ad.data(), ad.size(), data.data(), data.size(), tag);
+    CHECK(data == fromHex("d31a8d34648e60db7b86afbc53ef7ec2a4aded51296e08fea9e2b5a736ee62d63dbea45e8ca9671282fafb69da92728b"
+        "1a71de0a9e060b2905d6a5b67ecd3b3692ddbd7f2d778b8c9803aee328091b58fab324e4fad675945585808b4831d7bc"
+        "3ff4def08e4b7a9de576d26586cec64b6116"));
+    CHECK(std::vector<uint8_t>(tag, tag + sizeof(tag)) == fromHex("1ae10b594f09e26a7e902ecbd0600691"));
+}
+
+// RFC 8439 appendix A.5: decryption (counter 0x0807060504030201), & a flipped bit failing it
+TEST(aead_open_matches_rfc8439_vector)
+{
+    const crypto::Aead aead(keyFromHex("1c9240a5eb55d38af333888604f6b5f0473917c1402b80099dca5cbc207075c0"));
+    const std::vector<uint8_t> ad = fromHex("f33388860000000000004e91");
+    const std::vector<uint8_t> ciphertext = fromHex(
+        "64a0861575861af460f062c79be643bd5e805cfd345cf389f108670ac76c8cb24c6cfc18755d43eea09ee94e382d26b0"
+        "bdb7b73c321b0100d4f03b7f355894cf332f830e710b97ce98c8a84abd0b948114ad176e008d33bd60f982b1ff37c855"
+        "9797a06ef4f0ef61c186324e2b3506383606907b6a7c02b0f9f6157b53c867e4b9166c767b804d46a59b5216cde7a4e9"
+        "9040c5a40433225ee282a1b0a06c523eaf4534d7f83fa1155b0047718cbc546a0d072b04b3564eea1b422273f548271a"
+        "0bb2316053fa76991955ebd63159434ecebb4e466dae5a1073a6727627097a1049e617d91d361094fa68f0ff77987130"
+        "305beaba2eda04df997b714d6c6f2c29a6ad5cb4022b02709b");
+    const std::vector<uint8_t> tag = fromHex("eead9d67890cbb22392336fea1851f38");
+    const uint64_t nonce = 0x0807060504030201;
+
+    std::vector<uint8_t> tampered = ciphertext;
+    tampered[100] ^= 0x01;
+    CHECK(!aead.open(nonce, ad.data(), ad.size(), tampered.data(), tampered.size(), tag.data()));
+    tampered[100] ^= 0x01;
+    CHECK(tampered == ciphertext); // untouched
+
+    std::vector<uint8_t> data = ciphertext;
+    CHECK(aead.open(nonce, ad.data(), ad.size(), data.data(), data.size(), tag.data()));
+    const std::string text(data.begin(), data.end());
+    CHECK(text == "Internet-Drafts are draft documents valid for a maximum of six months and may be updated, replaced, "
+        "or obsoleted by other documents at any time. It is inappropriate to use Internet-Drafts as reference "
+        "material or to cite them other than as /\xE2\x80\x9Cwork in progress./\xE2\x80\x9D");
+}
+
+// A session lets each sealed packet through once: tampered ones & replays of an accepted nonce are dropped
+TEST(session_rejects_tampered_and_replayed_packets)
+{
+    test::Loopback loopback(1);
+    const crypto::SessionKeys keys = { crypto::Key{ 1 }, crypto::Key{ 2 } };
+    loopback.host.startSession(0, keys);
+    const crypto::Aead client(keys.rx); // seals what the host opens
+    const std::string first = sealPacket(client, 0, "first"), second = sealPacket(client, 1, "second");
+    std::string tampered = second;
+    tampered[sizeof(uint64_t) + 2] ^= 0x01;
+
+    loopback.send(0, first);
+    loopback.send(0, tampered);
+    loopback.send(0, first); // replayed
+    loopback.send(0, second);
+    const test::Clock::time_point start = test::Clock::now();
+    while (loopback.received() + loopback.host.getStats().rejected < 4 && test::secondsSince(start) < 2.0) std::this_thread::yield();
+    CHECK(loopback.received() == 2);
+    CHECK(loopback.host.getStats().rejected == 2);
+}
+
+TEST(generated_keys_differ)
+{
+    const crypto::KeyPair a = crypto::KeyPair::generate();
+    const crypto::KeyPair b = crypto::KeyPair::generate();
+    CHECK(a.secret != b.secret && a.public_key != b.public_key);
+}
+
+BENCH(encryption_per_message)
+{
+    for (size_t size : { 64, 256, 1200 })
+    {
+        SealedMessage message(size);
+        const std::string label = std::to_string(size) + " B message, ";
+        CHECK(message.open());
+        const double open_ns = test::nsPerCall([&] { test::keep(message.open()); });
+        const double seal_ns = test::nsPerCall([&] { message.seal(); });
+        test::report(label + "seal", seal_ns, "ns");
+        test::report(label + "open", open_ns, "ns");
+        test::report(label + "seal throughput", size / seal_ns * 1000.0, "MB/s");
+    }
+    test::report("key pair generation", test::nsPerCall([] { test::keep(crypto::KeyPair::generate().public_key[0]); }) / 1000.0, "us");
+}
+
+// Host broadcasts of a chat line to connected peers: one shared packet when no peer has a
+// session, a sealed copy per peer once they all do (see ENetWrapper::broadcastLocked)
+BENCH(broadcast_encryption)
+{
+    const std::string message(96, 'm');
+    for (size_t peers : { 16, 256 })
+    {
+        test::Loopback loopback(peers);
+        const double plain = broadcastsPerSecond(loopback, message);
+        const crypto::SessionKeys keys = { crypto::Key{ 1 }, crypto::Key{ 2 } };
+        for (size_t i = 0; i < peers; ++i) loopback.host.startSession(static_cast<net::peer_id_t>(i), keys);
+        const double encrypted = broadcastsPerSecond(loopback, message);
+
+        const std::string label = std::to_string(peers) + " peers, ";
+        test::report(label + "plain", plain, "msg/s");
+        test::report(label + "encrypted", encrypted, "msg/s");
+        test::report(label + "encrypted, per peer", 1e9 / encrypted / peers, "ns");
+    }
+}
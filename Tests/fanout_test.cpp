@@ -0,0 +1,69 @@
+﻿#include <numeric>
+#include <thread>
+
+#include "test.h"
+#include "loopback.h"
+
+namespace
+{
+    // Services the clients until `expected` packets arrived (or a second passed), then a bit longer
+    // @return packets received
+    size_t receiveAll(test::Loopback& loopback, size_t expected)
+    {
+        size_t received = 0;
+        const test::Clock::time_point start = test::Clock::now();
+        while (received < expected && test::secondsSince(start) < 1.0) received += loopback.drain();
+        std::this_thread::sleep_for(std::chrono::milliseconds(20)); // anything extra
+        return received + loopback.drain();
+    }
+}
+
+TEST(send_to_many_reaches_only_the_listed_peers)
+{
+    test::Loopback loopback(8);
+    const std::vector<net::peer_id_t> peers = { 1, 3, 5 };
+    loopback.host.sendToMany(peers, std::string("hello"), true);
+    CHECK(receiveAll(loopback, peers.size()) == peers.size());
+
+    net::PeerSet set(loopback.size());
+    set.insert(0);
+    set.insert(7);
+    loopback.host.sendToMany(set, std::string("hello"), true);
+    CHECK(receiveAll(loopback, 2) == 2);
+}
+
+// One chat line to 1000 peers: a send per peer (a packet copy & a lock each) vs sendToMany
+// (one shared packet, one lock), w/ the recipients listed or as a PeerSet
+BENCH(send_to_1000_peers)
+{
+    const size_t PEERS = 1000;
+    test::Loopback loopback(PEERS);
+    std::vector<net::peer_id_t> peers(PEERS);
+    std::iota(peers.begin(), peers.end(), net::peer_id_t(0));
+    net::PeerSet set(PEERS);
+    for (net::peer_id_t peer_id : peers) set.insert(peer_id);
+    const net::NetworkTraffic message(reinterpret_cast<const enet_uint8*>("a typical short chat line"), 25);
+
+    // each round of sends is timed, the clients are drained in between
+    auto timed = [&](auto&& send)
+    {
+        double seconds = 0.0;
+        size_t rounds = 0;
+        while (seconds < 0.3 || rounds < 3)
+        {
+            const test::Clock::time_point start = test::Clock::now();
+            send();
+            seconds += test::secondsSince(start);
+            rounds++;
+            loopback.drain();
+        }
+        return seconds * 1e6 / rounds;
+    };
+    const double loop = timed([&] { for (net::peer_id_t peer_id : peers) loopback.host.send(peer_id, message); });
+    const double many = timed([&] { loopback.host.sendToMany(peers, message); });
+    const double peer_set = timed([&] { loopback.host.sendToMany(set, message); });
+
+    test::report("send loop", loop, "us");
+    test::report("sendToMany, peer IDs", many, "us");
+    test::report("sendToMany, PeerSet", peer_set, "us");
+}
@@ -0,0 +1,147 @@
+﻿#include <algorithm>
+
+#include "test.h"
+#include "host_session.h"
+#include "chat/message_history.h"
+
+namespace
+{
+    protocol::MessagePackage makeMessage(size_t i, size_t padding = 0)
+    {
+        return protocol::MessagePackage(static_cast<user_id_t>(1 + i % 7), "message " + std::to_string(i) + std::string(padding, '.'));
+    }
+
+    size_t serializedSize(const protocol::MessagePackage& pkg)
+    {
+        ByteStream s;
+        pkg.serialize(s);
+        return s.getLength();
+    }
+
+    // Number the kept messages carry, the oldest first
+    std::vector<size_t> keptNumbers(const MessageHistory& history)
+    {
+        std::vector<size_t> numbers;
+        history.forEach([&numbers](std::string_view packet)
+        {
+            ByteStream s(packet.data(), packet.length());
+            const protocol::MessagePackage pkg(s);
+            numbers.push_back(std::stoul(pkg.message.substr(pkg.message.find(' ') + 1)));
+        });
+        return numbers;
+    }
+
+    // Whether the numbers are first, first + 1, ... up to last
+    bool isRun(const std::vector<size_t>& numbers, size_t last)
+    {
+        if (numbers.empty() || numbers.back() != last) return false;
+        for (size_t i = 1; i < numbers.size(); ++i)
+        {
+            if (numbers[i] != numbers[i - 1] + 1) return false;
+        }
+        return true;
+    }
+}
+
+TEST(history_keeps_the_newest_messages_up_to_the_count)
+{
+    HistoryLimits limits;
+    limits.max_messages = 5;
+    MessageHistory history(limits);
+    for (size_t i = 0; i < 12; ++i) history.add(makeMessage(i));
+    CHECK(history.size() == 5);
+    CHECK(keptNumbers(history) == std::vector<size_t>({ 7, 8, 9, 10, 11 }));
+}
+
+// Messages of varying sizes, so the byte ring wraps at all points
+TEST(history_keeps_the_newest_messages_up_to_the_bytes)
+{
+    HistoryLimits limits;
+    limits.max_messages = 1000;
+    limits.max_bytes = 1000;
+    MessageHistory history(limits);
+    for (size_t i = 0; i < 500; ++i)
+    {
+        history.add(makeMessage(i, i * 37 % 150));
+        const std::vector<size_t> kept = keptNumbers(history);
+        CHECK(isRun(kept, i));
+
+        size_t bytes = 0;
+        for (size_t number : kept) bytes += serializedSize(makeMessage(number, number * 37 % 150));
+        CHECK(bytes <= limits.max_bytes);
+        CHECK(kept.size() >= std::min<size_t>(i + 1, 5)); // ~100 B each, a wrap drops a few at most
+    }
+}
+
+TEST(history_skips_messages_too_large_to_keep)
+{
+    HistoryLimits limits;
+    limits.max_bytes = 64;
+    MessageHistory history(limits);
+    history.add(makeMessage(1));
+    history.add(makeMessage(2, 100));
+    CHECK(keptNumbers(history) == std::vector<size_t>({ 1 }));
+
+    limits.max_messages = 0;
+    MessageHistory none(limits);
+    none.add(makeMessage(1));
+    CHECK(none.empty());
+}
+
+TEST(history_batches_split_at_max_bytes)
+{
+    const size_t MAX_BYTES = 300;
+    HistoryLimits limits;
+    MessageHistory history(limits);
+    for (size_t i = 0; i < 40; ++i) history.add(makeMessage(i, i == 20 ? 400 : i % 30));
+
+    std::vector<size_t> numbers;
+    size_t batches = 0;
+    history.forEachBatch(MAX_BYTES, [&](const std::string& packet)
+    {
+        ByteStream s(packet.data(), packet.length());
+        const protocol::MessageBatchPackage batch(s);
+        CHECK(packet.length() <= MAX_BYTES || batch.messages.size() == 1); // only an oversized message stands alone
+        for (const protocol::MessagePackage& pkg : batch.messages)
+        {
+            numbers.push_back(std::stoul(pkg.message.substr(pkg.message.find(' ') + 1)));
+            CHECK(pkg.user_id == makeMessage(numbers.back()).user_id);
+        }
+        batches++;
+    });
+    CHECK(batches > 3);
+    CHECK(numbers.size() == 40 && isRun(numbers, 39));
+}
+
+// A newcomer gets live lines only once it has the history: a line said while it's set up,
+// after it joined the lobby but before the catch-up, arrives once, w/ the history
+TEST(host_holds_back_live_lines_until_a_newcomer_has_the_history)
+{
+    test::HostSession session;
+    const size_t max_text = session.app.maxBroadcastPayload() - protocol::MessageBatchPackage::HEADER_SIZE - protocol::MessageBatchPackage::ENTRY_HEADER_SIZE;
+    size_t lines = 0;
+    auto say = [&]
+    {
+        // fills a batch, so it's sent right away
+        const std::string line = "line " + std::to_string(lines++) + " ";
+        session.host->handleInput(line + std::string(max_text - line.length(), '.'));
+    };
+    for (size_t i = 0; i < 3; ++i) say();
+    session.host->synced = [&](user_id_t) { say(); };
+
+    std::vector<size_t> clients;
+    for (size_t i = 0; i < 4; ++i) clients.push_back(session.join("user" + std::to_string(i), 0));
+    session.host->synced = nullptr;
+    say();
+    session.settle();
+
+    for (size_t client : clients)
+    {
+        std::vector<size_t> numbers;
+        for (const protocol::MessagePackage& pkg : session.received<protocol::MessagePackage>(client))
+        {
+            numbers.push_back(std::stoul(pkg.message.substr(pkg.message.find(' ') + 1)));
+        }
+        CHECK(numbers.size() == lines && isRun(numbers, lines - 1));
+    }
+}
@@ -0,0 +1,186 @@
+﻿#pragma once
+
+#include <atomic>
+#include <functional>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "test.h"
+#include "chat/state/chat_state_host.h"
+
+namespace test
+{
+    /**
+     * A ChatApp hosting a session (ChatState_Host) w/ raw ENet clients joining it over loopback
+     *
+     * For tests of what the host sends to whom: clients pick their capabilities (w/o
+     * CAP_MESSAGE_BATCH they get plain MESSAGE packets) & keep everything the host sends
+     * them, until cleared.
+     */
+    class HostSession
+    {
+    public:
+        // The host state, w/ the network thread's ticks on hold while paused: queued lines
+        // & presence changes stay pending until it's resumed
+        class Host : public ChatState_Host
+        {
+        public:
+            Host(ChatApp* app) : ChatState_Host(app) {}
+
+            void tick() override
+            {
+                if (!paused) ChatState_Host::tick();
+            }
+
+            std::atomic<bool> paused{ false };
+            std::function<void(user_id_t)> synced; ///< called on the network thread once a newcomer's user list is synced, before it gets the history
+
+        protected:
+            void syncUserList(user_id_t user_id, uint32_t capabilities, uint32_t known_epoch, uint32_t known_version) override
+            {
+                ChatState_Host::syncUserList(user_id, capabilities, known_epoch, known_version);
+                if (synced) synced(user_id);
+            }
+        };
+
+        struct Client
+        {
+            ENetHost* host = nullptr;
+            ENetPeer* peer = nullptr;
+            bool connected = false;
+            user_id_t user_id = 0;             ///< assigned by the USERNAME_ACK
+            std::vector<std::string> received; ///< packets from the host, in order
+        };
+
+        HostSession()
+        {
+            app.getConfig()->checksum = false;
+            app.getConfig()->encryption = false;
+            app.goToState(host = new Host(&app));
+        }
+
+        ~HostSession()
+        {
+            for (Client& client : m_clients)
+            {
+                if (client.peer) enet_peer_disconnect(client.peer, 0);
+                enet_host_destroy(client.host);
+            }
+        }
+
+        // Connects a client, sends its USERNAME & waits for the USERNAME_ACK
+        // @return the client's index
+        size_t join(const std::string& name, uint32_t capabilities, uint32_t roster_epoch = 0, uint32_t known_version = 0)
+        {
+            ENetAddress address;
+            enet_address_set_host(&address, "127.0.0.1");
+            address.port = protocol::DEFAULT_PORT;
+            Client client;
+            client.host = enet_host_create(NULL, 1, 1, 0, 0);
+            client.peer = client.host ? enet_host_connect(client.host, &address, 1, 0) : NULL;
+            if (!client.peer) throw std::runtime_error("session client failed");
+            m_clients.push_back(client);
+            const size_t index = m_clients.size() - 1;
+
+            const Clock::time_point start = Clock::now();
+            while (!m_clients[index].connected)
+            {
+                if (secondsSince(start) > 2.0) throw std::runtime_error("session client didn't connect");
+                pump();
+            }
+            protocol::UsernamePackage username(name, roster_epoch, known_version);
+            username.capabilities = capabilities;
+            send(index, username);
+            if (!await<protocol::UsernameAckPackage>(index)) throw std::runtime_error("session client wasn't accepted");
+            m_clients[index].user_id = received<protocol::UsernameAckPackage>(index).back().assigned_user_id;
+            return index;
+        }
+
+        // Disconnects a client, the host hears of it on its next service
+        void leave(size_t index)
+        {
+            enet_peer_disconnect(m_clients[index].peer, 0);
+            m_clients[index].peer = NULL;
+        }
+
+        template <typename Pkg>
+        void send(size_t index, const Pkg& pkg)
+        {
+            ByteStream s;
+            pkg.serialize(s);
+            enet_peer_send(m_clients[index].peer, 0, enet_packet_create(s.getBufPtr(), s.getLength(), ENET_PACKET_FLAG_RELIABLE));
+            enet_host_flush(m_clients[index].host);
+        }
+
+        // Packages of a type a client received, decoded
+        template <typename Pkg>
+        std::vector<Pkg> received(size_t index) const
+        {
+            std::vector<Pkg> packages;
+            for (const std::string& packet : m_clients[index].received)
+            {
+                if (packet.empty() || static_cast<uint8_t>(packet[0]) != Pkg::TYPE) continue;
+                ByteStream s(packet.data(), packet.length());
+                packages.emplace_back(s);
+            }
+            return packages;
+        }
+
+        // Services the clients until one got a package of a type matching `match` (or `timeout` passed)
+        template <typename Pkg, typename Match>
+        bool await(size_t index, Match match, double timeout = 2.0)
+        {
+            const Clock::time_point start = Clock::now();
+            while (true)
+            {
+                for (const Pkg& pkg : received<Pkg>(index))
+                {
+                    if (match(pkg)) return true;
+                }
+                if (secondsSince(start) > timeout) return false;
+                pump();
+            }
+        }
+
+        template <typename Pkg>
+        bool await(size_t index, double timeout = 2.0)
+        {
+            return await<Pkg>(index, [](const Pkg&) { return true; }, timeout);
+        }
+
+        // Services the clients for a while, e.g. so whatever else was sent arrives
+        void settle(double seconds = 0.05)
+        {
+            const Clock::time_point start = Clock::now();
+            while (secondsSince(start) < seconds) pump();
+        }
+
+        void clear(size_t index) { m_clients[index].received.clear(); }
+        const Client& client(size_t index) const { return m_clients[index]; }
+
+        ChatApp app;
+        Host* host = nullptr; ///< owned by app
+
+    private:
+        // Services each client once, keeping what they received
+        void pump()
+        {
+            ENetEvent event;
+            for (Client& client : m_clients)
+            {
+                while (enet_host_service(client.host, &event, 0) > 0)
+                {
+                    if (event.type == ENET_EVENT_TYPE_CONNECT) client.connected = true;
+                    if (event.type != ENET_EVENT_TYPE_RECEIVE) continue;
+                    client.received.emplace_back(reinterpret_cast<const char*>(event.packet->data), event.packet->dataLength);
+                    enet_packet_destroy(event.packet);
+                }
+            }
+            std::this_thread::sleep_for(std::chrono::microseconds(100));
+        }
+
+        std::vector<Client> m_clients;
+    };
+}
@@ -0,0 +1,105 @@
+﻿#include "test.h"
+#include "chat/input_box.h"
+
+namespace
+{
+    // Feeds text byte by byte, as ncurses' wgetch hands over UTF-8 input
+    void type(InputBox& box, const std::string& text)
+    {
+        for (char byte : text) box.handleKey(static_cast<unsigned char>(byte));
+    }
+
+    // Completes the line being edited
+    std::string enter(InputBox& box)
+    {
+        box.handleKey('\n');
+        std::string line;
+        CHECK(box.popLine(line));
+        return line;
+    }
+}
+
+TEST(input_box_edits_whole_characters)
+{
+    InputBox box;
+    type(box, "a\xC3\xA9\xE2\x82\xAC" "b"); // a, é, €, b
+    box.handleKey(KEY_LEFT);
+    box.handleKey(KEY_BACKSPACE); // €
+    box.handleKey(KEY_LEFT);
+    box.handleKey(KEY_DC); // é
+    CHECK(enter(box) == "ab");
+
+    type(box, "\xF0\x9F\x98\x80x"); // emoji, x
+    box.handleKey(KEY_HOME);
+    box.handleKey(KEY_RIGHT);
+    type(box, "-");
+    box.handleKey(KEY_END);
+    box.handleKey(KEY_LEFT);
+    box.handleKey(KEY_LEFT);
+    box.handleKey(KEY_DC); // '-'
+    CHECK(enter(box) == "\xF0\x9F\x98\x80x");
+}
+
+// Wide curses builds hand over code points, narrow ones may hand over Latin-1 bytes
+TEST(input_box_encodes_key_codes_as_utf8)
+{
+    InputBox box;
+    box.handleKey(0x20AC); // €
+    box.handleKey(0x1F600); // emoji
+    CHECK(enter(box) == "\xE2\x82\xAC\xF0\x9F\x98\x80");
+
+    box.handleKey(0xE9); // é, or the lead byte of a 3-byte sequence
+    box.handleKey('!');
+    box.handleKey(0xA9); // ©, a continuation byte w/o a lead
+    CHECK(enter(box) == "\xC3\xA9!\xC2\xA9");
+
+    CHECK(!box.handleKey(KEY_F(1)));
+    box.handleKey(0xC3); // cut short by Enter
+    CHECK(enter(box) == "\xC3\x83");
+}
+
+TEST(input_box_browses_history)
+{
+    InputBox box;
+    type(box, "one");
+    enter(box);
+    type(box, "two");
+    enter(box);
+    type(box, "two");
+    enter(box); // repeats are kept once
+    type(box, "draft");
+
+    box.handleKey(KEY_UP);
+    CHECK(enter(box) == "two");
+    box.handleKey(KEY_UP);
+    box.handleKey(KEY_UP);
+    box.handleKey(KEY_UP); // stays at the oldest
+    CHECK(enter(box) == "one");
+
+    type(box, "draft");
+    box.handleKey(KEY_UP);
+    box.handleKey(KEY_UP);
+    box.handleKey(KEY_DOWN);
+    box.handleKey(KEY_DOWN); // back to the new line
+    CHECK(enter(box) == "draft");
+
+    box.handleKey(KEY_UP);
+    box.handleKey(KEY_BACKSPACE);
+    type(box, "!");
+    CHECK(enter(box) == "draf!");
+    box.handleKey(KEY_UP);
+    box.handleKey(KEY_UP);
+    CHECK(enter(box) == "draft"); // the recalled entry is left as it was
+}
+
+TEST(input_box_keeps_a_bounded_history)
+{
+    InputBox box;
+    for (size_t i = 0; i < InputBox::MAX_HISTORY + 10; ++i)
+    {
+        type(box, std::to_string(i));
+        enter(box);
+    }
+    for (size_t i = 0; i < InputBox::MAX_HISTORY + 10; ++i) box.handleKey(KEY_UP);
+    CHECK(enter(box) == "10");
+}
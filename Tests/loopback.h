@@ -0,0 +1,90 @@
+﻿#pragma once
+
+#include <atomic>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "test.h"
+#include "network/enet_wrapper.h"
+
+namespace test
+{
+    /**
+     * A hosting ENetWrapper w/ raw ENet clients connected to it over loopback
+     *
+     * For benchmarks of the host's send paths: everything the host sends reaches real
+     * peers, & piles up on the clients until drain() services them. Packets the clients
+     * send are counted once the host's network thread receives them.
+     */
+    class Loopback : net::NetworkListener
+    {
+    public:
+        static constexpr int PORT = 47390;
+
+        explicit Loopback(size_t clients) : host(*this, true, PORT, NULL, static_cast<int>(clients))
+        {
+            ENetAddress address;
+            enet_address_set_host(&address, "127.0.0.1");
+            address.port = PORT;
+            for (size_t i = 0; i < clients; ++i)
+            {
+                ENetHost* client = enet_host_create(NULL, 1, 1, 0, 0);
+                ENetPeer* peer = client ? enet_host_connect(client, &address, 1, 0) : NULL;
+                if (!peer) throw std::runtime_error("loopback client failed");
+                m_clients.push_back(client);
+                m_peers.push_back(peer);
+            }
+            const Clock::time_point start = Clock::now();
+            while (m_connected < clients)
+            {
+                if (secondsSince(start) > 10.0) throw std::runtime_error("loopback clients didn't connect");
+                drain();
+            }
+        }
+
+        ~Loopback()
+        {
+            for (ENetHost* client : m_clients) enet_host_destroy(client);
+        }
+
+        // Services the clients, dropping what they received
+        // @return packets received
+        size_t drain()
+        {
+            size_t received = 0;
+            ENetEvent event;
+            for (ENetHost* client : m_clients)
+            {
+                while (enet_host_service(client, &event, 0) > 0)
+                {
+                    if (event.type != ENET_EVENT_TYPE_RECEIVE) continue;
+                    enet_packet_destroy(event.packet);
+                    received++;
+                }
+            }
+            return received;
+        }
+
+        // Sends a packet from a client to the host, reliably
+        void send(size_t client, const std::string& packet)
+        {
+            enet_peer_send(m_peers[client], 0, enet_packet_create(packet.data(), packet.length(), ENET_PACKET_FLAG_RELIABLE));
+            enet_host_flush(m_clients[client]);
+        }
+
+        size_t size() const { return m_clients.size(); }
+        size_t received() const { return m_received; }
+
+        net::ENetWrapper host;
+
+    private:
+        void connectionEvent(net::NetworkTraffic const& e) override { m_connected++; }
+        void receiveEvent(net::NetworkTraffic const& e) override { m_received++; }
+
+        std::vector<ENetHost*> m_clients;
+        std::vector<ENetPeer*> m_peers;       ///< each client's peer, the host
+        std::atomic<size_t> m_connected{ 0 }; ///< peers the host saw connect
+        std::atomic<size_t> m_received{ 0 };  ///< packets the host let through
+    };
+}
@@ -0,0 +1,45 @@
+﻿#include <cstring>
+#include <exception>
+
+#include "test.h"
+#include "network/enet_wrapper.h"
+
+// Runs the tests, & the benchmarks w/ --bench. Other arguments select cases by name (substring)
+int main(int argc, char* argv[])
+{
+    net::ENetContainer enet; // initialize ENet
+
+    bool benchmarks = false;
+    std::vector<const char*> filters;
+    for (int i = 1; i < argc; ++i)
+    {
+        if (strcmp(argv[i], "--bench") == 0) benchmarks = true;
+        else filters.push_back(argv[i]);
+    }
+
+    int failed = 0, run = 0;
+    for (const test::Case& c : test::cases())
+    {
+        if (c.bench && !benchmarks) continue;
+        bool selected = filters.empty();
+        for (const char* filter : filters) selected |= strstr(c.name, filter) != nullptr;
+        if (!selected) continue;
+
+        std::printf("%s %s\n", c.bench ? "[bench]" : "[test] ", c.name);
+        std::fflush(stdout);
+        const int failures = test::failures();
+        try
+        {
+            c.function();
+        }
+        catch (const std::exception& e)
+        {
+            test::fail(c.name, 0, e.what());
+        }
+        run++;
+        if (test::failures() != failures) failed++;
+    }
+
+    std::printf("%d of %d cases passed\n", run - failed, run);
+    return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
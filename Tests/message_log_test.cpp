@@ -0,0 +1,226 @@
+﻿#include <algorithm>
+#include <filesystem>
+#include <thread>
+
+#include "test.h"
+#include "chat/message_log.h"
+#include "chat/state/chat_state_host.h"
+#include "util/byte_stream.h"
+
+namespace
+{
+    // A fresh directory under the system's temporary one, removed w/ its content
+    struct TempDirectory
+    {
+        std::filesystem::path path;
+
+        TempDirectory()
+        {
+            const auto ticks = test::Clock::now().time_since_epoch().count();
+            path = std::filesystem::temp_directory_path() / ("enetchat_log_" + std::to_string(ticks));
+        }
+
+        ~TempDirectory()
+        {
+            std::error_code error;
+            std::filesystem::remove_all(path, error);
+        }
+    };
+
+    protocol::MessagePackage makeMessage(uint64_t i)
+    {
+        return protocol::MessagePackage(static_cast<user_id_t>(1 + i % 7), "logged message number " + std::to_string(i));
+    }
+
+    void appendMessages(MessageLog& log, uint64_t first, uint64_t count, size_t per_batch)
+    {
+        std::vector<protocol::MessagePackage> batch;
+        for (uint64_t i = first; i < first + count; i += batch.size())
+        {
+            batch.clear();
+            for (uint64_t j = i; j < std::min(first + count, i + per_batch); ++j) batch.push_back(makeMessage(j));
+            log.append(batch);
+        }
+    }
+
+    // Waits for the writer to commit up to `committed` messages
+    bool waitForCommit(const MessageLog& log, uint64_t committed)
+    {
+        const test::Clock::time_point start = test::Clock::now();
+        while (log.getStats().committed < committed)
+        {
+            if (test::secondsSince(start) > 5.0) return false;
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+        return true;
+    }
+
+    // Reads messages back, checking they're the ones appended
+    // @return the sequence numbers read
+    std::vector<uint64_t> readBack(const MessageLog& log, uint64_t seq, size_t max_count)
+    {
+        std::vector<uint64_t> read;
+        log.forEachSince(seq, max_count, [&](uint64_t i, std::string_view packet)
+        {
+            ByteStream s(packet.data(), packet.length());
+            const protocol::MessagePackage pkg(s);
+            const protocol::MessagePackage expected = makeMessage(i);
+            CHECK(pkg.user_id == expected.user_id && pkg.message == expected.message);
+            read.push_back(i);
+        });
+        return read;
+    }
+
+    bool isRange(const std::vector<uint64_t>& seqs, uint64_t first, uint64_t count)
+    {
+        if (seqs.size() != count) return false;
+        for (size_t i = 0; i < seqs.size(); ++i) if (seqs[i] != first + i) return false;
+        return true;
+    }
+}
+
+TEST(message_log_is_opt_in)
+{
+    CHECK(MessageLogConfig().directory.empty());
+}
+
+TEST(message_log_reads_back_from_any_sequence_number)
+{
+    TempDirectory directory;
+    MessageLogConfig config;
+    config.directory = directory.path.string();
+    config.segment_size = 4096; // ~100 records each, so reads cross segments
+    config.sync = MessageLogConfig::SYNC_NEVER;
+
+    MessageLog log;
+    CHECK(log.open(config));
+    appendMessages(log, 0, 1000, 10);
+    CHECK(waitForCommit(log, 1000));
+    CHECK(log.getStats().segments > 5);
+
+    CHECK(isRange(readBack(log, 0, 2000), 0, 1000));
+    CHECK(isRange(readBack(log, 517, 5), 517, 5));   // past an index entry, mid-segment
+    CHECK(isRange(readBack(log, 64, 100), 64, 100)); // on an index entry
+    CHECK(isRange(readBack(log, 998, 10), 998, 2));
+    CHECK(readBack(log, 1000, 10).empty());
+
+    // reopened, the log resumes after its last record
+    log.close();
+    CHECK(log.open(config));
+    CHECK(log.getStats().committed == 1000);
+    appendMessages(log, 1000, 10, 10);
+    CHECK(waitForCommit(log, 1010));
+    CHECK(isRange(readBack(log, 990, 100), 990, 20));
+}
+
+// Appends the writer can't keep up w/ are dropped & counted, rather than buffered w/o bound
+TEST(message_log_drops_appends_past_max_pending)
+{
+    TempDirectory directory;
+    MessageLogConfig config;
+    config.directory = directory.path.string();
+    config.max_pending = 1000; // ~30 records
+    config.sync = MessageLogConfig::SYNC_NEVER;
+
+    MessageLog log;
+    CHECK(log.open(config));
+    appendMessages(log, 0, 1000, 1000); // in one go, the writer can't take any in between
+    log.close();
+    const MessageLogStats stats = log.getStats();
+    CHECK(stats.committed > 0 && stats.dropped > 0);
+    CHECK(stats.committed + stats.dropped == 1000);
+}
+
+// Lines the host queued but didn't send yet are logged too, the log is closed w/ the state
+TEST(host_state_commits_pending_messages_when_destroyed)
+{
+    const size_t LINES = 500;
+    TempDirectory directory;
+    ChatApp app;
+    app.getConfig()->checksum = false;
+    app.getConfig()->encryption = false;
+    app.getConfig()->log.directory = directory.path.string();
+    ChatState_Host* host = new ChatState_Host(&app);
+    app.goToState(host);
+    for (size_t i = 0; i < LINES; ++i) host->handleInput("line " + std::to_string(i));
+    app.goToState(new State(&app)); // deletes the host state
+
+    MessageLog log;
+    MessageLogConfig config = app.getConfig()->log;
+    CHECK(log.open(config));
+    CHECK(log.getStats().committed == LINES);
+    size_t read = 0;
+    log.forEachSince(0, LINES, [&](uint64_t seq, std::string_view packet)
+    {
+        ByteStream s(packet.data(), packet.length());
+        const protocol::MessagePackage pkg(s);
+        CHECK(pkg.user_id == 0 && pkg.message == "line " + std::to_string(seq));
+        read++;
+    });
+    CHECK(read == LINES);
+}
+
+// The host's message rate at 100k msg/s, appended as the host does: a batch per ~1 ms tick.
+// Then the most the writer commits when appends never pause
+BENCH(message_log_100k_per_second)
+{
+    const uint64_t RATE = 100000;
+    const size_t PER_TICK = 100;
+    TempDirectory directory;
+    MessageLogConfig config;
+    config.directory = directory.path.string();
+
+    for (MessageLogConfig::Sync sync : { MessageLogConfig::SYNC_INTERVAL, MessageLogConfig::SYNC_COMMIT })
+    {
+        config.sync = sync;
+        MessageLog log;
+        if (!log.open(config)) throw std::runtime_error("can't open the log in " + config.directory);
+        const uint64_t base = log.getStats().committed;
+        std::vector<double> append_us;
+        uint64_t appended = 0;
+        const test::Clock::time_point start = test::Clock::now();
+        while (appended < RATE)
+        {
+            const uint64_t due = std::min(RATE, static_cast<uint64_t>(test::secondsSince(start) * RATE) + PER_TICK);
+            if (appended < due)
+            {
+                const test::Clock::time_point call = test::Clock::now();
+                appendMessages(log, appended, due - appended, PER_TICK);
+                append_us.push_back(test::secondsSince(call) * 1e6);
+                appended = due;
+            }
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+        const double elapsed = test::secondsSince(start);
+        const uint64_t lag = appended - (log.getStats().committed - base);
+        waitForCommit(log, base + appended);
+        const MessageLogStats stats = log.getStats();
+
+        std::sort(append_us.begin(), append_us.end());
+        const std::string label = sync == MessageLogConfig::SYNC_INTERVAL ? "sync every 1s, " : "sync every commit, ";
+        test::report(label + "messages/s", appended / elapsed, "msg/s");
+        test::report(label + "append per tick, p50", append_us[append_us.size() / 2], "us");
+        test::report(label + "append per tick, p99", append_us[append_us.size() * 99 / 100], "us");
+        test::report(label + "uncommitted at the end", static_cast<double>(lag), "msgs");
+        test::report(label + "group commits", static_cast<double>(stats.commits), "commits");
+        test::report(label + "dropped", static_cast<double>(stats.dropped), "msgs");
+    }
+
+    {
+        config.sync = MessageLogConfig::SYNC_INTERVAL;
+        MessageLog log;
+        if (!log.open(config)) throw std::runtime_error("can't open the log in " + config.directory);
+        const uint64_t base = log.getStats().committed;
+        uint64_t appended = 0;
+        const test::Clock::time_point start = test::Clock::now();
+        while (test::secondsSince(start) < 0.5)
+        {
+            appendMessages(log, appended, PER_TICK * 10, PER_TICK);
+            appended += PER_TICK * 10;
+        }
+        const uint64_t dropped = log.getStats().dropped;
+        waitForCommit(log, base + appended - dropped);
+        test::report("unthrottled, committed", (appended - dropped) / test::secondsSince(start), "msg/s");
+        test::report("unthrottled, dropped past max_pending", static_cast<double>(dropped), "msgs");
+    }
+}
@@ -0,0 +1,254 @@
+﻿#include "test.h"
+#include "chat/userinfo.h"
+#include "network/protocol.h"
+#include "util/utf8.h"
+
+namespace
+{
+    template <typename... Pkgs>
+    constexpr size_t packageCount(protocol::PackageList<Pkgs...>) { return sizeof...(Pkgs); }
+
+    // Serializes a package & decodes it back, checking that the decoded package re-serializes to the
+    // same bytes, consumes all of them, and (unless large) that every truncation of them is rejected
+    template <typename Pkg>
+    Pkg roundTrip(const Pkg& pkg, bool truncations = true)
+    {
+        ByteStream s;
+        pkg.serialize(s);
+        CHECK(s.getLength() > 0 && s.getBufPtr()[0] == Pkg::TYPE);
+        for (size_t length = 0; truncations && length < s.getLength(); ++length)
+        {
+            ByteStream truncated(s.getBufPtr(), length);
+            CHECK_THROWS(Pkg(truncated), std::out_of_range);
+        }
+
+        ByteStream in(s.getBufPtr(), s.getLength());
+        Pkg decoded(in);
+        CHECK(in.end());
+        CHECK(decoded.packet_type == Pkg::TYPE);
+        ByteStream again;
+        decoded.serialize(again);
+        CHECK(again.getBuf() == s.getBuf());
+        return decoded;
+    }
+
+    std::vector<UserInfo> someUsers()
+    {
+        return { UserInfo(1, "alice"), UserInfo(300, "bob"), UserInfo(65535, std::string("\xc3\xa9ric")) };
+    }
+
+    // Text mixing 1 to 4 byte UTF-8 characters: a, é, €, emoji
+    std::string mixedText(size_t characters)
+    {
+        static const char* const CHARACTERS[] = { "a", "\xC3\xA9", "\xE2\x82\xAC", "\xF0\x9F\x98\x80" };
+        std::string text;
+        for (size_t i = 0; i < characters; ++i) text += CHARACTERS[i * 7 % 11 % 4];
+        return text;
+    }
+
+    // Checks that chunks put back together give the text, are cut between characters,
+    // hold at most max_bytes & are as long as they may be
+    void checkSplit(const std::string& text, const std::vector<std::string>& chunks, size_t max_bytes)
+    {
+        std::string joined;
+        for (size_t i = 0; i < chunks.size(); ++i)
+        {
+            const std::string& chunk = chunks[i];
+            CHECK(chunk.length() <= max_bytes);
+            CHECK(!chunk.empty() && !utf8::isContinuation(chunk[0]));
+            if (i + 1 < chunks.size()) CHECK(chunk.length() + utf8::sequenceLength(chunks[i + 1][0]) > max_bytes);
+            joined += chunk;
+        }
+        CHECK(joined == text);
+    }
+}
+
+TEST(every_package_round_trips)
+{
+    size_t checked = 0;
+
+    const protocol::UsernamePackage username = roundTrip(protocol::UsernamePackage("alice", 7, 42));
+    CHECK(username.username == "alice" && username.roster_epoch == 7 && username.known_version == 42);
+    CHECK(username.protocol_version == protocol::PROTOCOL_VERSION && username.capabilities == protocol::LOCAL_CAPABILITIES);
+    checked++;
+
+    const protocol::UsernameAckPackage ack = roundTrip(protocol::UsernameAckPackage(5, protocol::CAP_ROOMS, 7, 42, 3));
+    CHECK(ack.assigned_user_id == 5 && ack.capabilities == protocol::CAP_ROOMS && ack.roster_version == 42 && ack.page_count == 3);
+    checked++;
+
+    const protocol::AddUserPackage add = roundTrip(protocol::AddUserPackage(UserInfo(9, "carol")));
+    CHECK(add.user.user_id == 9 && add.user.name == "carol");
+    checked++;
+
+    CHECK(roundTrip(protocol::RemoveUserPackage(9)).user_id == 9);
+    checked++;
+
+    const protocol::MessagePackage message = roundTrip(protocol::MessagePackage(3, std::string("hi\0there", 8)));
+    CHECK(message.user_id == 3 && message.message == std::string("hi\0there", 8));
+    checked++;
+
+    protocol::UserDeltaPackage delta(4, 6);
+    delta.removed = { 2, 8 };
+    delta.added = someUsers();
+    const protocol::UserDeltaPackage delta_out = roundTrip(delta);
+    CHECK(delta_out.from_version == 4 && delta_out.to_version == 6 && delta_out.removed == delta.removed);
+    CHECK(delta_out.added.size() == 3 && delta_out.added[2].user_id == 65535 && delta_out.added[2].name == delta.added[2].name);
+    checked++;
+
+    protocol::UserListPagePackage page(42, 1, 2);
+    page.users = someUsers();
+    const protocol::UserListPagePackage page_out = roundTrip(page);
+    CHECK(page_out.roster_version == 42 && page_out.page_index == 1 && page_out.page_count == 2 && page_out.users.size() == 3);
+    checked++;
+
+    protocol::MessageBatchPackage batch;
+    batch.messages = { protocol::MessagePackage(1, "one"), protocol::MessagePackage(2, "") };
+    const protocol::MessageBatchPackage batch_out = roundTrip(batch);
+    CHECK(batch_out.messages.size() == 2 && batch_out.messages[1].user_id == 2 && batch_out.messages[1].message.empty());
+    checked++;
+
+    protocol::MessageBatchVarintPackage varint;
+    varint.messages = { protocol::MessagePackage(1, "one"), protocol::MessagePackage(65535, std::string(300, 'x')) };
+    const protocol::MessageBatchVarintPackage varint_out = roundTrip(varint);
+    CHECK(varint_out.messages.size() == 2 && varint_out.messages[1].user_id == 65535 && varint_out.messages[1].message.length() == 300);
+    checked++;
+
+    const protocol::DictionaryPackage dictionary = roundTrip(protocol::DictionaryPackage(3, std::string("hello\0world", 11)));
+    CHECK(dictionary.version == 3 && dictionary.entries.length() == 11);
+    checked++;
+
+    crypto::Key key;
+    for (size_t i = 0; i < key.size(); ++i) key[i] = static_cast<uint8_t>(i * 7);
+    crypto::Key key_out;
+    CHECK(roundTrip(protocol::KeyExchangePackage(key)).getKey(key_out) && key_out == key);
+    checked++;
+
+    CHECK(roundTrip(protocol::JoinRoomPackage("games")).room == "games");
+    checked++;
+
+    const protocol::RoomMembersPackage members = roundTrip(protocol::RoomMembersPackage("games", 70000, 0xCAFEF00D, 12, 3));
+    CHECK(members.room == "games" && members.member_count == 70000 && members.roster_epoch == 0xCAFEF00D);
+    CHECK(members.roster_version == 12 && members.page_count == 3);
+    checked++;
+
+    const protocol::DirectMessagePackage direct = roundTrip(protocol::DirectMessagePackage("bob", "psst", protocol::DirectMessagePackage::QUEUED));
+    CHECK(direct.peer == "bob" && direct.message == "psst" && direct.status == protocol::DirectMessagePackage::QUEUED);
+    checked++;
+
+    CHECK(checked == packageCount(protocol::Packages())); // a new package needs a case here
+}
+
+TEST(encoding_more_elements_than_the_count_holds_throws)
+{
+    protocol::UserDeltaPackage delta(1, 2);
+    delta.removed.assign(UINT16_MAX, 1);
+    CHECK(roundTrip(delta, false).removed.size() == UINT16_MAX);
+
+    delta.removed.push_back(1);
+    ByteStream overflow;
+    CHECK_THROWS(delta.serialize(overflow), std::length_error);
+}
+
+// Encoding & decoding cost of the busiest packages through the field-derived codec
+BENCH(codec_per_package)
+{
+    uint64_t sum = 0;
+    ByteStream s;
+    auto bench = [&](const std::string& what, const auto& pkg)
+    {
+        typedef std::decay_t<decltype(pkg)> Pkg;
+        test::report(what + ", encode", test::nsPerCall([&]()
+        {
+            s.clear();
+            pkg.serialize(s);
+            sum += s.getLength();
+        }), "ns");
+        s.clear();
+        pkg.serialize(s);
+        test::report(what + ", decode", test::nsPerCall([&]()
+        {
+            s.resetPtr();
+            Pkg decoded(s);
+            sum += decoded.packet_type;
+        }), "ns");
+    };
+
+    bench("MESSAGE", protocol::MessagePackage(1, "a typical short chat line"));
+    protocol::MessageBatchPackage batch;
+    batch.messages.assign(16, protocol::MessagePackage(1, "a typical short chat line"));
+    bench("MESSAGE_BATCH of 16", batch);
+    protocol::UserListPagePackage page(1, 0, 1);
+    for (size_t i = 0; i < 50; ++i) page.users.push_back(UserInfo(static_cast<user_id_t>(i + 1), "user" + std::to_string(i)));
+    bench("USER_LIST_PAGE of 50", page);
+    test::keep(sum);
+}
+
+TEST(counts_larger_than_the_packet_are_rejected_before_allocating)
+{
+    ByteStream varint;
+    varint.writeInt8(protocol::MESSAGE_BATCH_VARINT);
+    protocol::codec::encodeVarint(varint, uint64_t(1) << 40);
+    varint.writeUInt8(1);
+    varint.writeUInt8(0);
+    varint.resetPtr();
+    CHECK_THROWS(protocol::MessageBatchVarintPackage(varint), std::out_of_range);
+
+    ByteStream batch;
+    batch.writeInt8(protocol::MESSAGE_BATCH);
+    batch.writeUInt16(UINT16_MAX);
+    batch.writeUInt16(1);
+    batch.resetPtr();
+    CHECK_THROWS(protocol::MessageBatchPackage(batch), std::out_of_range);
+}
+
+TEST(message_split_cuts_between_utf8_characters)
+{
+    const std::string text = mixedText(200);
+    for (size_t max_bytes = 4; max_bytes <= 40; ++max_bytes)
+    {
+        checkSplit(text, protocol::MessagePackage::split(text, max_bytes), max_bytes);
+    }
+    CHECK(protocol::MessagePackage::split(text, text.length()) == std::vector<std::string>({ text }));
+    CHECK(protocol::MessagePackage::split("", 10) == std::vector<std::string>({ "" }));
+
+    // w/o a character boundary in reach, cut anywhere rather than stall
+    const std::string garbage(10, '\x80');
+    CHECK(protocol::MessagePackage::split(garbage, 4) == std::vector<std::string>({ garbage.substr(0, 4), garbage.substr(4, 4), garbage.substr(8) }));
+}
+
+// Below 4 bytes, chunks are 4 bytes at most, so that any character fits in one
+TEST(message_split_below_4_bytes_makes_progress)
+{
+    const std::string text = mixedText(50);
+    for (size_t max_bytes = 0; max_bytes < 4; ++max_bytes)
+    {
+        checkSplit(text, protocol::MessagePackage::split(text, max_bytes), 4);
+    }
+    CHECK(protocol::MessagePackage::split("abcdef", 1) == std::vector<std::string>({ "abcd", "ef" }));
+    CHECK(protocol::MessagePackage::split("\xF0\x9F\x98\x80\xF0\x9F\x98\x80", 0).size() == 2);
+}
+
+// Chunks sized as the client & host size them fit in a datagram, alone or in a batch
+TEST(message_split_chunks_fit_the_payload)
+{
+    const std::string text = mixedText(3000);
+    for (size_t payload : { size_t(64), size_t(548), size_t(1200), size_t(1400) })
+    {
+        for (const std::string& chunk : protocol::MessagePackage::split(text, payload - protocol::MessagePackage::HEADER_SIZE))
+        {
+            ByteStream s;
+            protocol::MessagePackage(65535, chunk).serialize(s);
+            CHECK(s.getLength() <= payload);
+        }
+
+        const size_t max_text = payload - protocol::MessageBatchPackage::HEADER_SIZE - protocol::MessageBatchPackage::ENTRY_HEADER_SIZE;
+        for (const std::string& chunk : protocol::MessagePackage::split(text, max_text))
+        {
+            protocol::MessageBatchPackage batch;
+            batch.messages.push_back(protocol::MessagePackage(65535, chunk));
+            ByteStream s;
+            batch.serialize(s);
+            CHECK(s.getLength() <= payload);
+        }
+    }
+}
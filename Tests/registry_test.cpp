@@ -0,0 +1,136 @@
+﻿#include <algorithm>
+#include <map>
+#include <random>
+
+#include "test.h"
+#include "chat/user_registry.h"
+
+namespace
+{
+    const size_t USERS = 10000;
+
+    UserInfo makeUser(size_t i)
+    {
+        return UserInfo(static_cast<user_id_t>(i + 1), "user" + std::to_string(i));
+    }
+
+    // User IDs in a random order, the same on every run
+    std::vector<user_id_t> shuffledIDs(size_t count)
+    {
+        std::vector<user_id_t> ids(count);
+        for (size_t i = 0; i < count; ++i) ids[i] = static_cast<user_id_t>(i + 1);
+        std::shuffle(ids.begin(), ids.end(), std::mt19937(42));
+        return ids;
+    }
+}
+
+TEST(registry_finds_users_by_id_and_name)
+{
+    UserRegistry users;
+    CHECK(users.insert(UserInfo(1, "alice")));
+    CHECK(users.insert(UserInfo(7, "bob")));
+    CHECK(!users.insert(UserInfo(7, "eve")));
+    CHECK(users.size() == 2);
+    CHECK(users.find(7) && users.find(7)->name == "bob");
+    CHECK(!users.find(3));
+    CHECK(users.findByName("alice") && users.findByName("alice")->user_id == 1);
+    CHECK(!users.findByName("eve"));
+}
+
+TEST(registry_erase_keeps_other_users_reachable)
+{
+    UserRegistry users;
+    for (size_t i = 0; i < 5; ++i) users.insert(makeUser(i));
+    CHECK(users.erase(2));
+    CHECK(!users.erase(2));
+    CHECK(!users.find(2) && !users.findByName("user1"));
+    for (user_id_t id : { 1, 3, 4, 5 }) CHECK(users.find(id) && users.find(id)->name == "user" + std::to_string(id - 1));
+    CHECK(users.size() == 4);
+    CHECK(users.version() == 6);
+}
+
+TEST(registry_shared_names_resolve_to_the_earliest_holder)
+{
+    UserRegistry users;
+    users.insert(UserInfo(1, "sam"));
+    users.insert(UserInfo(2, "sam"));
+    CHECK(users.findByName("sam")->user_id == 1);
+    users.erase(1);
+    CHECK(users.findByName("sam")->user_id == 2);
+    users.erase(2);
+    CHECK(!users.findByName("sam"));
+}
+
+// Lookups & iteration at 10k users, the dense registry vs the std::map it replaced
+BENCH(registry_10k_users)
+{
+    UserRegistry registry;
+    std::map<user_id_t, UserInfo> map;
+    for (size_t i = 0; i < USERS; ++i)
+    {
+        registry.insert(makeUser(i));
+        map.emplace(static_cast<user_id_t>(i + 1), makeUser(i));
+    }
+    const std::vector<user_id_t> ids = shuffledIDs(USERS);
+
+    size_t next = 0;
+    uint64_t sum = 0;
+    test::report("find by ID, std::map", test::nsPerCall([&]()
+    {
+        auto it = map.find(ids[next++ % USERS]);
+        sum += it->second.name.length();
+    }), "ns");
+    test::report("find by ID, UserRegistry", test::nsPerCall([&]()
+    {
+        sum += registry.find(ids[next++ % USERS])->name.length();
+    }), "ns");
+    test::report("find by name, UserRegistry", test::nsPerCall([&]()
+    {
+        sum += registry.findByName("user" + std::to_string(ids[next++ % USERS] - 1))->user_id;
+    }), "ns");
+
+    test::report("iterate all, std::map", test::nsPerCall([&]()
+    {
+        for (const auto& [id, user] : map) sum += user.name.length();
+    }) / 1000.0, "us");
+    test::report("iterate all, UserRegistry", test::nsPerCall([&]()
+    {
+        registry.forEach([&sum](const UserRef& user) { sum += user.name.length(); });
+    }) / 1000.0, "us");
+
+    const double map_join = test::nsPerCall([&]()
+    {
+        std::map<user_id_t, UserInfo> users;
+        for (size_t i = 0; i < USERS; ++i) users.emplace(static_cast<user_id_t>(i + 1), makeUser(i));
+        sum += users.size();
+    }, std::chrono::milliseconds(1000));
+    const double registry_join = test::nsPerCall([&]()
+    {
+        UserRegistry users;
+        for (size_t i = 0; i < USERS; ++i) users.insert(makeUser(i));
+        sum += users.size();
+    }, std::chrono::milliseconds(1000));
+    test::report("insert 10k, std::map", map_join / 1e6, "ms");
+    test::report("insert 10k, UserRegistry", registry_join / 1e6, "ms");
+    test::keep(sum);
+}
+
+// Copy-on-write cost of publishing a join as a new snapshot, as ChatApp::addUser does, by registry size
+BENCH(registry_snapshot_publish)
+{
+    uint64_t sum = 0;
+    for (size_t size : { 100, 1000, 10000 })
+    {
+        UserRegistry registry;
+        for (size_t i = 0; i < size; ++i) registry.insert(makeUser(i));
+        const UserSnapshot current = std::make_shared<UserRegistry>(registry);
+        const UserInfo joining = makeUser(size);
+        test::report("publish a join at " + std::to_string(size) + " users", test::nsPerCall([&]()
+        {
+            auto users = std::make_shared<UserRegistry>(*current);
+            users->insert(joining);
+            sum += users->size();
+        }) / 1000.0, "us");
+    }
+    test::keep(sum);
+}
@@ -0,0 +1,125 @@
+﻿#include <algorithm>
+#include <atomic>
+#include <thread>
+#include <vector>
+
+#include "test.h"
+#include "chat/chat_win.h"
+
+namespace
+{
+    std::string floodLine(size_t i)
+    {
+        return "user" + std::to_string(i % 50) + ": flooding the room w/ message number " + std::to_string(i);
+    }
+
+    // Opens a window w/ its panels, as the chat states do
+    void open(ChatWindow& window)
+    {
+        window.init();
+        window.clearAll();
+        window.render();
+    }
+
+    // Formats the percentiles of latency samples, in microseconds
+    std::string percentiles(std::vector<double> samples_us)
+    {
+        if (samples_us.empty()) return "n=0";
+        std::sort(samples_us.begin(), samples_us.end());
+        auto at = [&samples_us](double p) { return std::to_string(static_cast<long long>(samples_us[static_cast<size_t>(p * (samples_us.size() - 1))])); };
+        return "n=" + std::to_string(samples_us.size()) + " p50=" + at(0.5) + "us p90=" + at(0.9)
+            + "us p99=" + at(0.99) + "us max=" + at(1.0) + "us";
+    }
+}
+
+// Lines shown per second while a network thread floods the window, repainted once per frame
+BENCH(flood_displayed)
+{
+    const size_t lines = 200000;
+    double seconds = 0.0;
+    size_t frames = 0;
+    {
+        ChatWindow window;
+        open(window);
+        std::atomic<bool> done{ false };
+        const test::Clock::time_point start = test::Clock::now();
+        std::thread network([&]()
+        {
+            for (size_t i = 0; i < lines; ++i) window.print(floodLine(i));
+            done = true;
+        });
+        while (!done)
+        {
+            window.render();
+            frames++;
+            std::this_thread::sleep_for(ChatWindow::FRAME_INTERVAL);
+        }
+        network.join();
+        window.render(); // what's left
+        frames++;
+        seconds = test::secondsSince(start);
+    } // curses ends w/ the window, before reporting
+    test::report("lines displayed, one repaint per frame", lines / seconds, "lines/s");
+    test::report("frames", static_cast<double>(frames), "");
+}
+
+// The same flood w/ a repaint per line, i.e. bound by the terminal, as before frames were coalesced
+BENCH(flood_displayed_repaint_per_line)
+{
+    const size_t lines = 5000;
+    double seconds = 0.0;
+    {
+        ChatWindow window;
+        open(window);
+        const test::Clock::time_point start = test::Clock::now();
+        for (size_t i = 0; i < lines; ++i)
+        {
+            window.print(floodLine(i));
+            window.render();
+        }
+        seconds = test::secondsSince(start);
+    }
+    test::report("lines displayed, one repaint per line", lines / seconds, "lines/s");
+}
+
+// Latency from a line's arrival on the network thread to the frame showing it, at a steady 1000 lines/s,
+// plus how long print() holds the network thread. Only uses print/render, so it runs against any
+// revision of the window, e.g. before & after it became a UI actor
+BENCH(arrival_to_screen_latency)
+{
+    const size_t lines = 3000;
+    const std::chrono::microseconds interval(1000);
+    std::vector<test::Clock::time_point> arrived(lines);
+    std::vector<double> print_us(lines), screen_us;
+    screen_us.reserve(lines);
+    {
+        ChatWindow window;
+        open(window);
+        std::atomic<size_t> printed{ 0 };
+        std::thread network([&]()
+        {
+            test::Clock::time_point next = test::Clock::now();
+            for (size_t i = 0; i < lines; ++i)
+            {
+                std::this_thread::sleep_until(next);
+                next += interval;
+                arrived[i] = test::Clock::now();
+                window.print(floodLine(i));
+                print_us[i] = std::chrono::duration<double, std::micro>(test::Clock::now() - arrived[i]).count();
+                printed.store(i + 1, std::memory_order_release);
+            }
+        });
+        // UI loop as in ChatApp::run, lines printed before a render are on screen once it returns
+        for (size_t shown = 0; shown < lines;)
+        {
+            const size_t ready = printed.load(std::memory_order_acquire);
+            window.render();
+            const test::Clock::time_point now = test::Clock::now();
+            for (; shown < ready; ++shown) screen_us.push_back(std::chrono::duration<double, std::micro>(now - arrived[shown]).count());
+            std::this_thread::sleep_for(ChatWindow::FRAME_INTERVAL);
+        }
+        network.join();
+    }
+    test::report("arrival to screen", percentiles(std::move(screen_us)));
+    test::report("print() on the network thread", percentiles(std::move(print_us)));
+}
@@ -0,0 +1,128 @@
+﻿#include <algorithm>
+
+#include "test.h"
+#include "host_session.h"
+#include "chat/message_batcher.h"
+#include "chat/room_registry.h"
+
+namespace
+{
+    bool sameMembers(std::vector<user_id_t> members, std::vector<user_id_t> expected)
+    {
+        std::sort(members.begin(), members.end());
+        std::sort(expected.begin(), expected.end());
+        return members == expected;
+    }
+
+    bool listed(const std::vector<UserInfo>& users, user_id_t user_id)
+    {
+        return std::any_of(users.begin(), users.end(), [user_id](const UserInfo& user) { return user.user_id == user_id; });
+    }
+}
+
+// Leaving moves the room's last member into the freed slot, which must still find it
+TEST(room_registry_swap_remove_keeps_members_reachable)
+{
+    RoomRegistry rooms;
+    const room_id_t games = rooms.join(1, "games");
+    for (user_id_t user_id = 2; user_id <= 4; ++user_id) rooms.join(user_id, "games");
+
+    rooms.remove(1); // 4 takes its slot
+    CHECK(sameMembers(rooms.members(games), { 2, 3, 4 }));
+    rooms.remove(4);
+    CHECK(sameMembers(rooms.members(games), { 2, 3 }));
+    rooms.join(3, std::string());
+    CHECK(sameMembers(rooms.members(games), { 2 }));
+    CHECK(sameMembers(rooms.members(RoomRegistry::LOBBY), { 3 }));
+    CHECK(!rooms.contains(1) && !rooms.contains(4));
+    CHECK(rooms.roomOf(2) == games && rooms.roomOf(3) == RoomRegistry::LOBBY);
+}
+
+TEST(room_registry_reuses_the_id_of_a_dropped_room)
+{
+    RoomRegistry rooms;
+    const room_id_t games = rooms.join(1, "games");
+    const room_id_t music = rooms.join(2, "music");
+    rooms.join(1, std::string()); // games is dropped w/ its last member
+    CHECK(rooms.members(games).empty() && rooms.name(games).empty());
+
+    CHECK(rooms.join(3, "books") == games);
+    CHECK(rooms.name(games) == "books" && sameMembers(rooms.members(games), { 3 }));
+    CHECK(rooms.join(4, "games") != games); // a new room by the old name
+    CHECK(rooms.name(music) == "music" && sameMembers(rooms.members(music), { 2 }));
+}
+
+TEST(batcher_hands_each_line_its_room)
+{
+    std::vector<room_id_t> flushed;
+    MessageBatcher batcher([&](const std::vector<protocol::MessagePackage>& messages, const std::vector<room_id_t>& rooms)
+    {
+        CHECK(messages.size() == rooms.size());
+        flushed.insert(flushed.end(), rooms.begin(), rooms.end());
+    });
+    batcher.add(protocol::MessagePackage(1, "in games"), 2);
+    batcher.add(protocol::MessagePackage(1, "in music"), 5);
+    batcher.flush();
+    batcher.add(protocol::MessagePackage(1, "in the lobby"));
+    batcher.flush();
+    CHECK(flushed == std::vector<room_id_t>({ 2, 5, RoomRegistry::LOBBY }));
+}
+
+// A line goes to the room its sender was in when it was said, even if the sender moves
+// on before the batch is flushed
+TEST(host_sends_lines_to_the_room_they_were_said_in)
+{
+    test::HostSession session;
+    const size_t alice = session.join("alice", protocol::CAP_ROOMS);
+    session.host->paused = true;
+    session.host->handleInput("said in the lobby");
+    session.host->handleInput(JOIN_CMD " games");
+    session.host->paused = false;
+    CHECK(session.await<protocol::MessagePackage>(alice, [](const protocol::MessagePackage& pkg) { return pkg.message == "said in the lobby"; }));
+
+    // & it's kept as lobby history
+    const size_t bob = session.join("bob", protocol::CAP_ROOMS);
+    CHECK(session.await<protocol::MessagePackage>(bob, [](const protocol::MessagePackage& pkg) { return pkg.message == "said in the lobby"; }));
+}
+
+// Clients only follow their own room's user list
+TEST(host_scopes_user_deltas_to_the_room)
+{
+    test::HostSession session;
+    const size_t alice = session.join("alice", protocol::CAP_ROOMS);
+    const size_t bob = session.join("bob", protocol::CAP_ROOMS);
+    const size_t carol = session.join("carol", protocol::CAP_ROOMS);
+    const user_id_t alice_id = session.client(alice).user_id;
+    const user_id_t bob_id = session.client(bob).user_id;
+
+    session.send(alice, protocol::JoinRoomPackage("games"));
+    CHECK(session.await<protocol::RoomMembersPackage>(alice));
+    session.send(bob, protocol::JoinRoomPackage("games"));
+    CHECK(session.await<protocol::RoomMembersPackage>(bob));
+
+    // bob gets the list of games: alice & bob
+    const protocol::RoomMembersPackage members = session.received<protocol::RoomMembersPackage>(bob).back();
+    CHECK(members.room == "games" && members.member_count == 2 && members.page_count == 1);
+    CHECK(session.await<protocol::UserListPagePackage>(bob, [&](const protocol::UserListPagePackage& page)
+    {
+        return page.roster_version == members.roster_version && page.users.size() == 2 && listed(page.users, alice_id) && listed(page.users, bob_id);
+    }));
+
+    // alice hears of bob joining, carol of bob leaving the lobby
+    CHECK(session.await<protocol::UserDeltaPackage>(alice, [&](const protocol::UserDeltaPackage& delta) { return listed(delta.added, bob_id); }));
+    CHECK(session.await<protocol::UserDeltaPackage>(carol, [&](const protocol::UserDeltaPackage& delta)
+    {
+        return std::find(delta.removed.begin(), delta.removed.end(), bob_id) != delta.removed.end();
+    }));
+
+    // a join in the lobby doesn't reach games
+    session.settle();
+    session.clear(alice);
+    session.clear(bob);
+    const size_t dave = session.join("dave", protocol::CAP_ROOMS);
+    const user_id_t dave_id = session.client(dave).user_id;
+    CHECK(session.await<protocol::UserDeltaPackage>(carol, [&](const protocol::UserDeltaPackage& delta) { return listed(delta.added, dave_id); }));
+    session.settle();
+    CHECK(session.received<protocol::UserDeltaPackage>(alice).empty());
+    CHECK(session.received<protocol::UserDeltaPackage>(bob).empty());
+}
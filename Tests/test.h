@@ -0,0 +1,112 @@
+﻿#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+/**
+ * Minimal test & benchmark harness
+ *
+ * TEST(name) & BENCH(name) register a function, main runs them in registration
+ * order: tests always, benchmarks w/ --bench. A failed CHECK is reported & fails
+ * the run w/o stopping it, an exception escaping a case fails it too.
+ */
+namespace test
+{
+    typedef void (*Function)();
+    typedef std::chrono::steady_clock Clock;
+
+    struct Case
+    {
+        const char* name;
+        Function function;
+        bool bench; ///< benchmark, only run on request
+    };
+
+    // All registered cases
+    inline std::vector<Case>& cases()
+    {
+        static std::vector<Case> cases;
+        return cases;
+    }
+
+    struct Registrar
+    {
+        Registrar(const char* name, Function function, bool bench) { cases().push_back({ name, function, bench }); }
+    };
+
+    // Failed checks so far
+    inline int& failures()
+    {
+        static int failures = 0;
+        return failures;
+    }
+
+    inline void fail(const char* file, int line, const char* what)
+    {
+        std::printf("  %s(%d): %s\n", file, line, what);
+        failures()++;
+    }
+
+    // Keeps a computed value alive, so the optimizer can't drop the work producing it
+    inline void keep(uint64_t value)
+    {
+        static volatile uint64_t sink;
+        sink = value;
+    }
+
+    // Calls f() repeatedly for at least min_time
+    // @return mean time per call, in nanoseconds
+    template <typename F>
+    double nsPerCall(F&& f, std::chrono::milliseconds min_time = std::chrono::milliseconds(300))
+    {
+        const Clock::time_point start = Clock::now();
+        Clock::duration elapsed;
+        uint64_t calls = 0;
+        do
+        {
+            for (int i = 0; i < 8; ++i) f();
+            calls += 8;
+            elapsed = Clock::now() - start;
+        } while (elapsed < min_time);
+        return std::chrono::duration<double, std::nano>(elapsed).count() / static_cast<double>(calls);
+    }
+
+    // Seconds since a time point
+    inline double secondsSince(Clock::time_point start)
+    {
+        return std::chrono::duration<double>(Clock::now() - start).count();
+    }
+
+    // Prints a measurement, one per line
+    inline void report(const std::string& what, double value, const char* unit)
+    {
+        std::printf("  %-56s %14.1f %s\n", what.c_str(), value, unit);
+    }
+
+    inline void report(const std::string& what, const std::string& value)
+    {
+        std::printf("  %-56s %s\n", what.c_str(), value.c_str());
+    }
+}
+
+#define TEST(name) \
+    static void test_##name(); \
+    static const test::Registrar test_registrar_##name(#name, &test_##name, false); \
+    static void test_##name()
+
+#define BENCH(name) \
+    static void bench_##name(); \
+    static const test::Registrar bench_registrar_##name(#name, &bench_##name, true); \
+    static void bench_##name()
+
+#define CHECK(expression) \
+    do { if (!(expression)) test::fail(__FILE__, __LINE__, "CHECK(" #expression ") failed"); } while (0)
+
+#define CHECK_THROWS(expression, exception) \
+    do { \
+        try { (void)(expression); test::fail(__FILE__, __LINE__, #expression " didn't throw " #exception); } \
+        catch (const exception&) {} \
+    } while (0)
@@ -0,0 +1,241 @@
+﻿#include <algorithm>
+#include <atomic>
+#include <thread>
+
+#include "test.h"
+#include "host_session.h"
+#include "chat/roster_log.h"
+#include "chat/user_list_cache.h"
+#include "chat/state/chat_state_client.h"
+
+namespace
+{
+    const size_t MAX_PACKET = 1200; ///< page size used below, about an MTU
+
+    UserInfo makeUser(size_t i)
+    {
+        return UserInfo(static_cast<user_id_t>(i + 1), "user" + std::to_string(i));
+    }
+
+    // IDs of all registered users, e.g. everyone in the lobby
+    std::vector<user_id_t> everyone(const UserRegistry& registry)
+    {
+        std::vector<user_id_t> members;
+        registry.forEach([&members](const UserRef& user) { members.push_back(user.user_id); });
+        return members;
+    }
+
+    // Decodes cached pages the way a client receives them
+    std::vector<UserInfo> decodePages(const std::deque<UserListCache::Page>& pages)
+    {
+        std::vector<UserInfo> users;
+        for (size_t i = 0; i < pages.size(); ++i)
+        {
+            ByteStream s;
+            protocol::UserListPagePackage::serializeHeader(s, 1, static_cast<uint16_t>(i), static_cast<uint16_t>(pages.size()), pages[i].count);
+            s.writeBytes(pages[i].users.getBufPtr(), pages[i].users.getLength());
+            CHECK(s.getLength() <= MAX_PACKET);
+            s.resetPtr();
+            protocol::UserListPagePackage pkg(s);
+            users.insert(users.end(), pkg.users.begin(), pkg.users.end());
+        }
+        return users;
+    }
+
+    bool listed(const std::vector<UserInfo>& users, const std::string& name)
+    {
+        return std::any_of(users.begin(), users.end(), [&name](const UserInfo& user) { return user.name == name; });
+    }
+
+    // The client state, noting how the host synced its user list
+    class SyncedClient : public ChatState_Client
+    {
+    public:
+        SyncedClient(ChatApp* app) : ChatState_Client(app) {}
+
+        void receiveUsernameAckEvent(protocol::UsernameAckPackage& pkg) override
+        {
+            last_page_count = pkg.page_count;
+            acks++;
+            ChatState_Client::receiveUsernameAckEvent(pkg);
+        }
+
+        void receiveUserListPageEvent(protocol::UserListPagePackage& pkg) override
+        {
+            pages++;
+            ChatState_Client::receiveUserListPageEvent(pkg);
+        }
+
+        void receiveUserDeltaEvent(protocol::UserDeltaPackage& pkg) override
+        {
+            const bool applies = pkg.from_version == m_app->getRosterVersion()->version;
+            ChatState_Client::receiveUserDeltaEvent(pkg);
+            if (applies) deltas++;
+        }
+
+        std::atomic<size_t> acks{ 0 };
+        std::atomic<size_t> pages{ 0 };
+        std::atomic<size_t> deltas{ 0 }; ///< applied ones
+        std::atomic<uint16_t> last_page_count{ 0 };
+    };
+
+    template <typename Condition>
+    bool waitFor(Condition condition, double timeout = 3.0)
+    {
+        const test::Clock::time_point start = test::Clock::now();
+        while (!condition())
+        {
+            if (test::secondsSince(start) > timeout) return false;
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+        return true;
+    }
+}
+
+TEST(user_list_cache_pages_decode_to_the_registry)
+{
+    UserRegistry registry;
+    UserListCache cache;
+    cache.get(registry, everyone(registry), MAX_PACKET);
+    for (size_t i = 0; i < 300; ++i)
+    {
+        registry.insert(makeUser(i));
+        cache.add(makeUser(i)); // appended in place
+    }
+    const std::vector<UserInfo> users = decodePages(cache.get(registry, everyone(registry), MAX_PACKET));
+    CHECK(cache.get(registry, everyone(registry), MAX_PACKET).size() > 1);
+    CHECK(users.size() == 300);
+    for (size_t i = 0; i < users.size(); ++i) CHECK(users[i].user_id == i + 1 && users[i].name == makeUser(i).name);
+}
+
+TEST(user_list_cache_rebuilds_after_a_leave)
+{
+    UserRegistry registry;
+    UserListCache cache;
+    for (size_t i = 0; i < 3; ++i) registry.insert(makeUser(i));
+    CHECK(decodePages(cache.get(registry, everyone(registry), MAX_PACKET)).size() == 3);
+    registry.erase(2);
+    cache.invalidate();
+    const std::vector<UserInfo> users = decodePages(cache.get(registry, everyone(registry), MAX_PACKET));
+    CHECK(users.size() == 2);
+    for (const UserInfo& user : users) CHECK(user.user_id != 2);
+}
+
+TEST(roster_log_compacts_changes_since_a_version)
+{
+    RosterLog roster(4);
+    roster.add(makeUser(0));
+    roster.add(makeUser(1));
+    const uint32_t known = roster.version();
+    roster.remove(1);
+    roster.add(makeUser(2));
+
+    std::vector<user_id_t> removed;
+    std::vector<UserInfo> added;
+    CHECK(roster.since(known, removed, added));
+    CHECK(removed.size() == 1 && removed[0] == 1);
+    CHECK(added.size() == 1 && added[0].user_id == 3);
+
+    roster.add(makeUser(3));
+    roster.add(makeUser(4)); // the log only holds 4 changes
+    CHECK(!roster.since(0, removed, added));
+    CHECK(!roster.since(roster.version() + 1, removed, added));
+}
+
+// Host-side user list work for 5000 clients joining, each sent the full list: the cached pages vs
+// serializing every user per join, as USERNAME_ACK did before
+// A client that knows a version of the current epoch gets the changes since as a delta, not the pages
+TEST(host_syncs_a_known_version_w_a_delta)
+{
+    test::HostSession session;
+    const size_t alice = session.join("alice", 0);
+    const protocol::UsernameAckPackage known = session.received<protocol::UsernameAckPackage>(alice).back();
+    session.join("bob", 0);
+    session.leave(alice);
+
+    const size_t carol = session.join("carol", 0, known.roster_epoch, known.roster_version);
+    const protocol::UsernameAckPackage ack = session.received<protocol::UsernameAckPackage>(carol).back();
+    CHECK(ack.page_count == 0 && ack.roster_epoch == known.roster_epoch && ack.roster_version > known.roster_version);
+    CHECK(session.await<protocol::UserDeltaPackage>(carol, [&](const protocol::UserDeltaPackage& delta)
+    {
+        return delta.from_version == known.roster_version && delta.to_version == ack.roster_version
+            && listed(delta.added, "bob") && listed(delta.added, "carol");
+    }));
+    session.settle();
+    CHECK(session.received<protocol::UserListPagePackage>(carol).empty());
+
+    // another epoch's version means nothing here: pages
+    const size_t dave = session.join("dave", 0, known.roster_epoch + 1, known.roster_version);
+    CHECK(session.received<protocol::UsernameAckPackage>(dave).back().page_count > 0);
+    CHECK(session.await<protocol::UserListPagePackage>(dave));
+}
+
+// A client losing its connection reconnects w/ the user list version it has, & is caught up w/ a delta
+TEST(client_reconnects_w_its_user_list_version)
+{
+    test::HostSession session;
+    session.join("alice", 0);
+    ChatApp app;
+    app.getConfig()->checksum = false;
+    app.getConfig()->encryption = false;
+    app.getConfig()->nickname = "bob";
+    SyncedClient* client = new SyncedClient(&app);
+    app.goToState(client); // connects
+    CHECK(waitFor([&] { return client->acks == 1 && client->pages == 1; }));
+    const UserHandle local = app.getLocalUser();
+    CHECK(local);
+    if (!local) return;
+
+    const size_t deltas = client->deltas;
+    session.app.disconnect(local->user_id);
+    CHECK(waitFor([&] { return client->acks == 2 && client->deltas > deltas; }));
+    CHECK(client->last_page_count == 0 && client->pages == 1);
+    CHECK(app.getLocalUser() && app.getUsers()->size() == 3); // host, alice & bob
+}
+
+BENCH(join_storm_5000)
+{
+    const size_t joins = 5000;
+    uint64_t bytes = 0;
+
+    test::Clock::time_point start = test::Clock::now();
+    {
+        UserRegistry registry;
+        UserListCache cache;
+        RosterLog roster;
+        std::vector<user_id_t> members; // all in the lobby
+        for (size_t i = 0; i < joins; ++i)
+        {
+            const UserInfo user = makeUser(i);
+            registry.insert(user);
+            members.push_back(user.user_id);
+            roster.add(user);
+            cache.add(user);
+            // one packet per page, header + the pre-serialized users (copied into the packet, as ENet does)
+            const std::deque<UserListCache::Page>& pages = cache.get(registry, members, MAX_PACKET);
+            for (size_t page = 0; page < pages.size(); ++page)
+            {
+                ByteStream packet;
+                protocol::UserListPagePackage::serializeHeader(packet, roster.version(), static_cast<uint16_t>(page),
+                    static_cast<uint16_t>(pages.size()), pages[page].count);
+                packet.writeBytes(pages[page].users.getBufPtr(), pages[page].users.getLength());
+                bytes += packet.getLength();
+            }
+        }
+    }
+    test::report("5000 joins, cached user list pages", test::secondsSince(start) * 1000.0, "ms");
+
+    start = test::Clock::now();
+    {
+        UserRegistry registry;
+        for (size_t i = 0; i < joins; ++i)
+        {
+            registry.insert(makeUser(i));
+            ByteStream packet;
+            protocol::codec::encode(packet, registry.list());
+            bytes += packet.getLength();
+        }
+    }
+    test::report("5000 joins, serializing all users per join", test::secondsSince(start) * 1000.0, "ms");
+    test::keep(bytes);
+}
@@ -0,0 +1,60 @@
+﻿#include "test.h"
+#include "util/utf8.h"
+
+TEST(utf8_length_counts_code_points)
+{
+    CHECK(utf8::length("") == 0);
+    CHECK(utf8::length("plain") == 5);
+    CHECK(utf8::length("h\xC3\xA9llo") == 5);                  // é, 2 bytes
+    CHECK(utf8::length("\xE2\x9C\x93 \xF0\x9F\x98\x80") == 3); // check mark (3 bytes), space, emoji (4 bytes)
+}
+
+// Rows of a wrapped message, as ChatWindow::drawMessages cuts them
+TEST(utf8_advance_wraps_between_characters)
+{
+    const std::string_view text = "na\xC3\xAFve caf\xC3\xA9 \xE2\x9C\x93\xF0\x9F\x98\x80!";
+    const size_t width = 3;
+    size_t rows = 0;
+    size_t characters = 0;
+    for (size_t begin = 0; begin < text.length(); ++rows)
+    {
+        const size_t end = utf8::advance(text, begin, width);
+        CHECK(end > begin);
+        CHECK(!utf8::isContinuation(text[begin])); // rows start on a character
+        CHECK(end == text.length() || !utf8::isContinuation(text[end]));
+        const size_t row_length = utf8::length(text.substr(begin, end - begin));
+        CHECK(row_length == width || end == text.length());
+        characters += row_length;
+        begin = end;
+    }
+    CHECK(characters == utf8::length(text));
+    CHECK(rows == (utf8::length(text) + width - 1) / width);
+}
+
+TEST(utf8_advance_clamps_to_the_end)
+{
+    CHECK(utf8::advance("ab", 0, 5) == 2);
+    CHECK(utf8::advance("\xC3\xA9", 0, 1) == 2);
+    CHECK(utf8::advance("\xC3\xA9", 2, 1) == 2);
+}
+
+TEST(utf8_retreat_steps_back_over_characters)
+{
+    const std::string_view text = "a\xC3\xA9\xF0\x9F\x98\x80";
+    CHECK(utf8::retreat(text, text.length(), 1) == 3);
+    CHECK(utf8::retreat(text, text.length(), 2) == 1);
+    CHECK(utf8::retreat(text, 3, 5) == 0);
+}
+
+TEST(utf8_append_encodes_code_points)
+{
+    std::string text;
+    for (char32_t code_point : { U'a', U'é', U'€', U'\U0001F600' }) utf8::append(text, code_point);
+    CHECK(text == "a\xC3\xA9\xE2\x82\xAC\xF0\x9F\x98\x80");
+    CHECK(utf8::length(text) == 4);
+    CHECK(utf8::sequenceLength(text[1]) == 2 && utf8::sequenceLength(text[3]) == 3 && utf8::sequenceLength(text[6]) == 4);
+
+    text.clear();
+    utf8::append(text, 0xD800); // a lone surrogate
+    CHECK(text == "\xEF\xBF\xBD");
+}